@@ -12,6 +12,8 @@
 #include "PicoLCD_I2C.h"
 #include <Arduino.h>
 
+static PicoLCD_I2C *async_lcd = NULL;   // display of the interrupt handler
+
 PicoLCD_I2C::PicoLCD_I2C(uint8_t i2c_port, uint8_t addr, uint8_t scl, uint8_t sda) {
   _i2c_port = i2c_port;
   _addr = addr;
@@ -20,6 +22,8 @@ PicoLCD_I2C::PicoLCD_I2C(uint8_t i2c_port, uint8_t addr, uint8_t scl, uint8_t sd
   _linesize = 20;
   _i2c_speed = 100000;
   _backlight = LCD_NOBACKLIGHT;
+  _async_active = false;
+  _async_irq = false;
 }
 
 PicoLCD_I2C::PicoLCD_I2C(uint8_t i2c_port, uint8_t addr, uint8_t scl, uint8_t sda, uint8_t linesize) {
@@ -30,6 +34,8 @@ PicoLCD_I2C::PicoLCD_I2C(uint8_t i2c_port, uint8_t addr, uint8_t scl, uint8_t sd
   _linesize = linesize;
   _i2c_speed = 100000;
   _backlight = LCD_NOBACKLIGHT;
+  _async_active = false;
+  _async_irq = false;
 }
 
 PicoLCD_I2C::PicoLCD_I2C(uint8_t i2c_port, uint8_t addr, uint8_t scl, uint8_t sda, uint8_t linesize, uint32_t i2c_speed) {
@@ -40,34 +46,44 @@ PicoLCD_I2C::PicoLCD_I2C(uint8_t i2c_port, uint8_t addr, uint8_t scl, uint8_t sd
   _linesize = linesize;
   _i2c_speed = i2c_speed;
   _backlight = LCD_NOBACKLIGHT;
+  _async_active = false;
+  _async_irq = false;
 }
 
-void PicoLCD_I2C::i2c_write_byte(uint8_t value) {
-  if (_i2c_port == 0)
-    i2c_write_blocking(i2c0, _addr, &value, 1, false);
-  else
-    i2c_write_blocking(i2c1, _addr, &value, 1, false);
+i2c_inst_t *PicoLCD_I2C::port(void) {
+  return (_i2c_port == 0) ? i2c0 : i2c1;
 }
 
-void PicoLCD_I2C::toggle_enable(uint8_t value) {
-    // Toggle enable pin on LCD display
-    i2c_write_byte(value | LCD_ENABLE_BIT);
-    delayMicroseconds(1);
-    i2c_write_byte(value & ~LCD_ENABLE_BIT);
-    delayMicroseconds(DELAY_US);
+void PicoLCD_I2C::i2c_write(const uint8_t *data, size_t len) {
+  while (busy());
+  i2c_write_blocking(port(), _addr, data, len, false);
 }
 
-void PicoLCD_I2C::send_byte(uint8_t val, uint8_t mode) {
+/* Appends the I2C bytes of a display byte: per nibble enable high, enable low.
+ Each I2C byte takes 22.5us at 400 kHz (more at 100 kHz), longer than the enable 
+ pulse and the setup times, and the 4 bytes of a character take longer than its 
+ execution (37us), so a transfer of several bytes needs no delays.
+ */
+uint8_t *PicoLCD_I2C::put_byte(uint8_t *p, uint8_t val, uint8_t mode) {
     uint8_t upper_nibble;
     uint8_t lower_nibble;
 
     upper_nibble = mode | (val & 0xF0) | _backlight;
     lower_nibble = mode | ((val << 4) & 0xF0) | _backlight;
- 
-    i2c_write_byte(upper_nibble);
-    toggle_enable(upper_nibble);
-    i2c_write_byte(lower_nibble);
-    toggle_enable(lower_nibble);
+
+    *p++ = upper_nibble | LCD_ENABLE_BIT;
+    *p++ = upper_nibble;
+    *p++ = lower_nibble | LCD_ENABLE_BIT;
+    *p++ = lower_nibble;
+    return p;
+}
+
+void PicoLCD_I2C::send_byte(uint8_t val, uint8_t mode) {
+    uint8_t data[5];
+
+    data[0] = mode | _backlight;      // register select before the enable pulse
+    i2c_write(data, put_byte(data + 1, val, mode) - data);
+    delayMicroseconds(DELAY_US);
 }
 
 void PicoLCD_I2C::begin(void) {
@@ -110,9 +126,98 @@ void PicoLCD_I2C::write(char value) {
 }
 
 void PicoLCD_I2C::print(const char *s) {
+  uint8_t data[4 * LCD_RUN_MAX + 1];
+  uint8_t *p;
+
   while (*s) {
-    write(*s++);
+    p = data;
+    *p++ = LCD_CHARACTER | _backlight;
+    while (*s && (p + 4 <= data + sizeof(data))) p = put_byte(p, *s++, LCD_CHARACTER);
+    i2c_write(data, p - data);
+  }
+}
+
+// Writes n characters (max LCD_RUN_MAX) at x, y in a single I2C transfer
+void PicoLCD_I2C::writeAt(uint8_t x, uint8_t y, const char *s, uint8_t n) {
+  uint8_t data[LCD_RUN_BYTES(LCD_RUN_MAX)];
+
+  if (n > LCD_RUN_MAX) n = LCD_RUN_MAX;
+  i2c_write(data, encodeAt(data, x, y, s, n) - data);
+}
+
+// Appends the I2C bytes of n characters at x, y (LCD_RUN_BYTES(n)) to p, 
+// returns the end. Several runs can be sent as one transfer.
+uint8_t *PicoLCD_I2C::encodeAt(uint8_t *p, uint8_t x, uint8_t y, const char *s, uint8_t n) {
+  *p++ = LCD_COMMAND | _backlight;
+  p = put_byte(p, cursor_command(x, y), LCD_COMMAND);
+  *p++ = LCD_CHARACTER | _backlight;
+  while (n--) p = put_byte(p, *s++, LCD_CHARACTER);
+  return p;
+}
+
+/* Starts an interrupt driven transfer of encoded bytes (encodeAt), data has 
+ to stay unchanged until busy() returns false. The interrupt refills the I2C
+ transmit FIFO, the caller does not wait for the bus. Returns false while the
+ last transfer is running. Only one display per program can use it.
+ */
+bool PicoLCD_I2C::writeAsync(const uint8_t *data, uint16_t len) {
+  i2c_hw_t *hw = i2c_get_hw(port());
+  uint irq = (_i2c_port == 0) ? I2C0_IRQ : I2C1_IRQ;
+
+  if (busy() || (len == 0)) return false;
+  if (!_async_irq) {
+    async_lcd = this;
+    irq_set_exclusive_handler(irq, lcd_i2c_irq);
+    irq_set_enabled(irq, true);
+    _async_irq = true;
   }
+  hw->enable = 0;
+  hw->tar = _addr;
+  hw->enable = 1;
+  (void) (uint32_t) hw->clr_stop_det;
+  _async_data = data;
+  _async_len = len;
+  _async_pos = 0;
+  _async_active = true;
+  hw->tx_tl = LCD_I2C_TX_LEVEL;
+  hw->intr_mask = I2C_IC_INTR_MASK_M_TX_EMPTY_BITS | I2C_IC_INTR_MASK_M_TX_ABRT_BITS;
+  return true;
+}
+
+// True while an asynchronous transfer is queued or on the bus
+bool PicoLCD_I2C::busy(void) {
+  i2c_hw_t *hw;
+
+  if (!_async_active) return false;
+  if (_async_pos < _async_len) return true;
+  hw = i2c_get_hw(port());
+  if (!(hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_STOP_DET_BITS)) return true;
+  _async_active = false;
+  return false;
+}
+
+// Transmit FIFO at or below LCD_I2C_TX_LEVEL: refill, the last byte with 
+// the stop condition. An abort (no acknowledge) drops the transfer.
+void PicoLCD_I2C::run_irq(void) {
+  i2c_hw_t *hw = i2c_get_hw(port());
+  uint16_t pos = _async_pos;
+  uint32_t cmd;
+
+  if (hw->raw_intr_stat & I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS) {
+    (void) (uint32_t) hw->clr_tx_abrt;
+    pos = _async_len;
+  }
+  while ((pos < _async_len) && (hw->txflr < LCD_I2C_FIFO)) {
+    cmd = _async_data[pos++];
+    if (pos == _async_len) cmd |= I2C_IC_DATA_CMD_STOP_BITS;
+    hw->data_cmd = cmd;
+  }
+  _async_pos = pos;
+  if (pos >= _async_len) hw->intr_mask = 0;
+}
+
+void lcd_i2c_irq(void) {
+  async_lcd->run_irq();
 }
 
 void PicoLCD_I2C::setBacklight(bool backlight) {
@@ -152,10 +257,13 @@ void PicoLCD_I2C::blinkOff(void) {
 	send_byte(_displaycontrol | LCD_DISPLAYCONTROL, LCD_COMMAND);
 }
 
-void PicoLCD_I2C::setCursor(uint8_t x, uint8_t y) {
+uint8_t PicoLCD_I2C::cursor_command(uint8_t x, uint8_t y) {
   uint8_t line_offsets[] = { 0x00, 0x40, _linesize, (uint8_t) (0x40 + _linesize) };
-  uint8_t value = 0x80 + line_offsets[y] + x;
-  send_byte(value, LCD_COMMAND);
+  return LCD_SETDDRAMADDR + line_offsets[y] + x;
+}
+
+void PicoLCD_I2C::setCursor(uint8_t x, uint8_t y) {
+  send_byte(cursor_command(x, y), LCD_COMMAND);
 }
 
 void PicoLCD_I2C::home(void) {
@@ -14,6 +14,7 @@
 
 #include "pico/stdlib.h"
 #include "hardware/i2c.h"
+#include "hardware/irq.h"
 
 // commands
 #define LCD_CLEARDISPLAY    0x01
@@ -56,6 +57,15 @@
 // Timing
 #define DELAY_US            70
 
+// Characters per I2C transfer (writeAt)
+#define LCD_RUN_MAX         20
+// Bytes of a cursor position and n characters (encodeAt)
+#define LCD_RUN_BYTES(n)    (4 * ((n) + 1) + 2)
+
+// Asynchronous transfer (writeAsync)
+#define LCD_I2C_FIFO        16   // transmit FIFO of the rp2040 I2C
+#define LCD_I2C_TX_LEVEL     4   // interrupt at or below this fill level
+
 
 class PicoLCD_I2C {
   private: 
@@ -67,9 +77,16 @@ class PicoLCD_I2C {
     uint32_t _i2c_speed; // usually 100000 or 400000
 	uint8_t _displaycontrol;
     uint8_t _backlight;  
+    const uint8_t *_async_data;
+    volatile uint16_t _async_len;
+    volatile uint16_t _async_pos;
+    bool _async_active;
+    bool _async_irq;
     
-    void i2c_write_byte(uint8_t value);
-    void toggle_enable(uint8_t value);
+    i2c_inst_t *port(void);
+    void i2c_write(const uint8_t *data, size_t len);
+    uint8_t *put_byte(uint8_t *p, uint8_t value, uint8_t mode);
+    uint8_t cursor_command(uint8_t x, uint8_t y);
     void send_byte(uint8_t value, uint8_t mode);
 
   public:
@@ -80,6 +97,11 @@ class PicoLCD_I2C {
     void clear(void);
     void write(char value);
     void print(const char *s);
+    void writeAt(uint8_t x, uint8_t y, const char *s, uint8_t n);
+    uint8_t *encodeAt(uint8_t *p, uint8_t x, uint8_t y, const char *s, uint8_t n);
+    bool writeAsync(const uint8_t *data, uint16_t len);
+    bool busy(void);
+    void run_irq(void);
     void setCursor(uint8_t x, uint8_t y);
     void home(void);
     void setBacklight(bool backlight);
@@ -92,4 +114,7 @@ class PicoLCD_I2C {
     void createChar(uint8_t location, uint8_t charmap[]);
 };
 
+// Function prototypes
+void lcd_i2c_irq(void);
+
 #endif
@@ -49,27 +49,26 @@ def get_data(loops = 3):
 
 
 def turn_car(angdgr):
-    """ Turns the car by a given number of degrees """
-    divider = 21.35
-    if angdgr < 0:
-        mot.run(-15, 0)
-        angdgr = -angdgr
-    else:
-        mot.run(15, 0)
-    time.sleep(angdgr / divider)
-    mot.run(0, 0)
+    """ Turns the car by a given number of degrees (positive -> clockwise) """
+    mot.turn(-angdgr)
     
     
 def move_car(y):
     """ Moves the car by a given amount of mm """
-    divider = 79.8
-    if y < 0:
-        mot.run(0, -15)
-        y = -y
-    else:
-        mot.run(0, 15)
-    time.sleep(y / divider)
-    mot.run(0, 0)
+    mot.move(y)
+    
+    
+def pose_guess(pose_1, pose_2):
+    """ Initial guess for icp_2d from the odometry poses at both scans.
+        Returns the rotation (clockwise, degrees) and the translation (lidar
+        coordinates: x right, y forward) of the car in the frame of pose_1 """
+    x1, y1, h1 = pose_1[:3]
+    x2, y2, h2 = pose_2[:3]
+    dx, dy = x2 - x1, y2 - y1
+    h1_rad = h1 * math.pi / 180
+    fwd = math.cos(h1_rad) * dx + math.sin(h1_rad) * dy
+    left = -math.sin(h1_rad) * dx + math.cos(h1_rad) * dy
+    return -(h2 - h1), -left, fwd
     
     
 def match_org(xy_org_front, xy_org_back, limit=1200):
@@ -103,15 +102,20 @@ start_lidar()
 fig, ax = plt.subplots(figsize=(9, 9))
 
 # First position
+mot.reset_pose()
 xy_first = get_data()
+pose_first = mot.get_pose()
 ax = plot_data(ax, xy_first, 'blue')
 ax = plot_car(ax, car, 'blue')
 
 # Move to second position
 move_car(300)
 xy_second = get_data()
+pose_second = mot.get_pose()
 # Calculate new position
-theta_dgr_1, tx_1, ty_1, mean_err, iterations = icp_2d(xy_second, xy_first, verbose=True)
+ang, tx, ty = pose_guess(pose_first, pose_second)
+theta_dgr_1, tx_1, ty_1, mean_err, iterations = icp_2d(xy_second, xy_first, angdgr_guess=ang,
+                                                       tx_guess=tx, ty_guess=ty, verbose=True)
 # Transform car and point cloud
 xy_second_transformed = transform_pc(xy_second, theta_dgr_1, tx_1, ty_1)
 car = transform_pc(car, theta_dgr_1, tx_1, ty_1)
@@ -122,8 +126,11 @@ ax = plot_car(ax, car, 'green')
 turn_car(20)
 move_car(300)
 xy_third = get_data()
+pose_third = mot.get_pose()
 # Calculate new position
-theta_dgr_2, tx_2, ty_2, mean_err, iterations = icp_2d(xy_third, xy_second, verbose=True)
+ang, tx, ty = pose_guess(pose_second, pose_third)
+theta_dgr_2, tx_2, ty_2, mean_err, iterations = icp_2d(xy_third, xy_second, angdgr_guess=ang,
+                                                       tx_guess=tx, ty_guess=ty, verbose=True)
 # Transform car and point cloud
 xy_third_transformed = transform_pc(xy_third, theta_dgr_2, tx_2, ty_2)
 xy_third_transformed = transform_pc(xy_third_transformed, theta_dgr_1, tx_1, ty_1)
@@ -1,11 +1,13 @@
 """
 Modul: raspicar_ioctrl.py
 I/O interface for the RaspiCar
-Runs battery voltage control and system shut down as background processes
+Runs battery voltage control and system shut down as background processes,
+based on the telemetry lines pushed by the motor driver
 This version 2 of IoCtrl is based on the RPi.GPIO library (and does not require PIGPIO)
 
 - Class: IoCtrl
-- Methods: send_msg, clear_display, set_led_green, set_led_red, set_lidar_pwr, close
+- Methods: send_msg, send_tagged, get_reply, clear_display, set_led_green, set_led_red, set_lidar_pwr,
+           set_baudrate, get_telemetry, close
 
 SLW 01-12-2023
 Last update: 01-12-2025
@@ -19,6 +21,10 @@ import threading
 import os
 
 CHECK_VERSION = False
+SERIAL_BAUD_DEFAULT = 115200    # the motor driver falls back to this rate
+SERIAL_BAUD_TRIAL = 1.0         # s, time of the motor driver to wait for the confirmation
+TELEMETRY_HZ = 10               # rate of the telemetry lines ("$T")
+TELEMETRY_FIELDS = ("voltage", "status", "rpm_a", "rpm_b", "pos_a", "pos_b", "mode", "loops", "loop_max")
 
 """ Battery status:
 BAT_STATUS_EXTERN              0   // 'EX', external power supply
@@ -31,7 +37,7 @@ BAT_STATUS_SHUTDOWN_PENDING    5   // 'SP', shutdown was confirmed, waiting for
 
 class IoCtrl:
        
-    def __init__(self):
+    def __init__(self, baudrate=SERIAL_BAUD_DEFAULT, save_baudrate=False):
         # pin definitions
         _PIN_LED_RED = 6
         _PIN_LED_GREEN = 13
@@ -43,9 +49,12 @@ class IoCtrl:
         self._led_red = LED(_PIN_LED_RED)
         self._lidar_pwr = LED(_PIN_LIDAR_PWR)
         # initiate operating data
-        self._ser_busy = False
+        self._ser_lock = threading.Lock()     # one write + readline at a time, reader thread included
         self.__shutdown = False
         self._status = "OK"
+        self._telemetry = {}
+        self._seq = 0
+        self._replies = {}              # replies of tagged commands by sequence number
         # set initial values
         self._led_green.off()
         self._led_red.off()
@@ -55,7 +64,7 @@ class IoCtrl:
         connected = False
         while not connected and connection_cnt < 5:
             try:
-                self._ser = serial.Serial(_serial_port, baudrate=115200,
+                self._ser = serial.Serial(_serial_port, baudrate=SERIAL_BAUD_DEFAULT,
                                       parity=serial.PARITY_NONE, timeout=1)
                 connected = True
             except:
@@ -68,8 +77,12 @@ class IoCtrl:
             err_msg = "Error: can't open serial port " + _serial_port
             raise Exception(err_msg)            
         time.sleep(0.25)
-        self.send_ser(" ");
+        self.send_ser(" ");             # a motor driver at a fast rate falls back on the errors
         time.sleep(0.25)
+        self._ser.reset_input_buffer()
+        if baudrate != SERIAL_BAUD_DEFAULT:
+            if not self.set_baudrate(baudrate, save_baudrate):
+                print(" - ioctrl: baud rate", baudrate, "failed, using", SERIAL_BAUD_DEFAULT)
         self.send_ser("DMRaspi connected")
         # check version
         if CHECK_VERSION:
@@ -91,10 +104,15 @@ class IoCtrl:
 
 
     def _read_status(self):
+        """ Subscribes to the telemetry and reads the lines pushed in between the commands """
+        self.send_ser("T" + str(TELEMETRY_HZ))
         while not self.__shutdown:
-            while self._ser_busy:
-                time.sleep(0.01)
-            self._status = self.send_ser("BS")[-2:]
+            line = b''
+            with self._ser_lock:
+                if self._ser.in_waiting > 0:
+                    line = self._ser.readline()
+            if len(line) > 0:
+                self._handle_stream(line)
             if self._status == "SP":
                 print("Stopping motors ...")
                 self.send_ser("MR0,0")
@@ -106,10 +124,39 @@ class IoCtrl:
                 time.sleep(0.1)
                 os.popen("sudo shutdown -h now").read()
                 
-            time.sleep(1)
+            if len(line) == 0:
+                time.sleep(0.001)
+        self.send_ser("T0")
         print(" - ioctrl: status thread closed ...")
 
 
+    def _handle_stream(self, line: bytes):
+        """ Lines pushed by the motor driver, "$T" -> telemetry, "#<seq> " -> reply of a tagged command """
+        if line.startswith(b'#'):
+            tag, _, text = line[1:-2].decode("UTF-8", errors="replace").partition(" ")
+            if tag.isdigit():
+                seq = int(tag)
+                if seq in self._replies:
+                    self._replies[seq] += "\n" + text     # multi-line reply
+                else:
+                    self._replies[seq] = text
+        elif line.startswith(b'$T'):
+            fields = line[2:-2].decode("UTF-8", errors="replace").split(",")
+            if len(fields) == len(TELEMETRY_FIELDS):
+                telemetry = dict(zip(TELEMETRY_FIELDS, fields))
+                for key in telemetry:
+                    if key != "status":
+                        telemetry[key] = int(telemetry[key])
+                self._telemetry = telemetry
+                self._status = telemetry["status"]
+
+
+    def get_telemetry(self) -> dict:
+        """ Last telemetry: voltage in 10mV, battery status, RPM and position (microsteps)
+        of motor A and B, motor mode, main loop passes and longest pass in us """
+        return dict(self._telemetry)
+
+
     def get_status(self) -> str:
         return self._status
 
@@ -136,18 +183,57 @@ class IoCtrl:
 
 
     def send_ser(self, msg: str, ser_delay=0.002) -> str:
-        while self._ser_busy == True:
-            time.sleep(ser_delay)
-        self._ser_busy = True
         msg_bytes = bytes(msg + '\n', 'UTF-8')
-        self._ser.write(msg_bytes)
-        time.sleep(ser_delay)
-        response = self._ser.readline()
+        with self._ser_lock:
+            self._ser.write(msg_bytes)
+            time.sleep(ser_delay)
+            response = self._ser.readline()
+            while response.startswith(b'$') or response.startswith(b'#'):   # streamed data, tagged replies
+                self._handle_stream(response)
+                response = self._ser.readline()
         #response = bytes('OK', 'UTF-8')
-        self._ser_busy = False
-        return response[:-2].decode("UTF-8")
+        return response[:-2].decode("UTF-8", errors="replace")   # garbage at a wrong baud rate
     
     
+    def set_baudrate(self, baudrate: int, save=False) -> bool:
+        """ Switches both sides to a new baud rate (115200, 230400, 460800, 921600, 1000000).
+        The new rate is confirmed by a ping, otherwise both sides fall back to 115200.
+        save -> the motor driver starts with this rate after a reset """
+        cmd = "CB" + str(baudrate) + (",1" if save else "")
+        if self.send_ser(cmd) != "OK":
+            return False
+        self._ser.baudrate = baudrate
+        time.sleep(0.01)
+        self._ser.reset_input_buffer()
+        if self.send_ser("P") == "OK":
+            return True
+        self._ser.baudrate = SERIAL_BAUD_DEFAULT
+        time.sleep(SERIAL_BAUD_TRIAL)
+        self._ser.reset_input_buffer()
+        return False
+
+
+    def send_tagged(self, msg: str) -> int:
+        """ Sends a command with a sequence tag and returns without waiting for the reply,
+        so several commands can be in flight. Returns the sequence number for get_reply() """
+        with self._ser_lock:
+            self._seq = (self._seq + 1) % 100000
+            seq = self._seq
+            self._replies.pop(seq, None)
+            self._ser.write(bytes("#" + str(seq) + " " + msg + "\n", 'UTF-8'))
+        return seq
+
+
+    def get_reply(self, seq: int, timeout=1.0):
+        """ Reply of a tagged command, None after the timeout """
+        t_end = time.time() + timeout
+        while seq not in self._replies:
+            if time.time() > t_end:
+                return None
+            time.sleep(0.0005)
+        return self._replies.pop(seq)
+
+
     def send_msg(self, msg: str):
         self.send_ser("DM" + msg)
         
@@ -3,7 +3,7 @@ Modul: raspicar_motors.py
 Motor control for the RaspiCar
 
 - Class: Motors
-- Methods: run, stop
+- Methods: run, stop, move, turn, queue, wait, get_pose, reset_pose
 
 SLW 27-09-2021
 """
@@ -17,9 +17,7 @@ class Motors:
         self._debug = False
         self._io = io
         self._dir_a, self._dir_b = True, True
-        self._io.send_ser("MR0,0")
-        self._io.send_ser("MP1,1")
-        self._io.send_ser("MD1,1")
+        self._io.send_ser("MR0,0;MP1,1;MD1,1")
         self._mot_a, self._mot_b = 0, 0
         self._mot_power_on = True
         self._cutoff = 20
@@ -66,10 +64,12 @@ class Motors:
             self._mot_a = self._speed_max
         if self._mot_b > self._speed_max:
             self._mot_b = self._speed_max
+        # All commands go in one line, executed together by the motor driver
+        cmds = []
         # Manage the counter for powering off the motors
         if self._mot_a > 0 or self._mot_b > 0:
             if self._mot_stop_cnt >= self._mot_stop_cutoff:
-                self._io.send_ser("MP1,1")
+                cmds.append("MP1,1")
             self._mot_stop_cnt = 0
             cmd = "MR" + str(self._mot_a) + "," + str(self._mot_b)
         else:
@@ -78,25 +78,95 @@ class Motors:
         # Set direction
         if (dir_a != self._dir_a) or (dir_b != self._dir_b):
             dir_cmd = "MD" + ('1' if dir_a else '0') + ',' + ('1' if dir_b else '0')
-            self._io.send_ser(dir_cmd)
+            cmds.append(dir_cmd)
             if self._debug:
                 print(dir_cmd)
             self._dir_a = dir_a
             self._dir_b = dir_b
         # Send speed command
         if cmd != self._last_cmd:
-            self._io.send_ser(cmd)
+            cmds.append(cmd)
             self._last_cmd = cmd
         # If the power counter reaches its limit, power off the motors
         if self._mot_stop_cnt == self._mot_stop_cutoff:
-            self._io.send_ser("MP0,0")
+            cmds.append("MP0,0")
+        if len(cmds) > 0:
+            self._io.send_ser(";".join(cmds))
         if self._debug:
             print(cmd)
         
         
     def stop(self):
-        self._io.send_ser("MR0,0")
-        self._io.send_ser("MP0,0")
+        self._io.send_ser("MR0,0;MP0,0")
+
+
+    def move(self, length: int, radius=0, wait=True):
+        """ Drives the car by length mm along an arc with the given radius in mm
+            (positive -> left, 0 -> straight line) as one move on the motor driver """
+        self._start_segment("MA" + str(int(length)) + "," + str(int(radius)), wait)
+
+
+    def turn(self, angdgr: int, wait=True):
+        """ Turns the car on the spot by angdgr degrees (positive -> counter-clockwise) """
+        self._start_segment("MT" + str(int(angdgr)), wait)
+
+
+    def queue(self, steps_a: int, steps_b: int, rpm=0, timeout=30.0) -> bool:
+        """ Appends a segment (signed steps, 1 step = 8 microsteps) to the motion queue
+            of the motor driver, consecutive segments are driven without a stop.
+            Waits while the queue is full, returns False on timeout """
+        cmd = "MQ" + str(int(steps_a)) + "," + str(int(steps_b))
+        if rpm > 0:
+            cmd += "," + str(int(rpm))
+        if self._mot_stop_cnt >= self._mot_stop_cutoff:
+            self._io.send_ser("MP1,1")
+        self._mot_stop_cnt = 0
+        self._dir_a, self._dir_b = None, None
+        self._last_cmd = ""
+        end_time = time.time() + timeout
+        while self._io.send_ser(cmd) != "OK":
+            if time.time() > end_time:
+                return False
+            time.sleep(0.05)
+        return True
+
+
+    def wait(self, timeout=30.0) -> bool:
+        """ Waits until the motor driver has finished the move, returns False on timeout """
+        end_time = time.time() + timeout
+        while time.time() < end_time:
+            if self._io.send_ser("GC") == "0":
+                return True
+            time.sleep(0.05)
+        return False
+
+
+    def get_pose(self):
+        """ Returns the pose from the odometry of the motor driver:
+            x, y in mm (x forward, y left at the last reset), heading in degrees
+            (counter-clockwise) and the time stamp in us, None on error """
+        try:
+            x, y, heading, t = self._io.send_ser("GP").split(",")
+            return int(x) / 10, int(y) / 10, int(heading) / 100, int(t)
+        except ValueError:
+            return None
+
+
+    def reset_pose(self):
+        self._io.send_ser("MO")
+
+
+    def _start_segment(self, cmd: str, wait: bool):
+        self._io.send_ser("MP1,1")
+        self._mot_stop_cnt = 0
+        self._io.send_ser(cmd)
+        # the motor driver sets the directions, send them again on the next run()
+        self._dir_a, self._dir_b = None, None
+        self._last_cmd = ""
+        if self._debug:
+            print(cmd)
+        if wait:
+            self.wait()
         
         
     def set_debug(self, status: bool):
@@ -0,0 +1,154 @@
+/*
+ * Check of the RaspiCarClient against a pseudo terminal
+ * A thread on the master side of the pty stands in for the rp2040: it
+ * answers the tagged commands like the ASCII command decoder and pushes
+ * telemetry lines. The client opens the slave side by a symlink, so the
+ * stand-in can be restarted on a new pty to test the reconnect.
+ *
+ * Build and run: make check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include "raspicar_client.h"
+
+#define CHECK(cond) do { if (!(cond)) { printf("FAIL: %s (line %d)\n", #cond, __LINE__); exit(1); } } while (0)
+
+static char link_path[64];
+static std::atomic<bool> stand_in_run;
+static std::atomic<uint32_t> telemetry_hz;
+
+//-------------------------------------------------------------------------
+// Reply of the stand-in to one command (without tag)
+static std::string answer(const std::string &cmd) {
+  if (cmd == "GP") return "2042,-10,9000,123456789";
+  if (cmd == "GC") return "1";
+  if (cmd == "BV") return "11.52";
+  if (cmd == "GQ") return "0,0,0,12,40,0";
+  if (cmd == "XX") return "";                         // no reply -> timeout
+  if (cmd[0] == 'T') {
+    telemetry_hz = atoi(cmd.c_str() + 1);
+    return "OK";
+  }
+  if (cmd.compare(0, 2, "MR") == 0) {
+    if (atoi(cmd.c_str() + 2) > 120) return "Motor RPM A out of range! (max 120)";
+    return "OK";
+  }
+  if ((cmd[0] == 'M') || (cmd[0] == 'D') || (cmd[0] == 'P')) return "OK";
+  return "Not recognized: " + cmd;
+}
+
+//-------------------------------------------------------------------------
+static void stand_in(int master) {
+  std::string rx, line, reply;
+  char buf[256];
+  size_t end, sp;
+  int n, ticks = 0;
+  struct pollfd pfd = {master, POLLIN, 0};
+
+  while (stand_in_run) {
+    if (::poll(&pfd, 1, 10) > 0) {
+      n = read(master, buf, sizeof(buf));
+      if (n > 0) rx.append(buf, n);
+    }
+    while ((end = rx.find('\n')) != std::string::npos) {
+      line = rx.substr(0, end);
+      rx.erase(0, end + 1);
+      if ((line[0] != '#') || ((sp = line.find(' ')) == std::string::npos)) continue;
+      reply = answer(line.substr(sp + 1));
+      if (reply.empty()) continue;
+      reply = line.substr(0, sp + 1) + reply + "\r\n";
+      CHECK(write(master, reply.data(), reply.size()) == (ssize_t) reply.size());
+    }
+    if ((telemetry_hz > 0) && (++ticks % 5 == 0)) {
+      reply = "$T1152,OK,60,60,12800,-12800,1,2211,412\r\n";
+      CHECK(write(master, reply.data(), reply.size()) == (ssize_t) reply.size());
+    }
+  }
+  close(master);
+}
+
+//-------------------------------------------------------------------------
+// New pty, the symlink points to the slave side
+static std::thread start_stand_in(void) {
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+
+  CHECK(master >= 0);
+  CHECK((grantpt(master) == 0) && (unlockpt(master) == 0));
+  unlink(link_path);
+  CHECK(symlink(ptsname(master), link_path) == 0);
+  stand_in_run = true;
+  return std::thread(stand_in, master);
+}
+
+//-------------------------------------------------------------------------
+int main(void) {
+  RaspiCarClient client;
+  uint32_t done = 0, telemetry_lines = 0;
+  Telemetry tel = {};
+  Pose pose = {};
+  bool failed = false, timed_out = false;
+  int32_t mode = 0;
+  double volt = 0;
+
+  snprintf(link_path, sizeof(link_path), "/tmp/raspicar_check_%d", getpid());
+  std::thread t = start_stand_in();
+  CHECK(client.open(link_path));
+  client.set_timeout(200);
+  client.set_reconnect(50);
+  client.on_telemetry([&](const Telemetry &tl) { tel = tl; telemetry_lines += 1; });
+
+  // pipelined requests, replies matched by the tag
+  for (int i = 0; i < 20; i++) {
+    client.motor_rpm(60, 60, [&](const Reply &r) { CHECK(r.ok); done += 1; });
+  }
+  client.get_pose([&](bool ok, const Pose &p) { CHECK(ok); pose = p; done += 1; });
+  client.get_mode([&](bool ok, int32_t v) { CHECK(ok); mode = v; done += 1; });
+  client.bat_voltage([&](bool ok, double v) { CHECK(ok); volt = v; done += 1; });
+  CHECK(client.get_pending() == 23);
+  CHECK(client.wait_idle(1000));
+  CHECK(done == 23);
+  CHECK((pose.x == 2042) && (pose.y == -10) && (pose.heading == 9000) && (pose.time == 123456789));
+  CHECK((mode == 1) && (volt > 11.5) && (volt < 11.6));
+
+  // error reply and timeout
+  client.motor_rpm(500, 60, [&](const Reply &r) { failed = !r.ok && !r.timeout; });
+  client.request("XX", [&](const Reply &r) { timed_out = r.timeout; });
+  client.wait_idle(1000);
+  CHECK(failed && timed_out);
+
+  // telemetry
+  client.set_telemetry(10, [&](const Reply &r) { CHECK(r.ok); });
+  while (telemetry_lines < 3) client.poll(100);
+  CHECK((tel.voltage == 1152) && (tel.status == "OK") && (tel.pos_b == -12800) && (tel.loop_max == 412));
+
+  // stand-in restarted on a new pty: pending request fails, the client
+  // reconnects and subscribes to the telemetry again
+  failed = false;
+  client.request("XX", [&](const Reply &r) { failed = !r.ok && !r.timeout; });
+  stand_in_run = false;
+  t.join();
+  telemetry_hz = 0;
+  for (int i = 0; (i < 20) && !failed; i++) client.poll(10);
+  CHECK(failed && !client.is_open());
+  t = start_stand_in();
+  for (int i = 0; (i < 50) && !client.is_open(); i++) client.poll(10);
+  CHECK(client.is_open() && (client.get_reconnects() == 1));
+  telemetry_lines = 0;
+  while (telemetry_lines < 3) client.poll(100);
+  CHECK(telemetry_hz == 10);
+
+  stand_in_run = false;
+  t.join();
+  client.close();
+  unlink(link_path);
+  printf("OK: pipelined requests, typed replies, errors, timeout, telemetry, reconnect\n");
+  return 0;
+}
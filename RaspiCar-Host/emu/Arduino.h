@@ -0,0 +1,65 @@
+#ifndef __EMU_ARDUINO__
+#define __EMU_ARDUINO__
+
+// Arduino API of the arduino-pico core as far as the motor driver uses it
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include "pico/stdlib.h"
+
+using std::min;
+using std::max;
+
+#define HIGH              1
+#define LOW               0
+#define INPUT             0
+#define OUTPUT            1
+#define INPUT_PULLUP      2
+#define INPUT_PULLDOWN    3
+
+#define A0               26
+#define A1               27
+#define A2               28
+#define A3               29
+
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int value);
+int digitalRead(int pin);
+int analogRead(int pin);
+void analogReadResolution(int bits);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+unsigned long millis(void);
+unsigned long micros(void);
+char *itoa(int value, char *s, int base);
+char *utoa(unsigned value, char *s, int base);
+char *ltoa(long value, char *s, int base);
+
+// USB serial, goes to stderr of the emulator
+class EmuSerial {
+  public:
+    void begin(unsigned long baud);
+    void print(const char *s);
+    void print(char c);
+    void print(long v);
+    void print(unsigned long v);
+    void print(int v) { print((long) v); }
+    void print(unsigned v) { print((unsigned long) v); }
+    void print(double v);
+    template <typename T> void println(T v) { print(v); print('\n'); }
+    void println(void) { print('\n'); }
+    operator bool() { return true; }
+};
+
+extern EmuSerial Serial;
+
+void setup(void);
+void loop(void);
+void setup1(void) __attribute__((weak));
+void loop1(void) __attribute__((weak));
+
+#endif
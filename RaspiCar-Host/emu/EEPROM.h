@@ -0,0 +1,21 @@
+#ifndef __EMU_EEPROM__
+#define __EMU_EEPROM__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// EEPROM emulation of the arduino-pico core, commit() saves to the file
+// given by --eeprom. A new file reads 0xFF (erased flash).
+class EEPROMClass {
+  public:
+    void begin(size_t size);
+    uint8_t read(int address);
+    void write(int address, uint8_t value);
+    bool commit(void);
+    bool end(void);
+    size_t length(void);
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
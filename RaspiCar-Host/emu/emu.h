@@ -0,0 +1,96 @@
+#ifndef __EMU__
+#define __EMU__
+
+/*
+ * Host emulator of the rp2040 motor driver
+ * The unmodified firmware runs against the mock HAL in this directory.
+ * Each core is a thread (setup()/loop() and setup1()/loop1()). The cores
+ * share a virtual clock: every pass through loop(), every busy wait and
+ * every delay is a time quantum, the clock moves on when both cores have
+ * finished their quantum. Interrupts of a core run on its thread between
+ * quanta and when the core enables its interrupts again.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define EMU_CORES              2
+#define EMU_QUANTUM_US        10  // virtual time of a loop pass
+#define EMU_SPIN_YIELDS      100  // a core waiting for the other core yields first
+#define EMU_SPIN_MS            1  // then sleeps this wall time at most in a quantum
+#define EMU_GPIO_COUNT        30
+#define EMU_UART_FIFO         32
+#define EMU_UART_TX_LEVEL      4  // TX interrupt at or below (1/8 FIFO)
+#define EMU_UART_RX_LEVEL      4  // RX interrupt at or above (1/8 FIFO)
+#define EMU_I2C_FIFO          16
+#define EMU_EEPROM_SIZE     4096
+#define EMU_FLASH_SIZE   0x200000  // 2 MB
+#define EMU_FLASH_KEEP    0x10000  // top of the flash saved to the --flash file
+#define EMU_POWER_PIN         10  // POWER_ON of the motor driver, low -> power off
+#define EMU_ADC_DEFAULT      514  // about 11.5V with the default battery calibration
+#define EMU_LCD_ROWS           4
+#define EMU_LCD_COLS          20
+
+struct EmuConfig {
+  double speed = 1.0;               // virtual / real time, 0 -> as fast as possible
+  uint32_t quantum = EMU_QUANTUM_US;
+  const char *link = nullptr;       // symlink to the pty
+  const char *eeprom = "emu_eeprom.bin";
+  const char *flash = "emu_flash.bin";  // top of the flash (configuration journal)
+  uint32_t adc = EMU_ADC_DEFAULT;   // battery ADC reading
+  bool lcd = false;                 // print the display on changes
+  bool baud_check = true;           // host and UART baud rate have to match
+  bool stats = false;               // statistics at the end
+  double run_time = 0;              // virtual seconds, 0 -> until stopped
+};
+
+extern EmuConfig emu_cfg;
+
+// emu_core.cpp: clock, cores, interrupts
+int emu_core(void);
+bool emu_in_irq(void);
+uint64_t emu_now(void);
+void emu_start_core(int core);
+void emu_stop_core(void);
+void emu_yield(void);
+void emu_busy(uint64_t us);
+void emu_dispatch(void);
+void emu_lock(void);
+void emu_unlock(void);
+bool emu_running(void);
+void emu_stop(int code);
+int emu_exit_code(void);
+uint64_t emu_quanta(void);
+bool emu_timer_line(uint32_t num);
+void emu_timer_advance(uint64_t now);
+
+// Holds the emulator lock in a scope of the HAL functions
+class EmuGuard {
+  public:
+    EmuGuard() { emu_lock(); }
+    ~EmuGuard() { emu_unlock(); }
+};
+
+// emu_uart.cpp: UART1 and the pseudo terminal
+bool emu_uart_open(void);
+void emu_uart_advance(uint64_t now);
+bool emu_uart_line(void);
+uint32_t emu_uart_reg_read(uint32_t id);
+void emu_uart_reg_write(uint32_t id, uint32_t v);
+const char *emu_uart_name(void);
+void emu_uart_stats(FILE *f);
+
+// emu_periph.cpp: GPIO, ADC, I2C display, EEPROM, flash
+uint32_t emu_sio_reg_read(uint32_t id);
+void emu_sio_reg_write(uint32_t id, uint32_t v);
+uint32_t emu_i2c_reg_read(uint32_t id);
+void emu_i2c_reg_write(uint32_t id, uint32_t v);
+void emu_i2c_advance(uint64_t now);
+bool emu_i2c_line(void);
+void emu_lcd_advance(uint64_t now);
+uint32_t emu_adc_reg_read(uint32_t id);
+void emu_adc_advance(uint64_t now);
+void emu_flash_load(void);
+void emu_periph_stats(FILE *f);
+
+#endif
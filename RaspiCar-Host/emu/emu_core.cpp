@@ -0,0 +1,544 @@
+/*
+ * Virtual clock, cores, interrupts, timer and repeating timers
+ */
+
+#include "emu.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+EmuConfig emu_cfg;
+
+struct EmuIrq {
+  irq_handler_t handler;
+  bool enabled;
+  bool pending;               // set by irq_set_pending
+  int core;                   // core that enabled the interrupt
+};
+
+static std::recursive_mutex mtx;
+static std::condition_variable_any cv;
+static int participants = 0;          // cores running
+static int arrived = 0;               // cores at the end of their quantum
+static std::atomic<uint64_t> generation(0);
+static uint64_t now_us = 0;           // virtual clock
+static uint64_t quanta = 0;
+static bool running = true;
+static int exit_code = 0;
+static std::chrono::steady_clock::time_point wall_start = std::chrono::steady_clock::now();
+
+static thread_local int core_id = 0;
+static thread_local bool masked = false;      // PRIMASK of the core
+static thread_local bool in_irq = false;
+
+static EmuIrq irqs[EMU_IRQ_COUNT];
+static std::vector<repeating_timer_t *> timers;
+static uint32_t alarm_target[4];
+static uint32_t alarm_armed = 0;
+static uint32_t alarm_claimed = 1u << 3;     // alarm 3: repeating timers
+static uint32_t timer_intr = 0, timer_inte = 0, timer_intf = 0;
+
+static timer_hw_t timer_regs;
+timer_hw_t *timer_hw = &timer_regs;
+static systick_hw_t systick_regs;
+systick_hw_t *systick_hw = &systick_regs;
+static uint32_t systick_csr = 0, systick_rvr = 0;
+static std::chrono::steady_clock::time_point systick_ref;    // last write of CVR
+
+//-------------------------------------------------------------------------
+void emu_lock(void) {
+  mtx.lock();
+}
+
+//-------------------------------------------------------------------------
+void emu_unlock(void) {
+  mtx.unlock();
+}
+
+//-------------------------------------------------------------------------
+int emu_core(void) {
+  return core_id;
+}
+
+//-------------------------------------------------------------------------
+bool emu_in_irq(void) {
+  return in_irq;
+}
+
+//-------------------------------------------------------------------------
+uint64_t emu_now(void) {
+  std::lock_guard<std::recursive_mutex> lk(mtx);
+  return now_us;
+}
+
+//-------------------------------------------------------------------------
+uint64_t emu_quanta(void) {
+  return quanta;
+}
+
+//-------------------------------------------------------------------------
+bool emu_running(void) {
+  std::lock_guard<std::recursive_mutex> lk(mtx);
+  return running;
+}
+
+//-------------------------------------------------------------------------
+// Ends the emulation, the main thread prints the statistics and exits
+void emu_stop(int code) {
+  std::lock_guard<std::recursive_mutex> lk(mtx);
+  if (running) exit_code = code;
+  running = false;
+  cv.notify_all();
+}
+
+//-------------------------------------------------------------------------
+// Waits in the main thread until the emulation ends
+int emu_exit_code(void) {
+  std::unique_lock<std::recursive_mutex> lk(mtx);
+  cv.wait(lk, [] { return !running; });
+  return exit_code;
+}
+
+//-------------------------------------------------------------------------
+void emu_start_core(int core) {
+  std::lock_guard<std::recursive_mutex> lk(mtx);
+  core_id = core;
+  participants += 1;
+}
+
+//-------------------------------------------------------------------------
+void emu_stop_core(void) {
+  std::lock_guard<std::recursive_mutex> lk(mtx);
+  participants -= 1;
+  cv.notify_all();
+}
+
+//-------------------------------------------------------------------------
+// One quantum of virtual time: alarms, UART line, I2C bus, display, ADC. In
+// real time mode the clock waits for the wall clock.
+static void advance(void) {
+  std::chrono::steady_clock::time_point wall;
+
+  now_us += emu_cfg.quantum;
+  quanta += 1;
+  emu_timer_advance(now_us);
+  emu_uart_advance(now_us);
+  emu_i2c_advance(now_us);
+  emu_adc_advance(now_us);
+  emu_lcd_advance(now_us);
+  if ((emu_cfg.run_time > 0) && (now_us >= emu_cfg.run_time * 1e6)) emu_stop(0);
+  if (emu_cfg.speed > 0) {
+    wall = wall_start + std::chrono::microseconds((int64_t) (now_us / emu_cfg.speed));
+    if (wall - std::chrono::steady_clock::now() > std::chrono::milliseconds(1)) {
+      std::this_thread::sleep_until(wall);
+    }
+  }
+}
+
+//-------------------------------------------------------------------------
+// emu_yield
+// End of the quantum of the calling core. The last core of a quantum moves
+// the clock on, then the pending interrupts of the core run. A core spinning
+// without HAL calls (e.g. waiting for a result of the other core) never ends
+// its quantum, the waiting core then runs another pass in the same quantum.
+void emu_yield(void) {
+  std::unique_lock<std::recursive_mutex> lk(mtx);
+  uint64_t gen = generation;
+
+  if (!running) {
+    cv.wait(lk);                        // stopped, the main thread exits
+    return;
+  }
+  arrived += 1;
+  if (arrived >= participants) {
+    arrived = 0;
+    advance();
+    generation += 1;
+    cv.notify_all();
+  } else {
+    lk.unlock();                                // the other core is usually close
+    for (int i = 0; (i < EMU_SPIN_YIELDS) && (generation == gen); i++) std::this_thread::yield();
+    lk.lock();
+    cv.wait_for(lk, std::chrono::milliseconds(EMU_SPIN_MS),
+                [gen] { return (generation != gen) || (arrived >= participants) || !running; });
+    if ((generation == gen) && running) {
+      if (arrived >= participants) {            // the other core has stopped
+        arrived = 0;
+        advance();
+        generation += 1;
+        cv.notify_all();
+      } else {
+        arrived -= 1;                           // the other core spins on us, run again
+      }
+    }
+  }
+  lk.unlock();
+  emu_dispatch();
+}
+
+//-------------------------------------------------------------------------
+// The calling core is busy for us microseconds (delay, bus transfer)
+void emu_busy(uint64_t us) {
+  uint64_t end = emu_now() + us;
+
+  while (emu_now() < end) emu_yield();
+}
+
+//-------------------------------------------------------------------------
+static bool irq_line(uint32_t num) {
+  if (irqs[num].pending) return true;
+  if (num <= TIMER_IRQ_3) return emu_timer_line(num);
+  if (num == UART1_IRQ) return emu_uart_line();
+  if (num == I2C0_IRQ) return emu_i2c_line();
+  return false;
+}
+
+//-------------------------------------------------------------------------
+// emu_dispatch
+// Runs the interrupt handlers and repeating timers of the calling core
+// while their interrupt line is active. Not nested, not while masked.
+void emu_dispatch(void) {
+  irq_handler_t handler;
+  repeating_timer_t *rt;
+  bool keep;
+
+  if (masked || in_irq) return;
+  for (int guard = 0; guard < 1000; guard++) {
+    handler = nullptr;
+    rt = nullptr;
+    mtx.lock();
+    for (uint32_t n = 0; n < EMU_IRQ_COUNT; n++) {
+      if (irqs[n].enabled && irqs[n].handler && (irqs[n].core == core_id) && irq_line(n)) {
+        irqs[n].pending = false;
+        handler = irqs[n].handler;
+        break;
+      }
+    }
+    if (!handler) {
+      for (auto t : timers) {
+        if ((t->emu_core == core_id) && (t->emu_next <= now_us)) {
+          rt = t;
+          break;
+        }
+      }
+    }
+    mtx.unlock();
+
+    in_irq = true;
+    if (handler) {
+      handler();
+    } else if (rt) {
+      keep = rt->callback(rt);
+      std::lock_guard<std::recursive_mutex> lk(mtx);
+      auto it = std::find(timers.begin(), timers.end(), rt);
+      if (it != timers.end()) {
+        if (!keep) timers.erase(it);
+        else if (rt->delay_us < 0) rt->emu_next += -rt->delay_us;
+        else rt->emu_next = now_us + rt->delay_us;
+      }
+    }
+    in_irq = false;
+    if (!handler && !rt) return;
+  }
+  fprintf(stderr, "emu: interrupt of core %d is not cleared by its handler\n", core_id);
+}
+
+//-------------------------------------------------------------------------
+uint32_t get_core_num(void) {
+  return core_id;
+}
+
+//-------------------------------------------------------------------------
+uint32_t save_and_disable_interrupts(void) {
+  uint32_t status = masked;
+
+  masked = true;
+  return status;
+}
+
+//-------------------------------------------------------------------------
+void restore_interrupts(uint32_t status) {
+  masked = status;
+  if (!masked) emu_dispatch();
+}
+
+//-------------------------------------------------------------------------
+void __sev(void) {
+}
+
+//-------------------------------------------------------------------------
+void __wfe(void) {
+  emu_yield();
+}
+
+//-------------------------------------------------------------------------
+void __wfi(void) {
+  emu_yield();
+}
+
+//-------------------------------------------------------------------------
+void tight_loop_contents(void) {
+  emu_yield();
+}
+
+//-------------------------------------------------------------------------
+void irq_set_exclusive_handler(uint num, irq_handler_t handler) {
+  std::lock_guard<std::recursive_mutex> lk(mtx);
+  if (num < EMU_IRQ_COUNT) irqs[num].handler = handler;
+}
+
+//-------------------------------------------------------------------------
+irq_handler_t irq_get_exclusive_handler(uint num) {
+  std::lock_guard<std::recursive_mutex> lk(mtx);
+  return (num < EMU_IRQ_COUNT) ? irqs[num].handler : nullptr;
+}
+
+//-------------------------------------------------------------------------
+// The NVIC of a core: disabling an interrupt of the other core has no effect
+void irq_set_enabled(uint num, bool enabled) {
+  if (num >= EMU_IRQ_COUNT) return;
+  mtx.lock();
+  if (enabled || (irqs[num].core == core_id)) irqs[num].enabled = enabled;
+  if (enabled) irqs[num].core = core_id;
+  mtx.unlock();
+  if (enabled) emu_dispatch();
+}
+
+//-------------------------------------------------------------------------
+bool irq_is_enabled(uint num) {
+  std::lock_guard<std::recursive_mutex> lk(mtx);
+  return (num < EMU_IRQ_COUNT) && irqs[num].enabled && (irqs[num].core == core_id);
+}
+
+//-------------------------------------------------------------------------
+void irq_set_pending(uint num) {
+  if (num >= EMU_IRQ_COUNT) return;
+  mtx.lock();
+  irqs[num].pending = true;
+  mtx.unlock();
+  emu_dispatch();
+}
+
+//-------------------------------------------------------------------------
+void irq_set_priority(uint num, uint8_t priority) {
+  (void) num;
+  (void) priority;
+}
+
+//-------------------------------------------------------------------------
+// Hardware alarms: an armed alarm fires when the low 32 bits of the clock
+// reach its target (checked once per quantum)
+void emu_timer_advance(uint64_t now) {
+  for (uint32_t n = 0; n < 4; n++) {
+    if ((alarm_armed & (1u << n)) && ((int32_t) ((uint32_t) now - alarm_target[n]) >= 0)) {
+      timer_intr |= 1u << n;
+      alarm_armed &= ~(1u << n);
+    }
+  }
+}
+
+//-------------------------------------------------------------------------
+bool emu_timer_line(uint32_t num) {
+  return ((timer_intr | timer_intf) & timer_inte) & (1u << num);
+}
+
+//-------------------------------------------------------------------------
+static uint32_t timer_reg_read(uint32_t id) {
+  switch (id) {
+    case EMU_TIMER_TIMEHR:
+    case EMU_TIMER_TIMERAWH:  return now_us >> 32;
+    case EMU_TIMER_TIMELR:
+    case EMU_TIMER_TIMERAWL:  return (uint32_t) now_us;
+    case EMU_TIMER_ALARM0:
+    case EMU_TIMER_ALARM1:
+    case EMU_TIMER_ALARM2:
+    case EMU_TIMER_ALARM3:    return alarm_target[id - EMU_TIMER_ALARM0];
+    case EMU_TIMER_ARMED:     return alarm_armed;
+    case EMU_TIMER_INTR:      return timer_intr;
+    case EMU_TIMER_INTE:      return timer_inte;
+    case EMU_TIMER_INTF:      return timer_intf;
+    case EMU_TIMER_INTS:      return (timer_intr | timer_intf) & timer_inte;
+    default:                  return 0;
+  }
+}
+
+//-------------------------------------------------------------------------
+static void timer_reg_write(uint32_t id, uint32_t v) {
+  switch (id) {
+    case EMU_TIMER_ALARM0:
+    case EMU_TIMER_ALARM1:
+    case EMU_TIMER_ALARM2:
+    case EMU_TIMER_ALARM3:
+      alarm_target[id - EMU_TIMER_ALARM0] = v;
+      alarm_armed |= 1u << (id - EMU_TIMER_ALARM0);
+      break;
+    case EMU_TIMER_ARMED:     alarm_armed &= ~v; break;     // write 1 -> disarm
+    case EMU_TIMER_INTR:      timer_intr &= ~v; break;      // write 1 -> clear
+    case EMU_TIMER_INTE:      timer_inte = v; break;
+    case EMU_TIMER_INTF:      timer_intf = v; break;
+    default:                  break;                        // the clock is not set by the firmware
+  }
+}
+
+//-------------------------------------------------------------------------
+// The counter runs down from RVR at the processor clock of the host time,
+// so the benchmark (GH) measures the host
+static uint32_t systick_reg_read(uint32_t id) {
+  uint64_t ticks;
+
+  switch (id) {
+    case EMU_SYSTICK_CSR:     return systick_csr;
+    case EMU_SYSTICK_RVR:     return systick_rvr;
+    case EMU_SYSTICK_CVR:
+      if (!(systick_csr & 1)) return 0;
+      ticks = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - systick_ref).count();
+      ticks = ticks * (clock_get_hz(clk_sys) / 1000000) / 1000;
+      return systick_rvr - ticks % ((uint64_t) systick_rvr + 1);
+    default:                  return 0;
+  }
+}
+
+//-------------------------------------------------------------------------
+static void systick_reg_write(uint32_t id, uint32_t v) {
+  switch (id) {
+    case EMU_SYSTICK_CSR:     systick_csr = v; systick_ref = std::chrono::steady_clock::now(); break;
+    case EMU_SYSTICK_RVR:     systick_rvr = v & 0x00FFFFFF; break;
+    case EMU_SYSTICK_CVR:     systick_ref = std::chrono::steady_clock::now(); break;
+    default:                  break;
+  }
+}
+
+//-------------------------------------------------------------------------
+uint32_t emu_reg_read(uint32_t id) {
+  std::lock_guard<std::recursive_mutex> lk(mtx);
+
+  if (id <= EMU_TIMER_INTS) return timer_reg_read(id);
+  if (id <= EMU_SIO_GPIO_OE_TOGL) return emu_sio_reg_read(id);
+  if (id >= EMU_ADC_FIFO) return emu_adc_reg_read(id);
+  if (id >= EMU_I2C_CON) return emu_i2c_reg_read(id);
+  if (id >= EMU_SYSTICK_CSR) return systick_reg_read(id);
+  return emu_uart_reg_read(id);
+}
+
+//-------------------------------------------------------------------------
+void emu_reg_write(uint32_t id, uint32_t v) {
+  std::lock_guard<std::recursive_mutex> lk(mtx);
+
+  if (id <= EMU_TIMER_INTS) timer_reg_write(id, v);
+  else if (id <= EMU_SIO_GPIO_OE_TOGL) emu_sio_reg_write(id, v);
+  else if (id >= EMU_ADC_FIFO) return;                // ADC and DMA: read only
+  else if (id >= EMU_I2C_CON) emu_i2c_reg_write(id, v);
+  else if (id >= EMU_SYSTICK_CSR) systick_reg_write(id, v);
+  else emu_uart_reg_write(id, v);
+}
+
+//-------------------------------------------------------------------------
+int hardware_alarm_claim_unused(bool required) {
+  std::lock_guard<std::recursive_mutex> lk(mtx);
+
+  for (int n = 0; n < 4; n++) {
+    if (!(alarm_claimed & (1u << n))) {
+      alarm_claimed |= 1u << n;
+      return n;
+    }
+  }
+  if (required) {
+    fprintf(stderr, "emu: no hardware alarm left\n");
+    emu_stop(1);
+  }
+  return -1;
+}
+
+//-------------------------------------------------------------------------
+void hardware_alarm_claim(uint alarm_num) {
+  std::lock_guard<std::recursive_mutex> lk(mtx);
+  alarm_claimed |= 1u << alarm_num;
+}
+
+//-------------------------------------------------------------------------
+void hardware_alarm_unclaim(uint alarm_num) {
+  std::lock_guard<std::recursive_mutex> lk(mtx);
+  alarm_claimed &= ~(1u << alarm_num);
+}
+
+//-------------------------------------------------------------------------
+uint32_t clock_get_hz(enum clock_index clk_index) {
+  switch (clk_index) {
+    case clk_ref:   return 12000000;
+    case clk_usb:
+    case clk_adc:   return 48000000;
+    case clk_rtc:   return 46875;
+    default:        return 125000000;
+  }
+}
+
+//-------------------------------------------------------------------------
+uint64_t time_us_64(void) {
+  return emu_now();
+}
+
+//-------------------------------------------------------------------------
+uint32_t time_us_32(void) {
+  return (uint32_t) emu_now();
+}
+
+//-------------------------------------------------------------------------
+absolute_time_t get_absolute_time(void) {
+  return emu_now();
+}
+
+//-------------------------------------------------------------------------
+void sleep_us(uint64_t us) {
+  emu_busy(us);
+}
+
+//-------------------------------------------------------------------------
+void sleep_ms(uint32_t ms) {
+  emu_busy((uint64_t) ms * 1000);
+}
+
+//-------------------------------------------------------------------------
+void busy_wait_us_32(uint32_t us) {
+  emu_busy(us);
+}
+
+//-------------------------------------------------------------------------
+// Repeating timers run on the core that added them, as the default alarm
+// pool of the SDK. delay_us < 0: start to start, > 0: end to start.
+bool add_repeating_timer_us(int64_t delay_us, repeating_timer_callback_t callback, void *user_data, repeating_timer_t *out) {
+  std::lock_guard<std::recursive_mutex> lk(mtx);
+
+  if (delay_us == 0) delay_us = 1;
+  out->delay_us = delay_us;
+  out->alarm_id = 1;
+  out->callback = callback;
+  out->user_data = user_data;
+  out->emu_next = now_us + (delay_us < 0 ? -delay_us : delay_us);
+  out->emu_core = core_id;
+  if (std::find(timers.begin(), timers.end(), out) == timers.end()) timers.push_back(out);
+  return true;
+}
+
+//-------------------------------------------------------------------------
+bool add_repeating_timer_ms(int32_t delay_ms, repeating_timer_callback_t callback, void *user_data, repeating_timer_t *out) {
+  return add_repeating_timer_us((int64_t) delay_ms * 1000, callback, user_data, out);
+}
+
+//-------------------------------------------------------------------------
+bool cancel_repeating_timer(repeating_timer_t *timer) {
+  std::lock_guard<std::recursive_mutex> lk(mtx);
+  auto it = std::find(timers.begin(), timers.end(), timer);
+
+  if (it == timers.end()) return false;
+  timers.erase(it);
+  return true;
+}
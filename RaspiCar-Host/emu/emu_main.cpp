@@ -0,0 +1,114 @@
+/*
+ * raspicar_emu: runs the motor driver firmware on the host, UART1 is a
+ * pseudo terminal for raspicar_ioctrl.py, raspicar_terminal.py or the client
+ */
+
+#include "emu.h"
+#include "Arduino.h"
+#include <signal.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <thread>
+
+//-------------------------------------------------------------------------
+static void usage(const char *name) {
+  fprintf(stderr,
+          "usage: %s [options]\n"
+          "  --speed <f>       virtual time per real time (default 1, 0 -> as fast as possible)\n"
+          "  --quantum <us>    virtual time of a loop pass (default %d)\n"
+          "  --link <path>     symlink to the pseudo terminal (e.g. /tmp/ttyRaspiCar)\n"
+          "  --eeprom <file>   EEPROM contents (default emu_eeprom.bin)\n"
+          "  --flash <file>    top 64 kB of the flash, configuration journal (default emu_flash.bin)\n"
+          "  --adc <n>         battery ADC reading 0 ... 1023 (default %d)\n"
+          "  --lcd             prints the display on changes\n"
+          "  --no-baud-check   ignores the baud rate set by the host\n"
+          "  --time <s>        stops after s seconds of virtual time\n"
+          "  --stats           prints statistics at the end\n",
+          name, EMU_QUANTUM_US, EMU_ADC_DEFAULT);
+  exit(2);
+}
+
+//-------------------------------------------------------------------------
+// SIGINT and SIGTERM are blocked in all threads and taken here
+static void wait_signal(sigset_t set) {
+  int sig;
+
+  sigwait(&set, &sig);
+  emu_stop(0);
+}
+
+//-------------------------------------------------------------------------
+static void run_core0(void) {
+  emu_start_core(0);
+  setup();
+  while (emu_running()) {
+    loop();
+    emu_yield();
+  }
+}
+
+//-------------------------------------------------------------------------
+static void run_core1(void) {
+  emu_start_core(1);
+  setup1();
+  while (emu_running()) {
+    loop1();
+    emu_yield();
+  }
+}
+
+//-------------------------------------------------------------------------
+int main(int argc, char *argv[]) {
+  sigset_t set;
+  int code;
+
+  for (int i = 1; i < argc; i++) {
+    const char *opt = argv[i];
+    const char *arg = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+    if (!strcmp(opt, "--lcd")) emu_cfg.lcd = true;
+    else if (!strcmp(opt, "--no-baud-check")) emu_cfg.baud_check = false;
+    else if (!strcmp(opt, "--stats")) emu_cfg.stats = true;
+    else if (!arg) usage(argv[0]);
+    else {
+      if (!strcmp(opt, "--speed")) emu_cfg.speed = atof(arg);
+      else if (!strcmp(opt, "--quantum")) emu_cfg.quantum = atoi(arg);
+      else if (!strcmp(opt, "--link")) emu_cfg.link = arg;
+      else if (!strcmp(opt, "--eeprom")) emu_cfg.eeprom = arg;
+      else if (!strcmp(opt, "--flash")) emu_cfg.flash = arg;
+      else if (!strcmp(opt, "--adc")) emu_cfg.adc = atoi(arg);
+      else if (!strcmp(opt, "--time")) emu_cfg.run_time = atof(arg);
+      else usage(argv[0]);
+      i += 1;
+    }
+  }
+  if ((emu_cfg.quantum == 0) || (emu_cfg.speed < 0)) usage(argv[0]);
+
+  emu_flash_load();
+  if (!emu_uart_open()) return 1;
+  printf("%s\n", emu_cfg.link ? emu_cfg.link : emu_uart_name());
+  fflush(stdout);
+  signal(SIGPIPE, SIG_IGN);
+  sigemptyset(&set);
+  sigaddset(&set, SIGINT);
+  sigaddset(&set, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &set, nullptr);
+
+  // The threads end with the process
+  std::thread(wait_signal, set).detach();
+  std::thread(run_core0).detach();
+  if (loop1) std::thread(run_core1).detach();
+
+  code = emu_exit_code();
+  if (emu_cfg.stats) {
+    fprintf(stderr, "virtual time: %.3f s, quanta: %llu\n", emu_now() / 1e6, (unsigned long long) emu_quanta());
+    emu_uart_stats(stderr);
+    emu_periph_stats(stderr);
+  }
+  if (emu_cfg.link) unlink(emu_cfg.link);
+  fflush(stdout);
+  fflush(stderr);
+  _exit(code);
+}
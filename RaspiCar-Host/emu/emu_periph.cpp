@@ -0,0 +1,711 @@
+/*
+ * GPIO, ADC with DMA, I2C with the LCD backpack, EEPROM, flash and the Arduino API
+ */
+
+#include "emu.h"
+#include "Arduino.h"
+#include "EEPROM.h"
+#include "hardware/gpio.h"
+#include "hardware/i2c.h"
+#include "hardware/flash.h"
+#include "hardware/adc.h"
+#include "hardware/dma.h"
+#include <string.h>
+#include <algorithm>
+#include <deque>
+
+#define LCD_EN_BIT     0x04   // PCF8574 backpack: P2 -> enable, P0 -> register select
+#define LCD_RS_BIT     0x01
+#define LCD_REFRESH_US 100000 // print interval of a changed display
+#define FLASH_ERASE_US  45000 // sector erase
+#define FLASH_PROGRAM_US  800 // page program
+#define ADC_CLK_HZ   48000000 // clk_adc
+#define ADC_CYCLES         96 // conversion time, minimum period
+
+static sio_hw_t sio_regs;
+sio_hw_t *sio_hw = &sio_regs;
+
+static uint32_t gpio_out = 0;
+static uint32_t gpio_oe = 0;
+static uint32_t gpio_in = ~0u;            // inputs idle high (pull-ups, buttons released)
+static uint64_t gpio_edges[EMU_GPIO_COUNT];
+static bool power_seen = false;
+
+struct i2c_inst {
+  int num;
+  uint32_t speed;
+};
+
+static i2c_inst_t i2c_insts[2] = {{0, 100000}, {1, 100000}};
+i2c_inst_t *i2c0 = &i2c_insts[0];
+i2c_inst_t *i2c1 = &i2c_insts[1];
+static uint64_t i2c_bytes = 0;
+static i2c_hw_t i2c_regs;
+static std::deque<uint16_t> i2c_fifo;     // data and stop bit
+static uint32_t i2c_con = 0, i2c_tar = 0, i2c_enable = 0, i2c_mask = 0, i2c_tx_tl = 0;
+static uint32_t i2c_latched = 0;          // STOP_DET
+static bool i2c_in_transfer = false;      // address sent, no stop yet
+static uint64_t i2c_next_ns = 0;          // end of the next byte on the bus
+
+static char lcd_ddram[128];
+static uint8_t lcd_addr = 0;
+static uint8_t lcd_last = 0;              // last byte written to the backpack
+static uint8_t lcd_upper = 0;
+static bool lcd_have_upper = false;
+static bool lcd_dirty = false;
+static uint64_t lcd_printed = 0;
+static const uint8_t lcd_row_addr[EMU_LCD_ROWS] = {0x00, 0x40, 0x14, 0x54};
+
+static adc_hw_t adc_regs;
+adc_hw_t *adc_hw = &adc_regs;
+static bool adc_running = false;
+static bool adc_dreq = false;
+static uint64_t adc_period_ns = ADC_CYCLES * 1000000000ull / ADC_CLK_HZ;
+static uint64_t adc_next_ns = 0;          // next conversion
+static uint64_t adc_conversions = 0;
+
+static dma_channel_hw_t dma_regs;
+static bool dma_claimed = false;
+static dma_channel_config dma_cfg;
+static uintptr_t dma_write = 0;           // host address
+static uint32_t dma_count = 0;            // transfers left
+static uint64_t dma_transfers = 0;
+
+static uint8_t eeprom[EMU_EEPROM_SIZE];
+static size_t eeprom_size = 0;
+
+// Flash, the file system and the EEPROM end at the top (_FS_start), the
+// program takes the first 256 kB
+extern "C" {
+  __attribute__((aligned(4096))) uint8_t emu_flash[EMU_FLASH_SIZE];
+}
+asm(".globl _FS_start\n"
+    ".set _FS_start, emu_flash + 0x1FF000\n"
+    ".globl __flash_binary_end\n"
+    ".set __flash_binary_end, emu_flash + 0x40000\n");
+static_assert(EMU_FLASH_SIZE - FLASH_SECTOR_SIZE == 0x1FF000, "_FS_start");
+static uint32_t flash_erases = 0, flash_programs = 0;
+
+EEPROMClass EEPROM;
+EmuSerial Serial;
+
+//-------------------------------------------------------------------------
+// The power pin of the motor driver going low ends the emulation (BX)
+static void set_out(uint32_t out) {
+  uint32_t changed = (gpio_out ^ out) & ((1u << EMU_GPIO_COUNT) - 1);
+
+  for (int pin = 0; changed; pin++, changed >>= 1) {
+    if (changed & 1) gpio_edges[pin] += 1;
+  }
+  gpio_out = out;
+  if (gpio_oe & (1u << EMU_POWER_PIN)) {
+    if (out & (1u << EMU_POWER_PIN)) {
+      power_seen = true;
+    } else if (power_seen) {
+      fprintf(stderr, "emu: power off\n");
+      emu_stop(0);
+    }
+  }
+}
+
+//-------------------------------------------------------------------------
+static uint32_t gpio_level(void) {
+  return (gpio_out & gpio_oe) | (gpio_in & ~gpio_oe);
+}
+
+//-------------------------------------------------------------------------
+// Called with the emulator lock held
+uint32_t emu_sio_reg_read(uint32_t id) {
+  switch (id) {
+    case EMU_SIO_CPUID:     return emu_core();
+    case EMU_SIO_GPIO_IN:   return gpio_level() & ((1u << EMU_GPIO_COUNT) - 1);
+    case EMU_SIO_GPIO_OUT:  return gpio_out;
+    case EMU_SIO_GPIO_OE:   return gpio_oe;
+    default:                return 0;
+  }
+}
+
+//-------------------------------------------------------------------------
+void emu_sio_reg_write(uint32_t id, uint32_t v) {
+  switch (id) {
+    case EMU_SIO_GPIO_OUT:      set_out(v); break;
+    case EMU_SIO_GPIO_SET:      set_out(gpio_out | v); break;
+    case EMU_SIO_GPIO_CLR:      set_out(gpio_out & ~v); break;
+    case EMU_SIO_GPIO_TOGL:     set_out(gpio_out ^ v); break;
+    case EMU_SIO_GPIO_OE:       gpio_oe = v; break;
+    case EMU_SIO_GPIO_OE_SET:   gpio_oe |= v; break;
+    case EMU_SIO_GPIO_OE_CLR:   gpio_oe &= ~v; break;
+    case EMU_SIO_GPIO_OE_TOGL:  gpio_oe ^= v; break;
+    default:                    break;
+  }
+}
+
+//-------------------------------------------------------------------------
+void gpio_init(uint gpio) {
+  EmuGuard g;
+
+  gpio_oe &= ~(1u << gpio);
+  set_out(gpio_out & ~(1u << gpio));
+}
+
+//-------------------------------------------------------------------------
+void gpio_set_function(uint gpio, enum gpio_function fn) {
+  (void) gpio;
+  (void) fn;
+}
+
+//-------------------------------------------------------------------------
+void gpio_set_dir(uint gpio, bool out) {
+  EmuGuard g;
+
+  if (out) gpio_oe |= 1u << gpio;
+  else gpio_oe &= ~(1u << gpio);
+}
+
+//-------------------------------------------------------------------------
+void gpio_pull_up(uint gpio) {
+  EmuGuard g;
+
+  gpio_in |= 1u << gpio;
+}
+
+//-------------------------------------------------------------------------
+void gpio_pull_down(uint gpio) {
+  EmuGuard g;
+
+  gpio_in &= ~(1u << gpio);
+}
+
+//-------------------------------------------------------------------------
+void gpio_put(uint gpio, bool value) {
+  EmuGuard g;
+
+  set_out(value ? (gpio_out | (1u << gpio)) : (gpio_out & ~(1u << gpio)));
+}
+
+//-------------------------------------------------------------------------
+bool gpio_get(uint gpio) {
+  EmuGuard g;
+
+  return (gpio_level() >> gpio) & 1;
+}
+
+//-------------------------------------------------------------------------
+void pinMode(int pin, int mode) {
+  gpio_set_dir(pin, mode == OUTPUT);
+  if (mode == INPUT_PULLUP) gpio_pull_up(pin);
+  if (mode == INPUT_PULLDOWN) gpio_pull_down(pin);
+}
+
+//-------------------------------------------------------------------------
+void digitalWrite(int pin, int value) {
+  gpio_put(pin, value != LOW);
+}
+
+//-------------------------------------------------------------------------
+int digitalRead(int pin) {
+  return gpio_get(pin) ? HIGH : LOW;
+}
+
+//-------------------------------------------------------------------------
+// 10 bit reading as the arduino-pico default, all channels read --adc
+int analogRead(int pin) {
+  (void) pin;
+  emu_busy(2);                            // conversion time
+  return emu_cfg.adc & 0x3FF;
+}
+
+//-------------------------------------------------------------------------
+void analogReadResolution(int bits) {
+  (void) bits;
+}
+
+//-------------------------------------------------------------------------
+void adc_init(void) {
+  EmuGuard g;
+
+  adc_running = false;
+  adc_dreq = false;
+}
+
+//-------------------------------------------------------------------------
+void adc_gpio_init(uint gpio) {
+  (void) gpio;
+}
+
+//-------------------------------------------------------------------------
+void adc_select_input(uint input) {
+  (void) input;
+}
+
+//-------------------------------------------------------------------------
+void adc_fifo_setup(bool en, bool dreq_en, uint16_t dreq_thresh, bool err_in_fifo, bool byte_shift) {
+  EmuGuard g;
+
+  (void) dreq_thresh;
+  (void) err_in_fifo;
+  (void) byte_shift;
+  adc_dreq = en && dreq_en;
+}
+
+//-------------------------------------------------------------------------
+// A conversion every 1 + clkdiv cycles of clk_adc, 96 cycles at least
+void adc_set_clkdiv(float clkdiv) {
+  EmuGuard g;
+  uint64_t cycles = (uint64_t) clkdiv + 1;
+
+  adc_period_ns = std::max(cycles, (uint64_t) ADC_CYCLES) * 1000000000ull / ADC_CLK_HZ;
+}
+
+//-------------------------------------------------------------------------
+void adc_run(bool run) {
+  EmuGuard g;
+
+  if (run && !adc_running) adc_next_ns = emu_now() * 1000 + adc_period_ns;
+  adc_running = run;
+}
+
+//-------------------------------------------------------------------------
+// 12 bit value of a conversion
+static uint16_t adc_value(void) {
+  return (emu_cfg.adc & 0x3FF) << 2;
+}
+
+//-------------------------------------------------------------------------
+uint32_t emu_adc_reg_read(uint32_t id) {
+  switch (id) {
+    case EMU_ADC_FIFO:        return adc_value();
+    case EMU_DMA_TRANS_COUNT: return dma_count;
+    case EMU_DMA_CTRL_TRIG:   return (dma_count > 0) ? DMA_CH0_CTRL_TRIG_BUSY_BITS : 0;
+    default:                  return 0;
+  }
+}
+
+//-------------------------------------------------------------------------
+// The write address wraps at the ring size (aligned)
+static void dma_transfer(uint32_t v) {
+  uint32_t size = 1u << dma_cfg.size;
+  uintptr_t mask, next;
+
+  memcpy((void *) dma_write, &v, size);
+  if (dma_cfg.write_incr) {
+    next = dma_write + size;
+    if (dma_cfg.ring_write && dma_cfg.ring_bits) {
+      mask = ((uintptr_t) 1 << dma_cfg.ring_bits) - 1;
+      next = (dma_write & ~mask) | (next & mask);
+    }
+    dma_write = next;
+  }
+  dma_count -= 1;
+  dma_transfers += 1;
+}
+
+//-------------------------------------------------------------------------
+// Conversions of the free running ADC, moved by the DMA with DREQ_ADC
+void emu_adc_advance(uint64_t now) {
+  while (adc_running && (adc_next_ns <= now * 1000)) {
+    adc_conversions += 1;
+    if (adc_dreq && (dma_count > 0) && (dma_cfg.dreq == DREQ_ADC)) dma_transfer(adc_value());
+    adc_next_ns += adc_period_ns;
+  }
+}
+
+//-------------------------------------------------------------------------
+int dma_claim_unused_channel(bool required) {
+  EmuGuard g;
+
+  if (!dma_claimed) {
+    dma_claimed = true;
+    return 0;
+  }
+  if (required) {
+    fprintf(stderr, "emu: no DMA channel left\n");
+    emu_stop(1);
+  }
+  return -1;
+}
+
+//-------------------------------------------------------------------------
+dma_channel_config dma_channel_get_default_config(uint channel) {
+  dma_channel_config c = {DMA_SIZE_32, true, false, false, 0, 0x3F};
+
+  (void) channel;
+  return c;
+}
+
+//-------------------------------------------------------------------------
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger) {
+  EmuGuard g;
+
+  (void) channel;
+  (void) read_addr;
+  dma_cfg = *config;
+  dma_write = (uintptr_t) write_addr;
+  dma_count = trigger ? transfer_count : 0;
+}
+
+//-------------------------------------------------------------------------
+bool dma_channel_is_busy(uint channel) {
+  return (dma_channel_hw_addr(channel)->ctrl_trig & DMA_CH0_CTRL_TRIG_BUSY_BITS) != 0;
+}
+
+//-------------------------------------------------------------------------
+dma_channel_hw_t *dma_channel_hw_addr(uint channel) {
+  (void) channel;
+  return &dma_regs;
+}
+
+//-------------------------------------------------------------------------
+void delay(unsigned long ms) {
+  emu_busy((uint64_t) ms * 1000);
+}
+
+//-------------------------------------------------------------------------
+void delayMicroseconds(unsigned int us) {
+  emu_busy(us);
+}
+
+//-------------------------------------------------------------------------
+unsigned long millis(void) {
+  return emu_now() / 1000;
+}
+
+//-------------------------------------------------------------------------
+unsigned long micros(void) {
+  return emu_now();
+}
+
+//-------------------------------------------------------------------------
+char *ltoa(long value, char *s, int base) {
+  char tmp[34];
+  unsigned long v = (value < 0) && (base == 10) ? -value : value;
+  int i = 0, j = 0;
+
+  do {
+    tmp[i++] = "0123456789abcdefghijklmnopqrstuvwxyz"[v % base];
+    v /= base;
+  } while (v);
+  if ((value < 0) && (base == 10)) s[j++] = '-';
+  while (i) s[j++] = tmp[--i];
+  s[j] = '\0';
+  return s;
+}
+
+//-------------------------------------------------------------------------
+char *itoa(int value, char *s, int base) {
+  return ltoa(value, s, base);
+}
+
+//-------------------------------------------------------------------------
+char *utoa(unsigned value, char *s, int base) {
+  return ltoa((long) value, s, base);
+}
+
+//-------------------------------------------------------------------------
+void EmuSerial::begin(unsigned long baud) {
+  (void) baud;
+}
+
+//-------------------------------------------------------------------------
+void EmuSerial::print(const char *s) {
+  fputs(s, stderr);
+}
+
+//-------------------------------------------------------------------------
+void EmuSerial::print(char c) {
+  fputc(c, stderr);
+}
+
+//-------------------------------------------------------------------------
+void EmuSerial::print(long v) {
+  fprintf(stderr, "%ld", v);
+}
+
+//-------------------------------------------------------------------------
+void EmuSerial::print(unsigned long v) {
+  fprintf(stderr, "%lu", v);
+}
+
+//-------------------------------------------------------------------------
+void EmuSerial::print(double v) {
+  fprintf(stderr, "%.2f", v);
+}
+
+//-------------------------------------------------------------------------
+// HD44780 in 4 bit mode: the nibble is taken at the falling edge of EN,
+// two nibbles (high first) form a command (RS low) or a character
+static void lcd_write(uint8_t v) {
+  uint8_t c;
+
+  if ((lcd_last & LCD_EN_BIT) && !(v & LCD_EN_BIT)) {
+    if (!lcd_have_upper) {
+      lcd_upper = lcd_last & 0xF0;
+      lcd_have_upper = true;
+    } else {
+      lcd_have_upper = false;
+      c = lcd_upper | (lcd_last >> 4);
+      if (lcd_last & LCD_RS_BIT) {
+        lcd_ddram[lcd_addr & 0x7F] = c;
+        lcd_addr = (lcd_addr + 1) & 0x7F;
+      } else if (c & 0x80) {
+        lcd_addr = c & 0x7F;
+      } else if (c == 0x01) {
+        memset(lcd_ddram, ' ', sizeof(lcd_ddram));
+        lcd_addr = 0;
+      } else if ((c & 0xFE) == 0x02) {
+        lcd_addr = 0;
+      }
+      lcd_dirty = true;
+    }
+  }
+  lcd_last = v;
+}
+
+//-------------------------------------------------------------------------
+// Prints the display (--lcd) when it has changed, at most every 100ms
+void emu_lcd_advance(uint64_t now) {
+  if (!emu_cfg.lcd || !lcd_dirty || (now - lcd_printed < LCD_REFRESH_US)) return;
+  lcd_dirty = false;
+  lcd_printed = now;
+  fprintf(stderr, "+--------------------+ %.3f s\n", now / 1e6);
+  for (int row = 0; row < EMU_LCD_ROWS; row++) {
+    fprintf(stderr, "|%.*s|\n", EMU_LCD_COLS, lcd_ddram + lcd_row_addr[row]);
+  }
+  fprintf(stderr, "+--------------------+\n");
+}
+
+//-------------------------------------------------------------------------
+uint i2c_init(i2c_inst_t *i2c, uint baudrate) {
+  EmuGuard g;
+
+  i2c->speed = baudrate;
+  memset(lcd_ddram, ' ', sizeof(lcd_ddram));
+  return baudrate;
+}
+
+//-------------------------------------------------------------------------
+void i2c_deinit(i2c_inst_t *i2c) {
+  (void) i2c;
+}
+
+//-------------------------------------------------------------------------
+// Address byte and data bytes, 9 clocks each
+int i2c_write_blocking(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop) {
+  (void) addr;
+  (void) nostop;
+  emu_busy((len + 1) * 9 * 1000000ull / i2c->speed);
+  EmuGuard g;
+  for (size_t i = 0; i < len; i++) lcd_write(src[i]);
+  i2c_bytes += len + 1;
+  return len;
+}
+
+//-------------------------------------------------------------------------
+int i2c_read_blocking(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst, size_t len, bool nostop) {
+  (void) addr;
+  (void) nostop;
+  emu_busy((len + 1) * 9 * 1000000ull / i2c->speed);
+  memset(dst, 0xFF, len);
+  return len;
+}
+
+//-------------------------------------------------------------------------
+i2c_hw_t *i2c_get_hw(i2c_inst_t *i2c) {
+  (void) i2c;
+  return &i2c_regs;
+}
+
+//-------------------------------------------------------------------------
+// The next byte of the FIFO goes on the bus, the first byte of a transfer
+// after the address byte (9 clocks each)
+static void i2c_schedule(uint64_t from_ns) {
+  uint64_t byte_ns = 9000000000ull / i2c0->speed;
+
+  i2c_next_ns = from_ns + (i2c_in_transfer ? byte_ns : 2 * byte_ns);
+  if (!i2c_in_transfer) i2c_bytes += 1;
+  i2c_in_transfer = true;
+}
+
+//-------------------------------------------------------------------------
+// Interrupt driven transfers: the FIFO is emptied at the bus speed. An empty
+// FIFO without stop holds the bus (clock stretching) until the next byte.
+void emu_i2c_advance(uint64_t now) {
+  uint16_t cmd;
+
+  while (!i2c_fifo.empty() && (i2c_next_ns <= now * 1000)) {
+    cmd = i2c_fifo.front();
+    i2c_fifo.pop_front();
+    lcd_write(cmd & 0xFF);
+    i2c_bytes += 1;
+    if (cmd & I2C_IC_DATA_CMD_STOP_BITS) {
+      i2c_in_transfer = false;
+      i2c_latched |= I2C_IC_RAW_INTR_STAT_STOP_DET_BITS;
+    }
+    if (!i2c_fifo.empty()) i2c_schedule(i2c_next_ns);
+  }
+}
+
+//-------------------------------------------------------------------------
+static uint32_t i2c_raw_intr(void) {
+  uint32_t raw = i2c_latched;
+
+  if (i2c_fifo.size() <= i2c_tx_tl) raw |= I2C_IC_RAW_INTR_STAT_TX_EMPTY_BITS;
+  return raw;
+}
+
+//-------------------------------------------------------------------------
+bool emu_i2c_line(void) {
+  return (i2c_raw_intr() & i2c_mask) != 0;
+}
+
+//-------------------------------------------------------------------------
+uint32_t emu_i2c_reg_read(uint32_t id) {
+  uint32_t v;
+
+  switch (id) {
+    case EMU_I2C_CON:           return i2c_con;
+    case EMU_I2C_TAR:           return i2c_tar;
+    case EMU_I2C_INTR_STAT:     return i2c_raw_intr() & i2c_mask;
+    case EMU_I2C_INTR_MASK:     return i2c_mask;
+    case EMU_I2C_RAW_INTR_STAT: return i2c_raw_intr();
+    case EMU_I2C_TX_TL:         return i2c_tx_tl;
+    case EMU_I2C_CLR_INTR:
+    case EMU_I2C_CLR_STOP_DET:
+      v = (i2c_latched != 0);
+      i2c_latched = 0;
+      return v;
+    case EMU_I2C_ENABLE:        return i2c_enable;
+    case EMU_I2C_STATUS:
+      v = (i2c_in_transfer || !i2c_fifo.empty()) ? I2C_IC_STATUS_ACTIVITY_BITS : 0;
+      if (i2c_fifo.size() < EMU_I2C_FIFO) v |= I2C_IC_STATUS_TFNF_BITS;
+      if (i2c_fifo.empty()) v |= I2C_IC_STATUS_TFE_BITS;
+      return v;
+    case EMU_I2C_TXFLR:         return i2c_fifo.size();
+    default:                    return 0;
+  }
+}
+
+//-------------------------------------------------------------------------
+// Disabling the I2C flushes the FIFO
+void emu_i2c_reg_write(uint32_t id, uint32_t v) {
+  switch (id) {
+    case EMU_I2C_CON:       i2c_con = v; break;
+    case EMU_I2C_TAR:       i2c_tar = v; break;
+    case EMU_I2C_INTR_MASK: i2c_mask = v; break;
+    case EMU_I2C_TX_TL:     i2c_tx_tl = v & 0xFF; break;
+    case EMU_I2C_ENABLE:
+      i2c_enable = v & 1;
+      if (!i2c_enable) {
+        i2c_fifo.clear();
+        i2c_in_transfer = false;
+      }
+      break;
+    case EMU_I2C_DATA_CMD:
+      if (!i2c_enable || (i2c_fifo.size() >= EMU_I2C_FIFO)) break;     // TX_OVER
+      if (i2c_fifo.empty()) i2c_schedule(std::max(i2c_next_ns, emu_now() * 1000));
+      i2c_fifo.push_back(v & (I2C_IC_DATA_CMD_STOP_BITS | 0xFF));
+      break;
+  }
+}
+
+//-------------------------------------------------------------------------
+void EEPROMClass::begin(size_t size) {
+  FILE *f;
+
+  eeprom_size = (size < EMU_EEPROM_SIZE) ? size : EMU_EEPROM_SIZE;
+  memset(eeprom, 0xFF, sizeof(eeprom));
+  f = fopen(emu_cfg.eeprom, "rb");
+  if (f) {
+    if (fread(eeprom, 1, eeprom_size, f) == 0) memset(eeprom, 0xFF, sizeof(eeprom));
+    fclose(f);
+  }
+}
+
+//-------------------------------------------------------------------------
+uint8_t EEPROMClass::read(int address) {
+  if ((address < 0) || ((size_t) address >= eeprom_size)) return 0;
+  return eeprom[address];
+}
+
+//-------------------------------------------------------------------------
+void EEPROMClass::write(int address, uint8_t value) {
+  if ((address >= 0) && ((size_t) address < eeprom_size)) eeprom[address] = value;
+}
+
+//-------------------------------------------------------------------------
+bool EEPROMClass::commit(void) {
+  FILE *f = fopen(emu_cfg.eeprom, "wb");
+
+  emu_busy(1000);                         // flash erase and program
+  if (!f) return false;
+  fwrite(eeprom, 1, eeprom_size, f);
+  fclose(f);
+  return true;
+}
+
+//-------------------------------------------------------------------------
+bool EEPROMClass::end(void) {
+  return commit();
+}
+
+//-------------------------------------------------------------------------
+size_t EEPROMClass::length(void) {
+  return eeprom_size;
+}
+
+//-------------------------------------------------------------------------
+// Erased flash, the top from the --flash file
+void emu_flash_load(void) {
+  FILE *f;
+
+  memset(emu_flash, 0xFF, EMU_FLASH_SIZE);
+  f = fopen(emu_cfg.flash, "rb");
+  if (f) {
+    if (fread(emu_flash + EMU_FLASH_SIZE - EMU_FLASH_KEEP, 1, EMU_FLASH_KEEP, f) != EMU_FLASH_KEEP) {
+      memset(emu_flash + EMU_FLASH_SIZE - EMU_FLASH_KEEP, 0xFF, EMU_FLASH_KEEP);
+    }
+    fclose(f);
+  }
+}
+
+//-------------------------------------------------------------------------
+static void flash_save(void) {
+  FILE *f = fopen(emu_cfg.flash, "wb");
+
+  if (!f) return;
+  fwrite(emu_flash + EMU_FLASH_SIZE - EMU_FLASH_KEEP, 1, EMU_FLASH_KEEP, f);
+  fclose(f);
+}
+
+//-------------------------------------------------------------------------
+void flash_range_erase(uint32_t flash_offs, size_t count) {
+  emu_busy(FLASH_ERASE_US * (count / FLASH_SECTOR_SIZE));
+  if ((flash_offs % FLASH_SECTOR_SIZE) || (count % FLASH_SECTOR_SIZE) || (flash_offs + count > EMU_FLASH_SIZE)) return;
+  memset(emu_flash + flash_offs, 0xFF, count);
+  flash_erases += count / FLASH_SECTOR_SIZE;
+  flash_save();
+}
+
+//-------------------------------------------------------------------------
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count) {
+  emu_busy(FLASH_PROGRAM_US * (count / FLASH_PAGE_SIZE));
+  if ((flash_offs % FLASH_PAGE_SIZE) || (count % FLASH_PAGE_SIZE) || (flash_offs + count > EMU_FLASH_SIZE)) return;
+  for (size_t i = 0; i < count; i++) emu_flash[flash_offs + i] &= data[i];
+  flash_programs += count / FLASH_PAGE_SIZE;
+  flash_save();
+}
+
+//-------------------------------------------------------------------------
+void emu_periph_stats(FILE *f) {
+  EmuGuard g;
+
+  fprintf(f, "gpio edges:");
+  for (int pin = 0; pin < EMU_GPIO_COUNT; pin++) {
+    if (gpio_edges[pin]) fprintf(f, " %d:%llu", pin, (unsigned long long) gpio_edges[pin]);
+  }
+  fprintf(f, "\ni2c: %llu bytes\n", (unsigned long long) i2c_bytes);
+  fprintf(f, "flash: %u sector erases, %u page programs\n", flash_erases, flash_programs);
+  fprintf(f, "adc: %llu conversions, %llu DMA transfers\n", (unsigned long long) adc_conversions,
+          (unsigned long long) dma_transfers);
+}
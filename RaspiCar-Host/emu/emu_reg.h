@@ -0,0 +1,51 @@
+#ifndef __EMU_REG__
+#define __EMU_REG__
+
+#include <stdint.h>
+
+// Registers of the emulated peripherals
+enum emu_reg_id {
+  EMU_REG_NONE = 0,
+  // timer
+  EMU_TIMER_TIMEHW, EMU_TIMER_TIMELW, EMU_TIMER_TIMEHR, EMU_TIMER_TIMELR,
+  EMU_TIMER_ALARM0, EMU_TIMER_ALARM1, EMU_TIMER_ALARM2, EMU_TIMER_ALARM3,
+  EMU_TIMER_ARMED, EMU_TIMER_TIMERAWH, EMU_TIMER_TIMERAWL,
+  EMU_TIMER_DBGPAUSE, EMU_TIMER_PAUSE, EMU_TIMER_INTR, EMU_TIMER_INTE, EMU_TIMER_INTF, EMU_TIMER_INTS,
+  // SIO
+  EMU_SIO_CPUID, EMU_SIO_GPIO_IN, EMU_SIO_GPIO_HI_IN,
+  EMU_SIO_GPIO_OUT, EMU_SIO_GPIO_SET, EMU_SIO_GPIO_CLR, EMU_SIO_GPIO_TOGL,
+  EMU_SIO_GPIO_OE, EMU_SIO_GPIO_OE_SET, EMU_SIO_GPIO_OE_CLR, EMU_SIO_GPIO_OE_TOGL,
+  // UART (PL011)
+  EMU_UART_DR, EMU_UART_RSR, EMU_UART_FR, EMU_UART_ILPR, EMU_UART_IBRD, EMU_UART_FBRD,
+  EMU_UART_LCR_H, EMU_UART_CR, EMU_UART_IFLS, EMU_UART_IMSC, EMU_UART_RIS, EMU_UART_MIS,
+  EMU_UART_ICR, EMU_UART_DMACR,
+  // SysTick (M0PLUS_SYST_*)
+  EMU_SYSTICK_CSR, EMU_SYSTICK_RVR, EMU_SYSTICK_CVR, EMU_SYSTICK_CALIB,
+  // I2C (DW_apb_i2c)
+  EMU_I2C_CON, EMU_I2C_TAR, EMU_I2C_DATA_CMD, EMU_I2C_INTR_STAT, EMU_I2C_INTR_MASK,
+  EMU_I2C_RAW_INTR_STAT, EMU_I2C_TX_TL, EMU_I2C_CLR_INTR, EMU_I2C_CLR_TX_ABRT, EMU_I2C_CLR_STOP_DET,
+  EMU_I2C_ENABLE, EMU_I2C_STATUS, EMU_I2C_TXFLR,
+  // ADC and DMA
+  EMU_ADC_FIFO, EMU_DMA_TRANS_COUNT, EMU_DMA_CTRL_TRIG
+};
+
+uint32_t emu_reg_read(uint32_t id);
+void emu_reg_write(uint32_t id, uint32_t v);
+
+// Memory mapped register of the mock HAL. The firmware reads and writes it
+// like a volatile uint32_t, the access goes to the emulated peripheral.
+class emu_reg {
+  private:
+    const uint32_t id;
+
+  public:
+    emu_reg(emu_reg_id reg_id) : id(reg_id) {}
+    operator uint32_t() const { return emu_reg_read(id); }
+    emu_reg &operator=(uint32_t v) { emu_reg_write(id, v); return *this; }
+    emu_reg &operator=(const emu_reg &r) { emu_reg_write(id, (uint32_t) r); return *this; }
+    emu_reg &operator|=(uint32_t v) { emu_reg_write(id, emu_reg_read(id) | v); return *this; }
+    emu_reg &operator&=(uint32_t v) { emu_reg_write(id, emu_reg_read(id) & v); return *this; }
+    emu_reg &operator^=(uint32_t v) { emu_reg_write(id, emu_reg_read(id) ^ v); return *this; }
+};
+
+#endif
@@ -0,0 +1,383 @@
+/*
+ * UART1 (PL011) with FIFOs, interrupts and the byte time of the baud rate
+ * The line is the master side of a pseudo terminal, the host software
+ * opens the slave side (or the symlink given by --link) as serial port.
+ */
+
+#include "emu.h"
+#include "hardware/uart.h"
+#include "hardware/irq.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <deque>
+#include <string>
+
+#define UART_HOST_OUT_MAX   65536     // bytes the host has not read yet
+#define UART_BAUD_CHECK_US   1000     // interval to read the baud rate of the host
+
+struct uart_inst {
+  int num;
+};
+
+static uart_inst_t uart_insts[2] = {{0}, {1}};
+uart_inst_t *uart0 = &uart_insts[0];
+uart_inst_t *uart1 = &uart_insts[1];
+static uart_hw_t uart_regs;
+
+static int master = -1, slave = -1;
+static char slave_name[64];
+static uint32_t baud = 115200;
+static bool enabled = false;
+static uint32_t imsc = 0, ifls = 0, cr = 0, lcr_h = 0, dmacr = 0;
+static uint32_t err_latched = 0;          // error interrupts (RIS bits)
+static std::deque<uint16_t> rx_fifo;      // data and error bits
+static std::deque<uint8_t> tx_fifo;
+static std::deque<uint8_t> host_in;       // sent by the host, not yet on the line
+static std::string host_out;              // sent by the UART, not yet read by the host
+static uint64_t now_ns = 0;
+static uint64_t tx_free_ns = 0;           // end of the byte on the line
+static uint64_t rx_next_ns = 0;           // end of the last received byte
+static uint64_t rx_polled_ns = 0;
+static uint16_t rx_flags = 0;             // error bits of the next byte (overrun)
+static bool baud_match = true;
+static uint64_t baud_checked = 0;
+static uint64_t rx_bytes = 0, tx_bytes = 0, rx_overruns = 0, rx_errors = 0, tx_dropped = 0;
+
+//-------------------------------------------------------------------------
+static uint64_t byte_ns(void) {
+  return 10000000000ull / baud;             // 8N1: 10 bits
+}
+
+//-------------------------------------------------------------------------
+static uint32_t speed_to_baud(speed_t speed) {
+  switch (speed) {
+    case B9600:     return 9600;
+    case B19200:    return 19200;
+    case B38400:    return 38400;
+    case B57600:    return 57600;
+    case B115200:   return 115200;
+    case B230400:   return 230400;
+    case B460800:   return 460800;
+    case B921600:   return 921600;
+    case B1000000:  return 1000000;
+    default:        return 0;
+  }
+}
+
+//-------------------------------------------------------------------------
+// The pty has no line, but the host sets its baud rate. With a different
+// rate the bytes arrive as framing errors and the host receives garbage.
+static void check_baud(uint64_t now) {
+  struct termios tio;
+  uint32_t host_baud;
+
+  if (!emu_cfg.baud_check || (now - baud_checked < UART_BAUD_CHECK_US)) return;
+  baud_checked = now;
+  if (tcgetattr(master, &tio) < 0) return;
+  host_baud = speed_to_baud(cfgetospeed(&tio));
+  baud_match = (host_baud == 0) || (host_baud == baud);
+}
+
+//-------------------------------------------------------------------------
+bool emu_uart_open(void) {
+  struct termios tio;
+  struct stat st;
+
+  master = posix_openpt(O_RDWR | O_NOCTTY);
+  if ((master < 0) || (grantpt(master) < 0) || (unlockpt(master) < 0)) return false;
+  snprintf(slave_name, sizeof(slave_name), "%s", ptsname(master));
+  fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+  // the slave stays open: raw mode until the host opens it, no hangup
+  // when the host closes it
+  slave = open(slave_name, O_RDWR | O_NOCTTY);
+  if (slave < 0) return false;
+  tcgetattr(slave, &tio);
+  cfmakeraw(&tio);
+  cfsetispeed(&tio, B115200);
+  cfsetospeed(&tio, B115200);
+  tcsetattr(slave, TCSANOW, &tio);
+
+  if (emu_cfg.link) {
+    if ((lstat(emu_cfg.link, &st) == 0) && S_ISLNK(st.st_mode)) unlink(emu_cfg.link);
+    if (symlink(slave_name, emu_cfg.link) < 0) {
+      fprintf(stderr, "emu: symlink %s: %s\n", emu_cfg.link, strerror(errno));
+      return false;
+    }
+  }
+  return true;
+}
+
+//-------------------------------------------------------------------------
+const char *emu_uart_name(void) {
+  return emu_cfg.link ? emu_cfg.link : slave_name;
+}
+
+//-------------------------------------------------------------------------
+static void receive_byte(uint8_t c) {
+  rx_bytes += 1;
+  if (rx_fifo.size() >= EMU_UART_FIFO) {
+    rx_overruns += 1;
+    rx_flags |= UART_UARTDR_OE_BITS;
+    err_latched |= UART_UARTIMSC_OEIM_BITS;
+    return;
+  }
+  if (!baud_match) {
+    rx_errors += 1;
+    rx_flags |= UART_UARTDR_FE_BITS;
+    err_latched |= UART_UARTIMSC_FEIM_BITS;
+    c = 0;
+  }
+  rx_fifo.push_back(c | rx_flags);
+  rx_flags = 0;
+}
+
+//-------------------------------------------------------------------------
+// emu_uart_advance
+// Moves the bytes over the line up to now (one byte time each): TX FIFO to
+// the host, host to RX FIFO
+void emu_uart_advance(uint64_t now) {
+  uint8_t buf[512];
+  ssize_t n;
+  uint64_t start_ns = now_ns;
+
+  now_ns = now * 1000;
+  if (master < 0) return;
+
+  // transmit
+  while (!tx_fifo.empty() && (tx_free_ns + byte_ns() <= now_ns)) {
+    tx_free_ns += byte_ns();
+    if (host_out.size() < UART_HOST_OUT_MAX) {
+      host_out += baud_match ? (char) tx_fifo.front() : (char) 0xFF;
+    } else {
+      tx_dropped += 1;
+    }
+    tx_fifo.pop_front();
+    tx_bytes += 1;
+  }
+  if (!host_out.empty()) {
+    check_baud(now);
+    n = write(master, host_out.data(), host_out.size());
+    if (n > 0) host_out.erase(0, n);
+  }
+
+  // receive, the pty is read once per byte time
+  n = 0;
+  if (now_ns - rx_polled_ns >= byte_ns()) {
+    rx_polled_ns = now_ns;
+    n = read(master, buf, sizeof(buf));
+  }
+  if (n > 0) {
+    check_baud(now);
+    if (host_in.empty() && (rx_next_ns < start_ns)) rx_next_ns = start_ns;   // line was idle
+    host_in.insert(host_in.end(), buf, buf + n);
+  }
+  while (!host_in.empty() && (rx_next_ns + byte_ns() <= now_ns)) {
+    rx_next_ns += byte_ns();
+    if (enabled) receive_byte(host_in.front());
+    host_in.pop_front();
+  }
+}
+
+//-------------------------------------------------------------------------
+static uint32_t uart_ris(void) {
+  uint32_t r = err_latched;
+
+  if (rx_fifo.size() >= EMU_UART_RX_LEVEL) r |= UART_UARTRIS_RXRIS_BITS;
+  if (!rx_fifo.empty() && (now_ns - rx_next_ns >= 32 * byte_ns() / 10)) r |= UART_UARTRIS_RTRIS_BITS;
+  if (tx_fifo.size() <= EMU_UART_TX_LEVEL) r |= UART_UARTRIS_TXRIS_BITS;
+  return r;
+}
+
+//-------------------------------------------------------------------------
+bool emu_uart_line(void) {
+  return enabled && (uart_ris() & imsc);
+}
+
+//-------------------------------------------------------------------------
+static uint32_t uart_fr(void) {
+  uint32_t fr = 0;
+
+  if (rx_fifo.empty()) fr |= UART_UARTFR_RXFE_BITS;
+  if (rx_fifo.size() >= EMU_UART_FIFO) fr |= UART_UARTFR_RXFF_BITS;
+  if (tx_fifo.empty()) fr |= UART_UARTFR_TXFE_BITS;
+  if (tx_fifo.size() >= EMU_UART_FIFO) fr |= UART_UARTFR_TXFF_BITS;
+  if (!tx_fifo.empty() || (tx_free_ns > now_ns)) fr |= UART_UARTFR_BUSY_BITS;
+  return fr;
+}
+
+//-------------------------------------------------------------------------
+static void uart_tx(uint8_t c) {
+  if (tx_fifo.size() >= EMU_UART_FIFO) return;      // lost as on the PL011
+  if (tx_fifo.empty() && (tx_free_ns < now_ns)) tx_free_ns = now_ns;
+  tx_fifo.push_back(c);
+}
+
+//-------------------------------------------------------------------------
+// Called with the emulator lock held
+uint32_t emu_uart_reg_read(uint32_t id) {
+  uint32_t v;
+
+  switch (id) {
+    case EMU_UART_DR:
+      if (rx_fifo.empty()) return 0;
+      v = rx_fifo.front();
+      rx_fifo.pop_front();
+      return v;
+    case EMU_UART_FR:     return uart_fr();
+    case EMU_UART_IBRD:   return 125000000 / (16 * baud);
+    case EMU_UART_LCR_H:  return lcr_h;
+    case EMU_UART_CR:     return cr;
+    case EMU_UART_IFLS:   return ifls;
+    case EMU_UART_IMSC:   return imsc;
+    case EMU_UART_RIS:    return uart_ris();
+    case EMU_UART_MIS:    return uart_ris() & imsc;
+    case EMU_UART_DMACR:  return dmacr;
+    default:              return 0;
+  }
+}
+
+//-------------------------------------------------------------------------
+void emu_uart_reg_write(uint32_t id, uint32_t v) {
+  switch (id) {
+    case EMU_UART_DR:     uart_tx(v); break;
+    case EMU_UART_LCR_H:  lcr_h = v; break;
+    case EMU_UART_CR:     cr = v; break;
+    case EMU_UART_IFLS:   ifls = v; break;
+    case EMU_UART_IMSC:   imsc = v; break;
+    case EMU_UART_ICR:    err_latched &= ~v; break;
+    case EMU_UART_DMACR:  dmacr = v; break;
+    default:              break;
+  }
+}
+
+//-------------------------------------------------------------------------
+uint uart_init(uart_inst_t *uart, uint baudrate) {
+  EmuGuard g;
+
+  if (uart != uart1) return baudrate;
+  baud = baudrate;
+  enabled = true;
+  rx_fifo.clear();
+  tx_fifo.clear();
+  return baudrate;
+}
+
+//-------------------------------------------------------------------------
+void uart_deinit(uart_inst_t *uart) {
+  EmuGuard g;
+
+  if (uart == uart1) enabled = false;
+}
+
+//-------------------------------------------------------------------------
+uint uart_set_baudrate(uart_inst_t *uart, uint baudrate) {
+  EmuGuard g;
+
+  if (uart == uart1) {
+    baud = baudrate;
+    baud_checked = 0;
+  }
+  return baudrate;
+}
+
+//-------------------------------------------------------------------------
+void uart_set_format(uart_inst_t *uart, uint data_bits, uint stop_bits, int parity) {
+  (void) uart;
+  (void) data_bits;
+  (void) stop_bits;
+  (void) parity;
+}
+
+//-------------------------------------------------------------------------
+void uart_set_fifo_enabled(uart_inst_t *uart, bool enabled) {
+  (void) uart;
+  (void) enabled;
+}
+
+//-------------------------------------------------------------------------
+void uart_set_irq_enables(uart_inst_t *uart, bool rx_has_data, bool tx_needs_data) {
+  EmuGuard g;
+
+  if (uart != uart1) return;
+  imsc = (rx_has_data ? (UART_UARTIMSC_RXIM_BITS | UART_UARTIMSC_RTIM_BITS) : 0) |
+         (tx_needs_data ? UART_UARTIMSC_TXIM_BITS : 0);
+}
+
+//-------------------------------------------------------------------------
+uart_hw_t *uart_get_hw(uart_inst_t *uart) {
+  (void) uart;
+  return &uart_regs;
+}
+
+//-------------------------------------------------------------------------
+bool uart_is_readable(uart_inst_t *uart) {
+  EmuGuard g;
+
+  return (uart == uart1) && !rx_fifo.empty();
+}
+
+//-------------------------------------------------------------------------
+// Polled in a loop while the FIFO is full, the line drains as the clock
+// goes on. Interrupt handlers return instead.
+bool uart_is_writable(uart_inst_t *uart) {
+  bool writable;
+
+  emu_lock();
+  writable = (uart != uart1) || (tx_fifo.size() < EMU_UART_FIFO);
+  emu_unlock();
+  if (!writable && !emu_in_irq()) emu_yield();
+  return writable;
+}
+
+//-------------------------------------------------------------------------
+char uart_getc(uart_inst_t *uart) {
+  while (!uart_is_readable(uart)) emu_yield();
+  return (char) emu_reg_read(EMU_UART_DR);
+}
+
+//-------------------------------------------------------------------------
+void uart_putc_raw(uart_inst_t *uart, char c) {
+  if (uart != uart1) return;
+  while (!uart_is_writable(uart)) emu_yield();
+  emu_reg_write(EMU_UART_DR, (uint8_t) c);
+}
+
+//-------------------------------------------------------------------------
+void uart_putc(uart_inst_t *uart, char c) {
+  uart_putc_raw(uart, c);
+}
+
+//-------------------------------------------------------------------------
+void uart_puts(uart_inst_t *uart, const char *s) {
+  while (*s) uart_putc_raw(uart, *s++);
+}
+
+//-------------------------------------------------------------------------
+void uart_write_blocking(uart_inst_t *uart, const uint8_t *src, size_t len) {
+  for (size_t i = 0; i < len; i++) uart_putc_raw(uart, src[i]);
+}
+
+//-------------------------------------------------------------------------
+void uart_read_blocking(uart_inst_t *uart, uint8_t *dst, size_t len) {
+  for (size_t i = 0; i < len; i++) dst[i] = uart_getc(uart);
+}
+
+//-------------------------------------------------------------------------
+void uart_tx_wait_blocking(uart_inst_t *uart) {
+  while ((uart == uart1) && (emu_reg_read(EMU_UART_FR) & UART_UARTFR_BUSY_BITS)) emu_yield();
+}
+
+//-------------------------------------------------------------------------
+void emu_uart_stats(FILE *f) {
+  EmuGuard g;
+
+  fprintf(f, "uart1: %u baud, %llu bytes received, %llu sent, %llu overruns, %llu framing errors, %llu dropped (host not reading)\n",
+          baud, (unsigned long long) rx_bytes, (unsigned long long) tx_bytes,
+          (unsigned long long) rx_overruns, (unsigned long long) rx_errors, (unsigned long long) tx_dropped);
+}
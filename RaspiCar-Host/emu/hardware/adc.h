@@ -0,0 +1,17 @@
+#ifndef __EMU_HARDWARE_ADC__
+#define __EMU_HARDWARE_ADC__
+
+#include "pico/types.h"
+#include "hardware/structs/adc.h"
+
+// Free running conversions at the clock divider, each conversion reads
+// --adc (10 bit) as 12 bit value. With DREQ enabled, the conversions go
+// to the DMA channel paced by DREQ_ADC, the FIFO itself holds one value.
+void adc_init(void);
+void adc_gpio_init(uint gpio);
+void adc_select_input(uint input);
+void adc_fifo_setup(bool en, bool dreq_en, uint16_t dreq_thresh, bool err_in_fifo, bool byte_shift);
+void adc_set_clkdiv(float clkdiv);
+void adc_run(bool run);
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef __EMU_ADDRESS_MAPPED__
+#define __EMU_ADDRESS_MAPPED__
+
+#include <stdint.h>
+#include "emu_reg.h"
+
+typedef emu_reg io_rw_32;
+typedef emu_reg io_ro_32;
+typedef emu_reg io_wo_32;
+
+static inline void hw_set_bits(emu_reg *r, uint32_t mask) { *r |= mask; }
+static inline void hw_clear_bits(emu_reg *r, uint32_t mask) { *r &= ~mask; }
+static inline void hw_xor_bits(emu_reg *r, uint32_t mask) { *r ^= mask; }
+static inline void hw_set_bits(volatile uint32_t *a, uint32_t mask) { *a |= mask; }
+static inline void hw_clear_bits(volatile uint32_t *a, uint32_t mask) { *a &= ~mask; }
+static inline void hw_xor_bits(volatile uint32_t *a, uint32_t mask) { *a ^= mask; }
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef __EMU_HARDWARE_CLOCKS__
+#define __EMU_HARDWARE_CLOCKS__
+
+#include "pico/types.h"
+
+enum clock_index { clk_gpout0 = 0, clk_gpout1, clk_gpout2, clk_gpout3, clk_ref, clk_sys, clk_peri, clk_usb, clk_adc, clk_rtc };
+
+uint32_t clock_get_hz(enum clock_index clk_index);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef __EMU_HARDWARE_DMA__
+#define __EMU_HARDWARE_DMA__
+
+#include "pico/types.h"
+#include "hardware/structs/dma.h"
+
+// One DMA channel, paced by the ADC (DREQ_ADC): write increment and write
+// ring as the rp2040, the read address is the ADC FIFO.
+#define DREQ_ADC  36
+
+enum dma_channel_transfer_size { DMA_SIZE_8 = 0, DMA_SIZE_16 = 1, DMA_SIZE_32 = 2 };
+
+typedef struct {
+  uint32_t size;
+  bool read_incr;
+  bool write_incr;
+  bool ring_write;
+  uint32_t ring_bits;
+  uint32_t dreq;
+} dma_channel_config;
+
+int dma_claim_unused_channel(bool required);
+dma_channel_config dma_channel_get_default_config(uint channel);
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger);
+bool dma_channel_is_busy(uint channel);
+dma_channel_hw_t *dma_channel_hw_addr(uint channel);
+
+static inline void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size) { c->size = size; }
+static inline void channel_config_set_read_increment(dma_channel_config *c, bool incr) { c->read_incr = incr; }
+static inline void channel_config_set_write_increment(dma_channel_config *c, bool incr) { c->write_incr = incr; }
+static inline void channel_config_set_ring(dma_channel_config *c, bool write, uint size_bits) { c->ring_write = write; c->ring_bits = size_bits; }
+static inline void channel_config_set_dreq(dma_channel_config *c, uint dreq) { c->dreq = dreq; }
+
+#endif
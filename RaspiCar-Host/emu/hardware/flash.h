@@ -0,0 +1,21 @@
+#ifndef __EMU_HARDWARE_FLASH__
+#define __EMU_HARDWARE_FLASH__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Flash of 2 MB mapped at XIP_BASE. Erase and program take the time of the
+// flash chip (the calling core is busy), program only clears bits. The top
+// of the flash (configuration journal, EEPROM) is kept in the file given
+// by --flash. The linker symbols _FS_start and __flash_binary_end are set
+// as by the arduino-pico core without a file system.
+#define FLASH_PAGE_SIZE    (1u << 8)
+#define FLASH_SECTOR_SIZE  (1u << 12)
+
+extern "C" uint8_t emu_flash[];
+#define XIP_BASE ((uintptr_t) emu_flash)
+
+void flash_range_erase(uint32_t flash_offs, size_t count);
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count);
+
+#endif
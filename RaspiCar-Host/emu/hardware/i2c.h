@@ -0,0 +1,19 @@
+#ifndef __EMU_HARDWARE_I2C__
+#define __EMU_HARDWARE_I2C__
+
+#include "pico/types.h"
+#include "hardware/structs/i2c.h"
+
+// Writes take the bus time at the set speed. The bytes to the LCD backpack
+// (PCF8574, 4 bit mode) drive an emulated HD44780 text display. Both
+// instances share one set of registers (only i2c0 is connected).
+typedef struct i2c_inst i2c_inst_t;
+extern i2c_inst_t *i2c0, *i2c1;
+
+uint i2c_init(i2c_inst_t *i2c, uint baudrate);
+void i2c_deinit(i2c_inst_t *i2c);
+int i2c_write_blocking(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop);
+int i2c_read_blocking(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst, size_t len, bool nostop);
+i2c_hw_t *i2c_get_hw(i2c_inst_t *i2c);
+
+#endif
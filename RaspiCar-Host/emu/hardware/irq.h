@@ -0,0 +1,29 @@
+#ifndef __EMU_HARDWARE_IRQ__
+#define __EMU_HARDWARE_IRQ__
+
+#include "pico/types.h"
+#include "hardware/address_mapped.h"
+
+#define TIMER_IRQ_0       0
+#define TIMER_IRQ_1       1
+#define TIMER_IRQ_2       2
+#define TIMER_IRQ_3       3
+#define PWM_IRQ_WRAP      4
+#define UART0_IRQ        20
+#define UART1_IRQ        21
+#define I2C0_IRQ         23
+#define I2C1_IRQ         24
+#define EMU_IRQ_COUNT    32
+
+typedef void (*irq_handler_t)(void);
+
+// An interrupt belongs to the core that enables it (as the NVIC of the
+// rp2040), the handler runs on the thread of this core
+void irq_set_exclusive_handler(uint num, irq_handler_t handler);
+irq_handler_t irq_get_exclusive_handler(uint num);
+void irq_set_enabled(uint num, bool enabled);
+bool irq_is_enabled(uint num);
+void irq_set_pending(uint num);
+void irq_set_priority(uint num, uint8_t priority);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef __EMU_HARDWARE_PWM__
+#define __EMU_HARDWARE_PWM__
+
+#include "pico/types.h"
+#include "hardware/irq.h"
+
+// The PWM slices are not emulated: the settings are accepted, no wrap
+// interrupt is raised (STEP_BACKEND_PWM does not run in the emulator).
+typedef struct {
+  uint32_t csr;
+  uint32_t div;
+  uint32_t top;
+} pwm_config;
+
+static inline pwm_config pwm_get_default_config(void) { pwm_config c = {0, 1 << 4, 0xffff}; return c; }
+static inline void pwm_config_set_clkdiv(pwm_config *c, float div) { c->div = (uint32_t) (div * 16); }
+static inline void pwm_config_set_wrap(pwm_config *c, uint16_t wrap) { c->top = wrap; }
+static inline uint pwm_gpio_to_slice_num(uint gpio) { return (gpio >> 1) & 7; }
+static inline uint pwm_gpio_to_channel(uint gpio) { return gpio & 1; }
+static inline void pwm_init(uint slice, pwm_config *c, bool start) { (void) slice; (void) c; (void) start; }
+static inline void pwm_set_wrap(uint slice, uint16_t wrap) { (void) slice; (void) wrap; }
+static inline void pwm_set_chan_level(uint slice, uint chan, uint16_t level) { (void) slice; (void) chan; (void) level; }
+static inline void pwm_set_counter(uint slice, uint16_t c) { (void) slice; (void) c; }
+static inline void pwm_set_enabled(uint slice, bool enabled) { (void) slice; (void) enabled; }
+static inline void pwm_clear_irq(uint slice) { (void) slice; }
+static inline void pwm_set_irq_enabled(uint slice, bool enabled) { (void) slice; (void) enabled; }
+static inline uint32_t pwm_get_irq_status_mask(void) { return 0; }
+static inline uint16_t pwm_get_counter(uint slice) { (void) slice; return 0; }
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef __EMU_STRUCTS_ADC__
+#define __EMU_STRUCTS_ADC__
+
+#include "hardware/address_mapped.h"
+
+// Registers of the ADC, the FIFO is the read address of the DMA
+typedef struct {
+  io_ro_32 fifo = EMU_ADC_FIFO;
+} adc_hw_t;
+
+extern adc_hw_t *adc_hw;
+
+#endif
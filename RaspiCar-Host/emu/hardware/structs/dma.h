@@ -0,0 +1,15 @@
+#ifndef __EMU_STRUCTS_DMA__
+#define __EMU_STRUCTS_DMA__
+
+#include "hardware/address_mapped.h"
+
+// Registers of a DMA channel. The addresses are host pointers, they are
+// kept by dma_channel_configure() and have no register.
+typedef struct {
+  io_ro_32 transfer_count = EMU_DMA_TRANS_COUNT;
+  io_ro_32 ctrl_trig = EMU_DMA_CTRL_TRIG;
+} dma_channel_hw_t;
+
+#define DMA_CH0_CTRL_TRIG_BUSY_BITS   0x01000000
+
+#endif
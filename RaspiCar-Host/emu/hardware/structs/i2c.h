@@ -0,0 +1,35 @@
+#ifndef __EMU_STRUCTS_I2C__
+#define __EMU_STRUCTS_I2C__
+
+#include "hardware/address_mapped.h"
+
+// Registers of the DW_apb_i2c used for interrupt driven transfers (master,
+// transmit only). Reading a clr_* register clears the interrupt.
+typedef struct {
+  io_rw_32 con = EMU_I2C_CON;
+  io_rw_32 tar = EMU_I2C_TAR;
+  io_rw_32 data_cmd = EMU_I2C_DATA_CMD;
+  io_ro_32 intr_stat = EMU_I2C_INTR_STAT;
+  io_rw_32 intr_mask = EMU_I2C_INTR_MASK;
+  io_ro_32 raw_intr_stat = EMU_I2C_RAW_INTR_STAT;
+  io_rw_32 tx_tl = EMU_I2C_TX_TL;
+  io_ro_32 clr_intr = EMU_I2C_CLR_INTR;
+  io_ro_32 clr_tx_abrt = EMU_I2C_CLR_TX_ABRT;
+  io_ro_32 clr_stop_det = EMU_I2C_CLR_STOP_DET;
+  io_rw_32 enable = EMU_I2C_ENABLE;
+  io_ro_32 status = EMU_I2C_STATUS;
+  io_ro_32 txflr = EMU_I2C_TXFLR;
+} i2c_hw_t;
+
+#define I2C_IC_DATA_CMD_STOP_BITS               0x200
+#define I2C_IC_INTR_MASK_M_STOP_DET_BITS        0x200
+#define I2C_IC_INTR_MASK_M_TX_ABRT_BITS         0x040
+#define I2C_IC_INTR_MASK_M_TX_EMPTY_BITS        0x010
+#define I2C_IC_RAW_INTR_STAT_STOP_DET_BITS      0x200
+#define I2C_IC_RAW_INTR_STAT_TX_ABRT_BITS       0x040
+#define I2C_IC_RAW_INTR_STAT_TX_EMPTY_BITS      0x010
+#define I2C_IC_STATUS_TFE_BITS                  0x004
+#define I2C_IC_STATUS_TFNF_BITS                 0x002
+#define I2C_IC_STATUS_ACTIVITY_BITS             0x001
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef __EMU_STRUCTS_SIO__
+#define __EMU_STRUCTS_SIO__
+
+#include "hardware/address_mapped.h"
+
+typedef struct {
+  io_ro_32 cpuid = EMU_SIO_CPUID;
+  io_ro_32 gpio_in = EMU_SIO_GPIO_IN;
+  io_ro_32 gpio_hi_in = EMU_SIO_GPIO_HI_IN;
+  io_rw_32 gpio_out = EMU_SIO_GPIO_OUT;
+  io_wo_32 gpio_set = EMU_SIO_GPIO_SET;
+  io_wo_32 gpio_clr = EMU_SIO_GPIO_CLR;
+  io_wo_32 gpio_togl = EMU_SIO_GPIO_TOGL;
+  io_rw_32 gpio_oe = EMU_SIO_GPIO_OE;
+  io_wo_32 gpio_oe_set = EMU_SIO_GPIO_OE_SET;
+  io_wo_32 gpio_oe_clr = EMU_SIO_GPIO_OE_CLR;
+  io_wo_32 gpio_oe_togl = EMU_SIO_GPIO_OE_TOGL;
+} sio_hw_t;
+
+extern sio_hw_t *sio_hw;
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef __EMU_STRUCTS_SYSTICK__
+#define __EMU_STRUCTS_SYSTICK__
+
+#include "hardware/address_mapped.h"
+
+// The emulated SysTick counts the host clock, scaled to the processor clock
+typedef struct {
+  io_rw_32 csr = EMU_SYSTICK_CSR;
+  io_rw_32 rvr = EMU_SYSTICK_RVR;
+  io_rw_32 cvr = EMU_SYSTICK_CVR;
+  io_ro_32 calib = EMU_SYSTICK_CALIB;
+} systick_hw_t;
+
+extern systick_hw_t *systick_hw;
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef __EMU_STRUCTS_TIMER__
+#define __EMU_STRUCTS_TIMER__
+
+#include "hardware/address_mapped.h"
+
+typedef struct {
+  io_wo_32 timehw = EMU_TIMER_TIMEHW;
+  io_wo_32 timelw = EMU_TIMER_TIMELW;
+  io_ro_32 timehr = EMU_TIMER_TIMEHR;
+  io_ro_32 timelr = EMU_TIMER_TIMELR;
+  io_rw_32 alarm[4] = {EMU_TIMER_ALARM0, EMU_TIMER_ALARM1, EMU_TIMER_ALARM2, EMU_TIMER_ALARM3};
+  io_rw_32 armed = EMU_TIMER_ARMED;
+  io_ro_32 timerawh = EMU_TIMER_TIMERAWH;
+  io_ro_32 timerawl = EMU_TIMER_TIMERAWL;
+  io_rw_32 dbgpause = EMU_TIMER_DBGPAUSE;
+  io_rw_32 pause = EMU_TIMER_PAUSE;
+  io_rw_32 intr = EMU_TIMER_INTR;
+  io_rw_32 inte = EMU_TIMER_INTE;
+  io_rw_32 intf = EMU_TIMER_INTF;
+  io_ro_32 ints = EMU_TIMER_INTS;
+} timer_hw_t;
+
+extern timer_hw_t *timer_hw;
+
+#endif
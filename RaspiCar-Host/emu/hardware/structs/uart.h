@@ -0,0 +1,48 @@
+#ifndef __EMU_STRUCTS_UART__
+#define __EMU_STRUCTS_UART__
+
+#include "hardware/address_mapped.h"
+
+typedef struct {
+  io_rw_32 dr = EMU_UART_DR;
+  io_rw_32 rsr = EMU_UART_RSR;
+  io_ro_32 fr = EMU_UART_FR;
+  io_rw_32 ilpr = EMU_UART_ILPR;
+  io_rw_32 ibrd = EMU_UART_IBRD;
+  io_rw_32 fbrd = EMU_UART_FBRD;
+  io_rw_32 lcr_h = EMU_UART_LCR_H;
+  io_rw_32 cr = EMU_UART_CR;
+  io_rw_32 ifls = EMU_UART_IFLS;
+  io_rw_32 imsc = EMU_UART_IMSC;
+  io_ro_32 ris = EMU_UART_RIS;
+  io_ro_32 mis = EMU_UART_MIS;
+  io_wo_32 icr = EMU_UART_ICR;
+  io_rw_32 dmacr = EMU_UART_DMACR;
+} uart_hw_t;
+
+// PL011 register bits
+#define UART_UARTDR_OE_BITS       0x800
+#define UART_UARTDR_BE_BITS       0x400
+#define UART_UARTDR_PE_BITS       0x200
+#define UART_UARTDR_FE_BITS       0x100
+#define UART_UARTDR_DATA_BITS     0x0ff
+#define UART_UARTFR_TXFE_BITS     0x080
+#define UART_UARTFR_RXFF_BITS     0x040
+#define UART_UARTFR_TXFF_BITS     0x020
+#define UART_UARTFR_RXFE_BITS     0x010
+#define UART_UARTFR_BUSY_BITS     0x008
+#define UART_UARTIMSC_OEIM_BITS   0x400
+#define UART_UARTIMSC_BEIM_BITS   0x200
+#define UART_UARTIMSC_PEIM_BITS   0x100
+#define UART_UARTIMSC_FEIM_BITS   0x080
+#define UART_UARTIMSC_RTIM_BITS   0x040
+#define UART_UARTIMSC_TXIM_BITS   0x020
+#define UART_UARTIMSC_RXIM_BITS   0x010
+#define UART_UARTRIS_RTRIS_BITS   0x040
+#define UART_UARTRIS_TXRIS_BITS   0x020
+#define UART_UARTRIS_RXRIS_BITS   0x010
+#define UART_UARTMIS_RTMIS_BITS   0x040
+#define UART_UARTMIS_TXMIS_BITS   0x020
+#define UART_UARTMIS_RXMIS_BITS   0x010
+
+#endif
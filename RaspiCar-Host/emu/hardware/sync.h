@@ -0,0 +1,18 @@
+#ifndef __EMU_HARDWARE_SYNC__
+#define __EMU_HARDWARE_SYNC__
+
+#include "pico/types.h"
+#include "hardware/address_mapped.h"
+
+// Interrupt mask of the calling core, pending interrupts run on restore
+uint32_t save_and_disable_interrupts(void);
+void restore_interrupts(uint32_t status);
+
+static inline void __dmb(void) { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+static inline void __dsb(void) { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+static inline void __isb(void) { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+void __sev(void);
+void __wfe(void);
+void __wfi(void);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef __EMU_HARDWARE_TIMER__
+#define __EMU_HARDWARE_TIMER__
+
+#include "pico/types.h"
+#include "pico/time.h"
+#include "hardware/structs/timer.h"
+
+// Alarm 3 is used by the repeating timers (as the default alarm pool)
+int hardware_alarm_claim_unused(bool required);
+void hardware_alarm_claim(uint alarm_num);
+void hardware_alarm_unclaim(uint alarm_num);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef __EMU_HARDWARE_UART__
+#define __EMU_HARDWARE_UART__
+
+#include "pico/types.h"
+#include "hardware/structs/uart.h"
+
+// UART1 is emulated with FIFOs, interrupts and timing at the baud rate,
+// its line is the pseudo terminal of the emulator. UART0 is not connected.
+typedef struct uart_inst uart_inst_t;
+extern uart_inst_t *uart0, *uart1;
+
+uint uart_init(uart_inst_t *uart, uint baudrate);
+void uart_deinit(uart_inst_t *uart);
+uint uart_set_baudrate(uart_inst_t *uart, uint baudrate);
+void uart_set_format(uart_inst_t *uart, uint data_bits, uint stop_bits, int parity);
+void uart_set_fifo_enabled(uart_inst_t *uart, bool enabled);
+void uart_set_irq_enables(uart_inst_t *uart, bool rx_has_data, bool tx_needs_data);
+uart_hw_t *uart_get_hw(uart_inst_t *uart);
+bool uart_is_readable(uart_inst_t *uart);
+bool uart_is_writable(uart_inst_t *uart);
+char uart_getc(uart_inst_t *uart);
+void uart_putc_raw(uart_inst_t *uart, char c);
+void uart_putc(uart_inst_t *uart, char c);
+void uart_puts(uart_inst_t *uart, const char *s);
+void uart_write_blocking(uart_inst_t *uart, const uint8_t *src, size_t len);
+void uart_read_blocking(uart_inst_t *uart, uint8_t *dst, size_t len);
+void uart_tx_wait_blocking(uart_inst_t *uart);
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef __EMU_PICO_PLATFORM__
+#define __EMU_PICO_PLATFORM__
+
+#include <stdint.h>
+
+// No flash on the host, code placement attributes are dropped
+#define __not_in_flash(group)
+#define __not_in_flash_func(func_name) func_name
+#define __time_critical_func(func_name) func_name
+#define __no_inline_not_in_flash_func(func_name) __attribute__((noinline)) func_name
+#define __scratch_x(group)
+#define __scratch_y(group)
+
+uint32_t get_core_num(void);
+
+#endif
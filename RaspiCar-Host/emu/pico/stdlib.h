@@ -0,0 +1,13 @@
+#ifndef __EMU_PICO_STDLIB__
+#define __EMU_PICO_STDLIB__
+
+#include "pico/types.h"
+#include "pico/time.h"
+#include "hardware/sync.h"
+#include "hardware/gpio.h"
+#include "hardware/uart.h"
+
+// A busy wait loop of the firmware, the virtual clock moves on
+void tight_loop_contents(void);
+
+#endif
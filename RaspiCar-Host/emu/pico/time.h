@@ -0,0 +1,28 @@
+#ifndef __EMU_PICO_TIME__
+#define __EMU_PICO_TIME__
+
+#include "pico/types.h"
+
+typedef struct repeating_timer repeating_timer_t;
+typedef bool (*repeating_timer_callback_t)(repeating_timer_t *rt);
+
+struct repeating_timer {
+  int64_t delay_us;           // < 0 -> start to start, > 0 -> end to start
+  int32_t alarm_id;
+  repeating_timer_callback_t callback;
+  void *user_data;
+  uint64_t emu_next;          // emulator: next call on the virtual clock
+  int emu_core;               // emulator: core that added the timer
+};
+
+bool add_repeating_timer_us(int64_t delay_us, repeating_timer_callback_t callback, void *user_data, repeating_timer_t *out);
+bool add_repeating_timer_ms(int32_t delay_ms, repeating_timer_callback_t callback, void *user_data, repeating_timer_t *out);
+bool cancel_repeating_timer(repeating_timer_t *timer);
+uint64_t time_us_64(void);
+uint32_t time_us_32(void);
+absolute_time_t get_absolute_time(void);
+void sleep_us(uint64_t us);
+void sleep_ms(uint32_t ms);
+void busy_wait_us_32(uint32_t us);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef __EMU_PICO_TYPES__
+#define __EMU_PICO_TYPES__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include "pico/platform.h"
+
+typedef uint64_t absolute_time_t;
+
+#endif
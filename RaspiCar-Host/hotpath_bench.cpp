@@ -0,0 +1,97 @@
+/*
+ * Host harness of the firmware hot path benchmark (bench.cpp)
+ * Builds the firmware with the mock HAL of the emulator (without its main
+ * and without running setup()), runs each case of the firmware benchmark
+ * in timed batches and reports ns/op. The Cortex-M0+ cycles are estimated
+ * by the ratio of the reference case crc16_ccitt_64, whose cycles on the
+ * rp2040 are given by --ref-cycles (from "GH0" on the board) or counted
+ * from the Thumb code.
+ *
+ * Build and run: make hotpath
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "emu.h"
+#include "bench.h"
+
+#define HOTPATH_BATCH_NS     2000000  // min time of a timed batch
+#define HOTPATH_BATCHES           21  // the median batch counts
+#define HOTPATH_REF_CYCLES      4700  // crc16_ccitt_64 on the rp2040: about 72 cycles per byte
+#define HOTPATH_M0_HZ      125000000
+
+extern Bench bench;
+
+static double now_ns(void) {
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//-------------------------------------------------------------------------
+// Median ns per op of timed batches, min is set to the fastest batch
+static double time_case(uint8_t nr, double *min) {
+  std::vector<double> t;
+  uint32_t ops = 1;
+  double start;
+
+  // batch size: at least HOTPATH_BATCH_NS
+  for (;;) {
+    start = now_ns();
+    bench.run(nr, ops);
+    if ((now_ns() - start >= HOTPATH_BATCH_NS) || (ops >= (1u << 30))) break;
+    ops *= 2;
+  }
+  for (int i = 0; i < HOTPATH_BATCHES; i++) {
+    start = now_ns();
+    bench.run(nr, ops);
+    t.push_back((now_ns() - start) / ops);
+  }
+  std::sort(t.begin(), t.end());
+  *min = t.front();
+  return t[t.size() / 2];
+}
+
+//-------------------------------------------------------------------------
+int main(int argc, char *argv[]) {
+  double ns[BENCH_CASES], ns_min[BENCH_CASES], ratio, ref_cycles = HOTPATH_REF_CYCLES;
+  const char *json = nullptr;
+  FILE *f;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--ref-cycles") && (i + 1 < argc)) ref_cycles = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--json") && (i + 1 < argc)) json = argv[++i];
+    else {
+      fprintf(stderr, "usage: %s [--ref-cycles <n>] [--json <file>]\n", argv[0]);
+      return 2;
+    }
+  }
+  emu_cfg.speed = 0;                      // the stubs do not wait for the wall clock
+  emu_cfg.eeprom = "/dev/null";
+  bench.init();
+
+  for (uint8_t n = 0; n < BENCH_CASES; n++) ns[n] = time_case(n, &ns_min[n]);
+  ratio = ref_cycles / ns[0];             // M0+ cycles per host ns
+
+  printf("%-20s %10s %10s %14s %12s\n", "case", "ns/op", "min ns/op", "est. M0+ cyc", "est. M0+ us");
+  for (uint8_t n = 0; n < BENCH_CASES; n++) {
+    printf("%-20s %10.1f %10.1f %14.0f %12.2f\n", bench.get_name(n), ns[n], ns_min[n], ns[n] * ratio,
+           ns[n] * ratio * 1e6 / HOTPATH_M0_HZ);
+  }
+  printf("reference %s = %.0f cycles on the rp2040 (--ref-cycles)\n", bench.get_name(0), ref_cycles);
+
+  if (json && (f = fopen(json, "w"))) {
+    fprintf(f, "{\n  \"ref_cycles\": %.0f,\n  \"cases\": {", ref_cycles);
+    for (uint8_t n = 0; n < BENCH_CASES; n++) {
+      fprintf(f, "%s\n    \"%s\": {\"ns_per_op\": %.2f, \"min_ns_per_op\": %.2f, \"est_m0_cycles\": %.0f}",
+              n ? "," : "", bench.get_name(n), ns[n], ns_min[n], ns[n] * ratio);
+    }
+    fprintf(f, "\n  }\n}\n");
+    fclose(f);
+  }
+  fflush(stdout);
+  _exit(0);                               // no destructors of the firmware globals
+}
@@ -0,0 +1,126 @@
+"""
+Checks that the step interrupt of the motor driver runs from RAM only: all
+functions reachable from step_alarm_irq / pwm_wrap_irq (direct calls and
+branches, long call veneers) must lie outside of the flash (XIP). Functions
+in flash stall or fault the interrupt during a configuration save
+(flash_range_erase / flash_range_program), e.g. __aeabi_lmul of libgcc for
+a 64 bit multiplication.
+
+    arduino-cli compile --fqbn rp2040:rp2040:rpipico --output-dir build ../RaspiCar-rp2040-motor_driver
+    python3 isr_flash_check.py build/RaspiCar-rp2040-motor_driver.ino.elf
+
+Uses arm-none-eabi-objdump (--objdump for another one). Indirect calls
+(blx <reg>) cannot be followed, they are listed. Exit status 1 if a
+function in flash is reachable.
+"""
+
+import argparse
+import re
+import subprocess
+import sys
+
+ROOTS = ("step_alarm_irq", "pwm_wrap_irq")
+FLASH_START = 0x10000000            # XIP and its aliases
+FLASH_END = 0x16000000
+
+FUNC_RE = re.compile(r"^([0-9a-f]+) <(.+)>:$")
+INSN_RE = re.compile(r"^\s*([0-9a-f]+):\s+(?:[0-9a-f]{4}(?: [0-9a-f]{4})?\s+)?(\S+)\s*(.*)$")
+TARGET_RE = re.compile(r"^([0-9a-f]+) <([^>+]+)(?:\+0x[0-9a-f]+)?>")
+BRANCHES = ("b", "bl", "blx", "bx")
+CONDITIONS = ("eq", "ne", "cs", "cc", "hs", "lo", "mi", "pl", "vs", "vc",
+              "hi", "ls", "ge", "lt", "gt", "le", "al")
+
+
+def is_branch(mnemonic):
+    m = mnemonic.split(".")[0]
+    if m in BRANCHES:
+        return True
+    return m.startswith("b") and m[1:] in CONDITIONS
+
+
+def disassemble(objdump, elf):
+    """ Returns the addresses and the call targets of all functions """
+    out = subprocess.run([objdump, "-d", elf], check=True, capture_output=True, text=True).stdout
+    addr, calls, indirect = {}, {}, {}
+    func = None
+    for line in out.splitlines():
+        m = FUNC_RE.match(line)
+        if m:
+            func = m.group(2)
+            addr[func] = int(m.group(1), 16)
+            calls.setdefault(func, set())
+            continue
+        m = INSN_RE.match(line)
+        if not m or func is None or not is_branch(m.group(2)):
+            continue
+        t = TARGET_RE.match(m.group(3))
+        if t:
+            if t.group(2) != func:
+                calls[func].add(t.group(2))
+        elif m.group(2).startswith("blx"):
+            indirect.setdefault(func, []).append(m.group(1))
+    return addr, calls, indirect
+
+
+def veneer_target(name):
+    """ ____aeabi_lmul_veneer -> __aeabi_lmul, the veneer itself may be in RAM """
+    if name.startswith("__") and name.endswith("_veneer"):
+        return name[2:-len("_veneer")]
+    return None
+
+
+def demangle(names):
+    try:
+        out = subprocess.run(["c++filt"], input="\n".join(names), check=True,
+                             capture_output=True, text=True).stdout
+        return out.splitlines()
+    except (OSError, subprocess.CalledProcessError):
+        return list(names)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Checks that the step interrupt runs from RAM only")
+    parser.add_argument("elf", help="firmware ELF file")
+    parser.add_argument("--objdump", default="arm-none-eabi-objdump", help="objdump of the ARM toolchain")
+    args = parser.parse_args()
+
+    addr, calls, indirect = disassemble(args.objdump, args.elf)
+    roots = [f for f in addr if any(r in f for r in ROOTS)]
+    if not roots:
+        print("No step interrupt (" + ", ".join(ROOTS) + ") in " + args.elf)
+        return 2
+
+    # breadth first from the interrupt handlers, keeps the caller for the path
+    caller = {f: None for f in roots}
+    todo = list(roots)
+    while todo:
+        f = todo.pop(0)
+        targets = set(calls.get(f, ()))
+        v = veneer_target(f)
+        if v is not None:
+            targets.add(v)
+        for t in targets:
+            if t in addr and t not in caller:
+                caller[t] = f
+                todo.append(t)
+
+    in_flash = sorted(f for f in caller if FLASH_START <= addr[f] < FLASH_END)
+    names = sorted(caller, key=lambda f: addr[f])
+    for f, d in zip(names, demangle(names)):
+        print("%08x %s %s" % (addr[f], "FLASH" if f in in_flash else "ram  ", d))
+    for f in names:
+        for a in indirect.get(f, ()):
+            print("indirect call at %s in %s, not followed" % (a, demangle([f])[0]))
+
+    for f in in_flash:
+        path = []
+        while f is not None:
+            path.append(f)
+            f = caller[f]
+        print("in flash: " + " <- ".join(demangle(path)))
+    print("%d functions reachable, %d in flash" % (len(caller), len(in_flash)))
+    return 1 if in_flash else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
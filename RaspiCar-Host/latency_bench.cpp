@@ -0,0 +1,304 @@
+/*
+ * Round trip latency of the command protocol
+ * Sends a mix of commands at a fixed rate (open loop) or as fast as the
+ * in-flight limit allows (closed loop), measures the time from the request
+ * to the tagged reply and reports percentiles per command, throughput and
+ * drop rate (timeouts, lost connection). The device is the motor driver
+ * (e.g. /dev/serial0) or a pseudo terminal; --emu starts raspicar_emu as
+ * local stand-in.
+ *
+ * Example: latency_bench --emu --rate 200 --inflight 4 --mix "BS:2;GP:1;MR60,60:1" --json out.json
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include "raspicar_client.h"
+
+#define BENCH_DURATION_S     10
+#define BENCH_WARMUP_S        1
+#define BENCH_TIMEOUT_MS    500
+#define BENCH_MIX           "BS:1;GP:1;GC:1;MR0,0:1"
+#define BENCH_EMU           "./raspicar_emu"
+
+struct MixEntry {
+  std::string cmd;
+  uint32_t weight;
+  uint32_t sent, ok, errors, timeouts;
+  std::vector<double> latency;      // us
+};
+
+struct Options {
+  const char *device = nullptr;
+  const char *emu = nullptr;
+  uint32_t baud = CLIENT_BAUD_DEFAULT;
+  double rate = 0;                  // commands per s, 0 -> closed loop
+  uint32_t inflight = 1;
+  double duration = BENCH_DURATION_S;
+  double warmup = BENCH_WARMUP_S;
+  uint32_t timeout = BENCH_TIMEOUT_MS;
+  const char *mix = BENCH_MIX;
+  const char *json = nullptr;
+  const char *csv = nullptr;
+};
+
+static double now_s(void) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//-------------------------------------------------------------------------
+static void usage(const char *name) {
+  fprintf(stderr,
+          "usage: %s (--device <path> | --emu [path]) [options]\n"
+          "  --baud <rate>       switches the link with CB (default 115200)\n"
+          "  --rate <n>          commands per s, 0 -> closed loop (default 0)\n"
+          "  --inflight <n>      commands in flight at most (default 1)\n"
+          "  --duration <s>      measuring time (default %d)\n"
+          "  --warmup <s>        not measured (default %d)\n"
+          "  --timeout <ms>      reply timeout, counts as drop (default %d)\n"
+          "  --mix <cmd:w;...>   commands and weights (default \"%s\")\n"
+          "  --json <file>       results\n"
+          "  --csv <file>        every sample: time, command, latency in us, result\n",
+          name, BENCH_DURATION_S, BENCH_WARMUP_S, BENCH_TIMEOUT_MS, BENCH_MIX);
+  exit(2);
+}
+
+//-------------------------------------------------------------------------
+// "BS:2;MR60,60:1" -> commands with weights, the weight is optional
+static bool parse_mix(const char *s, std::vector<MixEntry> *mix) {
+  std::string str(s), item;
+  size_t start = 0, end, colon;
+  MixEntry e = {};
+
+  while (start <= str.size()) {
+    end = str.find(';', start);
+    if (end == std::string::npos) end = str.size();
+    item = str.substr(start, end - start);
+    start = end + 1;
+    if (item.empty()) continue;
+    colon = item.rfind(':');
+    e.cmd = item.substr(0, colon);
+    e.weight = (colon == std::string::npos) ? 1 : atoi(item.c_str() + colon + 1);
+    if (e.cmd.empty() || (e.weight == 0)) return false;
+    mix->push_back(e);
+  }
+  return !mix->empty();
+}
+
+//-------------------------------------------------------------------------
+// Starts the emulator, its first output line is the pty
+static pid_t start_emu(const char *path, std::string *pty) {
+  int fds[2];
+  char buf[128];
+  FILE *f;
+  pid_t pid;
+
+  if (pipe(fds) < 0) return -1;
+  pid = fork();
+  if (pid == 0) {
+    dup2(fds[1], STDOUT_FILENO);
+    close(fds[0]);
+    close(fds[1]);
+    execl(path, path, "--eeprom", "/dev/null", "--flash", "/dev/null", (char *) nullptr);
+    _exit(127);
+  }
+  close(fds[1]);
+  f = fdopen(fds[0], "r");
+  if ((pid < 0) || !f || !fgets(buf, sizeof(buf), f)) {
+    if (f) fclose(f);
+    return -1;
+  }
+  fclose(f);
+  buf[strcspn(buf, "\r\n")] = '\0';
+  *pty = buf;
+  return pid;
+}
+
+//-------------------------------------------------------------------------
+static double percentile(const std::vector<double> &v, double p) {
+  if (v.empty()) return 0;
+  return v[std::min(v.size() - 1, (size_t) (p / 100 * v.size()))];
+}
+
+//-------------------------------------------------------------------------
+static void print_json_stats(FILE *f, const std::vector<double> &v) {
+  double sum = 0;
+
+  for (double x : v) sum += x;
+  fprintf(f, "{\"samples\": %zu, \"mean\": %.1f, \"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f}",
+          v.size(), v.empty() ? 0 : sum / v.size(), percentile(v, 50), percentile(v, 90),
+          percentile(v, 99), percentile(v, 99.9), v.empty() ? 0 : v.back());
+}
+
+//-------------------------------------------------------------------------
+int main(int argc, char *argv[]) {
+  Options opt;
+  std::vector<MixEntry> mix;
+  std::vector<double> all;
+  std::string pty;
+  RaspiCarClient client;
+  std::mt19937 rng(1);
+  FILE *csv = nullptr, *json;
+  pid_t emu_pid = -1;
+  uint32_t total_weight = 0, inflight = 0, skipped = 0, lost = 0;
+  uint32_t sent = 0, ok = 0, errors = 0, timeouts = 0;
+  double t_start, t_end, t_next, now;
+  bool baud_ok = true;
+
+  for (int i = 1; i < argc; i++) {
+    const char *o = argv[i];
+    const char *arg = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+    if (!strcmp(o, "--emu")) {
+      opt.emu = (arg && (arg[0] != '-')) ? argv[++i] : BENCH_EMU;
+      continue;
+    }
+    if (!arg) usage(argv[0]);
+    if (!strcmp(o, "--device")) opt.device = arg;
+    else if (!strcmp(o, "--baud")) opt.baud = atoi(arg);
+    else if (!strcmp(o, "--rate")) opt.rate = atof(arg);
+    else if (!strcmp(o, "--inflight")) opt.inflight = atoi(arg);
+    else if (!strcmp(o, "--duration")) opt.duration = atof(arg);
+    else if (!strcmp(o, "--warmup")) opt.warmup = atof(arg);
+    else if (!strcmp(o, "--timeout")) opt.timeout = atoi(arg);
+    else if (!strcmp(o, "--mix")) opt.mix = arg;
+    else if (!strcmp(o, "--json")) opt.json = arg;
+    else if (!strcmp(o, "--csv")) opt.csv = arg;
+    else usage(argv[0]);
+    i += 1;
+  }
+  if ((!opt.device == !opt.emu) || (opt.inflight == 0) || (opt.rate < 0) || !parse_mix(opt.mix, &mix)) {
+    usage(argv[0]);
+  }
+  for (auto &e : mix) total_weight += e.weight;
+
+  if (opt.emu) {
+    emu_pid = start_emu(opt.emu, &pty);
+    if (emu_pid < 0) {
+      fprintf(stderr, "cannot start %s\n", opt.emu);
+      return 1;
+    }
+    opt.device = pty.c_str();
+    usleep(200000);                       // firmware setup
+  }
+  if (!client.open(opt.device)) {
+    fprintf(stderr, "cannot open %s\n", opt.device);
+    if (emu_pid > 0) kill(emu_pid, SIGTERM);
+    return 1;
+  }
+  client.set_timeout(opt.timeout);
+  if (opt.baud != CLIENT_BAUD_DEFAULT) {
+    client.set_baud(opt.baud, false, [&](const Reply &r) { baud_ok = r.ok; });
+    client.wait_idle(2000);
+    if (!baud_ok) fprintf(stderr, "baud rate %u not set, staying at %u\n", opt.baud, client.get_baud());
+  }
+  if (opt.csv) {
+    csv = fopen(opt.csv, "w");
+    if (csv) fprintf(csv, "time_s,command,latency_us,result\n");
+  }
+
+  // warmup, then measuring; open loop: one command every 1/rate s, a
+  // command due while the in-flight limit is reached is skipped
+  t_start = now_s() + opt.warmup;
+  t_end = t_start + opt.duration;
+  t_next = now_s();
+  while ((now = now_s()) < t_end) {
+    if ((opt.rate == 0) ? (inflight < opt.inflight) : (now >= t_next)) {
+      if (opt.rate > 0) t_next += 1.0 / opt.rate;
+      if (inflight >= opt.inflight) {
+        if (now >= t_start) skipped += 1;
+        continue;
+      }
+      uint32_t pick = rng() % total_weight;
+      size_t k = 0;
+      while (pick >= mix[k].weight) pick -= mix[k++].weight;
+      bool measured = now >= t_start;
+      double t0 = now_s();
+
+      inflight += 1;
+      if (measured) mix[k].sent += 1;
+      client.request(mix[k].cmd, [&, k, measured, t0](const Reply &r) {
+        double t = now_s();
+        double us = (t - t0) * 1e6;
+
+        inflight -= 1;
+        if (!measured) return;
+        if (r.ok) {
+          mix[k].ok += 1;
+          mix[k].latency.push_back(us);
+        } else if (r.timeout) {
+          mix[k].timeouts += 1;
+        } else if (r.text == "not connected") {
+          lost += 1;
+        } else {
+          mix[k].errors += 1;
+          mix[k].latency.push_back(us);
+        }
+        if (csv) fprintf(csv, "%.6f,%s,%.1f,%s\n", t0 - t_start, mix[k].cmd.c_str(), us,
+                         r.ok ? "ok" : (r.timeout ? "timeout" : "error"));
+      });
+      continue;
+    }
+    double wait = (opt.rate > 0) ? (t_next - now) : (t_end - now);
+    client.poll(std::max(0, std::min((int) (wait * 1000), 100)));
+  }
+  client.wait_idle(opt.timeout + 100);
+
+  for (auto &e : mix) {
+    std::sort(e.latency.begin(), e.latency.end());
+    all.insert(all.end(), e.latency.begin(), e.latency.end());
+    sent += e.sent;
+    ok += e.ok;
+    errors += e.errors;
+    timeouts += e.timeouts;
+  }
+  std::sort(all.begin(), all.end());
+
+  printf("%s, %u baud, %s, %u in flight, %.1f s\n", opt.emu ? "emulator" : opt.device, client.get_baud(),
+         (opt.rate > 0) ? (std::to_string((int) opt.rate) + " cmd/s").c_str() : "closed loop",
+         opt.inflight, opt.duration);
+  printf("%-12s %8s %8s %8s %10s %10s %10s %10s\n", "command", "sent", "errors", "drops", "p50 us", "p90 us", "p99 us", "max us");
+  for (auto &e : mix) {
+    printf("%-12s %8u %8u %8u %10.0f %10.0f %10.0f %10.0f\n", e.cmd.c_str(), e.sent, e.errors, e.timeouts,
+           percentile(e.latency, 50), percentile(e.latency, 90), percentile(e.latency, 99),
+           e.latency.empty() ? 0 : e.latency.back());
+  }
+  printf("throughput %.1f replies/s, drop rate %.4f, skipped %u, lost %u\n", (ok + errors) / opt.duration,
+         sent ? (double) (timeouts + lost) / sent : 0, skipped, lost);
+
+  if (opt.json && (json = fopen(opt.json, "w"))) {
+    fprintf(json, "{\n  \"device\": \"%s\",\n  \"emulator\": %s,\n  \"baud\": %u,\n", opt.device,
+            opt.emu ? "true" : "false", client.get_baud());
+    fprintf(json, "  \"rate\": %.1f,\n  \"inflight\": %u,\n  \"duration_s\": %.3f,\n", opt.rate, opt.inflight, opt.duration);
+    fprintf(json, "  \"sent\": %u,\n  \"ok\": %u,\n  \"errors\": %u,\n  \"timeouts\": %u,\n  \"lost\": %u,\n  \"skipped\": %u,\n",
+            sent, ok, errors, timeouts, lost, skipped);
+    fprintf(json, "  \"throughput\": %.2f,\n  \"drop_rate\": %.6f,\n  \"latency_us\": ", (ok + errors) / opt.duration,
+            sent ? (double) (timeouts + lost) / sent : 0);
+    print_json_stats(json, all);
+    fprintf(json, ",\n  \"commands\": {");
+    for (size_t k = 0; k < mix.size(); k++) {
+      fprintf(json, "%s\n    \"%s\": {\"weight\": %u, \"sent\": %u, \"ok\": %u, \"errors\": %u, \"timeouts\": %u, \"latency_us\": ",
+              k ? "," : "", mix[k].cmd.c_str(), mix[k].weight, mix[k].sent, mix[k].ok, mix[k].errors, mix[k].timeouts);
+      print_json_stats(json, mix[k].latency);
+      fprintf(json, "}");
+    }
+    fprintf(json, "\n  }\n}\n");
+    fclose(json);
+  }
+  if (csv) fclose(csv);
+
+  client.close();
+  if (emu_pid > 0) {
+    kill(emu_pid, SIGTERM);
+    waitpid(emu_pid, nullptr, 0);
+  }
+  return 0;
+}
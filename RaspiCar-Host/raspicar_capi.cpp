@@ -0,0 +1,170 @@
+/*
+ * C interface of the RaspiCarClient for the Python binding (ctypes)
+ * Replies are kept by sequence number until rc_result() picks them up, the
+ * last telemetry and pose stream values are kept for polling.
+ */
+
+#include "raspicar_client.h"
+#include <string.h>
+#include <memory>
+#include <chrono>
+
+struct RcHandle {
+  RaspiCarClient client;
+  std::map<uint32_t, Reply> results;
+  Telemetry telemetry = {};
+  uint32_t telemetry_count = 0;
+  Pose pose = {};
+  uint32_t pose_count = 0;
+};
+
+// Flat copy of Telemetry for ctypes
+struct RcTelemetry {
+  uint32_t voltage;
+  char status[4];
+  uint32_t rpm_a, rpm_b;
+  int64_t pos_a, pos_b;
+  int32_t mode;
+  uint32_t loops, loop_max;
+};
+
+//-------------------------------------------------------------------------
+// Sends by the given call, the reply is stored under the sequence number
+// returned by the call (also for set_baud, which answers with a later ping)
+static uint32_t keep_result(RcHandle *h, std::function<uint32_t(ReplyHandler)> send) {
+  std::shared_ptr<uint32_t> seq = std::make_shared<uint32_t>(0);
+
+  *seq = send([h, seq](const Reply &r) {
+    if (*seq) h->results[*seq] = r;
+  });
+  return *seq;
+}
+
+extern "C" {
+
+//-------------------------------------------------------------------------
+void *rc_open(const char *device, uint32_t baud) {
+  RcHandle *h = new RcHandle;
+
+  h->client.on_telemetry([h](const Telemetry &t) {
+    h->telemetry = t;
+    h->telemetry_count += 1;
+  });
+  h->client.on_pose([h](const Pose &p) {
+    h->pose = p;
+    h->pose_count += 1;
+  });
+  h->client.open(device, baud);
+  return h;
+}
+
+//-------------------------------------------------------------------------
+void rc_close(void *handle) {
+  delete (RcHandle *) handle;
+}
+
+//-------------------------------------------------------------------------
+int rc_is_open(void *handle) {
+  return ((RcHandle *) handle)->client.is_open();
+}
+
+//-------------------------------------------------------------------------
+void rc_set_timeout(void *handle, uint32_t ms) {
+  ((RcHandle *) handle)->client.set_timeout(ms);
+}
+
+//-------------------------------------------------------------------------
+int rc_poll(void *handle, int timeout) {
+  return ((RcHandle *) handle)->client.poll(timeout);
+}
+
+//-------------------------------------------------------------------------
+// Sends a command, returns the sequence number for rc_result (0 -> not
+// connected)
+uint32_t rc_request(void *handle, const char *cmd) {
+  RcHandle *h = (RcHandle *) handle;
+
+  return keep_result(h, [h, cmd](ReplyHandler rh) {
+    return h->client.request(cmd, rh);
+  });
+}
+
+//-------------------------------------------------------------------------
+// rc_result
+// Runs the event loop until the reply of seq is there or timeout ms are
+// over. Copies the reply text to buf, returns 1 -> ok, 0 -> error reply,
+// -1 -> no reply yet, -2 -> timeout or connection lost.
+int rc_result(void *handle, uint32_t seq, int timeout, char *buf, int len) {
+  RcHandle *h = (RcHandle *) handle;
+  auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+  Reply r;
+  int left;
+
+  if (seq == 0) return -2;
+  for (;;) {
+    auto it = h->results.find(seq);
+    if (it != h->results.end()) {
+      r = it->second;
+      h->results.erase(it);
+      break;
+    }
+    left = std::chrono::duration_cast<std::chrono::milliseconds>(end - std::chrono::steady_clock::now()).count();
+    if (left <= 0) return -1;
+    h->client.poll(left);
+  }
+  if (len > 0) {
+    strncpy(buf, r.text.c_str(), len - 1);
+    buf[len - 1] = '\0';
+  }
+  if (r.ok) return 1;
+  return (r.timeout || !h->client.is_open()) ? -2 : 0;
+}
+
+//-------------------------------------------------------------------------
+// Telemetry rate, restored by the client after a reconnect
+uint32_t rc_set_telemetry(void *handle, uint32_t hz) {
+  RcHandle *h = (RcHandle *) handle;
+
+  return keep_result(h, [h, hz](ReplyHandler rh) {
+    return h->client.set_telemetry(hz, rh);
+  });
+}
+
+//-------------------------------------------------------------------------
+uint32_t rc_set_baud(void *handle, uint32_t rate, int save) {
+  RcHandle *h = (RcHandle *) handle;
+
+  return keep_result(h, [h, rate, save](ReplyHandler rh) {
+    return h->client.set_baud(rate, save != 0, rh);
+  });
+}
+
+//-------------------------------------------------------------------------
+// Last telemetry line, returns the number of lines received so far
+uint32_t rc_telemetry(void *handle, RcTelemetry *t) {
+  RcHandle *h = (RcHandle *) handle;
+  Telemetry &s = h->telemetry;
+
+  t->voltage = s.voltage;
+  strncpy(t->status, s.status.c_str(), sizeof(t->status) - 1);
+  t->status[sizeof(t->status) - 1] = '\0';
+  t->rpm_a = s.rpm_a;
+  t->rpm_b = s.rpm_b;
+  t->pos_a = s.pos_a;
+  t->pos_b = s.pos_b;
+  t->mode = s.mode;
+  t->loops = s.loops;
+  t->loop_max = s.loop_max;
+  return h->telemetry_count;
+}
+
+//-------------------------------------------------------------------------
+// Last pose of the pose stream (GP<hz>), returns the number of poses so far
+uint32_t rc_pose(void *handle, Pose *p) {
+  RcHandle *h = (RcHandle *) handle;
+
+  *p = h->pose;
+  return h->pose_count;
+}
+
+}
@@ -0,0 +1,593 @@
+#include "raspicar_client.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+//-------------------------------------------------------------------------
+static int64_t now_ms(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+//-------------------------------------------------------------------------
+// Error replies of the motor driver end with '!' or report an unknown
+// command, everything else is a result or "OK"
+static bool reply_ok(const std::string &text) {
+  return (text.find('!') == std::string::npos) && (text.find("ot recognized") == std::string::npos);
+}
+
+//-------------------------------------------------------------------------
+static std::vector<std::string> split(const std::string &s, char sep) {
+  std::vector<std::string> v;
+  size_t start = 0, end;
+
+  while ((end = s.find(sep, start)) != std::string::npos) {
+    v.push_back(s.substr(start, end - start));
+    start = end + 1;
+  }
+  v.push_back(s.substr(start));
+  return v;
+}
+
+//-------------------------------------------------------------------------
+static bool to_int(const std::string &s, int64_t *v) {
+  char *end;
+
+  *v = strtoll(s.c_str(), &end, 10);
+  return (end != s.c_str()) && (*end == '\0');
+}
+
+//-------------------------------------------------------------------------
+// "$T<voltage>,<status>,<rpm a>,<rpm b>,<pos a>,<pos b>,<mode>,<loops>,<loop max>"
+bool parse_telemetry(const std::string &line, Telemetry *t) {
+  std::vector<std::string> f;
+  int64_t v[9];
+
+  if (line.compare(0, 2, "$T") != 0) return false;
+  f = split(line.substr(2), ',');
+  if (f.size() != 9) return false;
+  for (int i = 0; i < 9; i++) {
+    if ((i != 1) && !to_int(f[i], &v[i])) return false;
+  }
+  t->voltage = v[0];
+  t->status = f[1];
+  t->rpm_a = v[2];
+  t->rpm_b = v[3];
+  t->pos_a = v[4];
+  t->pos_b = v[5];
+  t->mode = v[6];
+  t->loops = v[7];
+  t->loop_max = v[8];
+  return true;
+}
+
+//-------------------------------------------------------------------------
+// "<x>,<y>,<heading>,<time>", reply of GP and content of the "$P" lines
+bool parse_pose(const std::string &text, Pose *p) {
+  std::vector<std::string> f = split(text, ',');
+  int64_t v[4];
+
+  if (f.size() != 4) return false;
+  for (int i = 0; i < 4; i++) {
+    if (!to_int(f[i], &v[i])) return false;
+  }
+  p->x = v[0];
+  p->y = v[1];
+  p->heading = v[2];
+  p->time = v[3];
+  return true;
+}
+
+//-------------------------------------------------------------------------
+RaspiCarClient::~RaspiCarClient() {
+  close();
+}
+
+//-------------------------------------------------------------------------
+// Opens the serial port (or a pseudo terminal). If the port is not there,
+// poll() keeps trying.
+bool RaspiCarClient::open(const char *dev, uint32_t rate) {
+  close();
+  device = dev;
+  baud = rate;
+  return connect();
+}
+
+//-------------------------------------------------------------------------
+void RaspiCarClient::close(void) {
+  device.clear();
+  disconnect();
+}
+
+//-------------------------------------------------------------------------
+bool RaspiCarClient::is_open(void) {
+  return fd >= 0;
+}
+
+//-------------------------------------------------------------------------
+int RaspiCarClient::get_fd(void) {
+  return fd;
+}
+
+//-------------------------------------------------------------------------
+uint32_t RaspiCarClient::get_baud(void) {
+  return baud;
+}
+
+//-------------------------------------------------------------------------
+uint32_t RaspiCarClient::get_pending(void) {
+  return pending.size();
+}
+
+//-------------------------------------------------------------------------
+uint32_t RaspiCarClient::get_reconnects(void) {
+  return reconnects;
+}
+
+//-------------------------------------------------------------------------
+void RaspiCarClient::set_timeout(uint32_t ms) {
+  timeout_ms = ms;
+}
+
+//-------------------------------------------------------------------------
+void RaspiCarClient::set_reconnect(uint32_t ms) {
+  reconnect_ms = ms;
+}
+
+//-------------------------------------------------------------------------
+void RaspiCarClient::on_telemetry(TelemetryHandler h) {
+  telemetry_handler = h;
+}
+
+//-------------------------------------------------------------------------
+void RaspiCarClient::on_pose(PoseStreamHandler h) {
+  pose_handler = h;
+}
+
+//-------------------------------------------------------------------------
+bool RaspiCarClient::set_port_baud(uint32_t rate) {
+  struct termios tio;
+  speed_t speed;
+
+  switch (rate) {
+    case 115200:  speed = B115200; break;
+    case 230400:  speed = B230400; break;
+    case 460800:  speed = B460800; break;
+    case 921600:  speed = B921600; break;
+    case 1000000: speed = B1000000; break;
+    default:      return false;
+  }
+  if (tcgetattr(fd, &tio) < 0) return false;
+  cfmakeraw(&tio);
+  tio.c_cflag |= CLOCAL | CREAD;
+  cfsetispeed(&tio, speed);
+  cfsetospeed(&tio, speed);
+  return tcsetattr(fd, TCSANOW, &tio) == 0;
+}
+
+//-------------------------------------------------------------------------
+bool RaspiCarClient::connect(void) {
+  next_connect = now_ms() + reconnect_ms;
+  if (device.empty()) return false;
+  fd = ::open(device.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (fd < 0) return false;
+  if (!set_port_baud(baud)) {
+    ::close(fd);
+    fd = -1;
+    return false;
+  }
+  tcflush(fd, TCIOFLUSH);
+  tx.clear();
+  rx.clear();
+  if (telemetry_hz > 0) request("T" + std::to_string(telemetry_hz));
+  return true;
+}
+
+//-------------------------------------------------------------------------
+// Closes the port and fails all requests in flight
+void RaspiCarClient::disconnect(void) {
+  std::map<uint32_t, Pending> failed;
+  Reply r = {false, false, "disconnected"};
+
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+    if (!device.empty()) reconnects += 1;
+  }
+  next_connect = now_ms() + reconnect_ms;
+  failed.swap(pending);
+  for (auto &p : failed) {
+    if (p.second.handler) p.second.handler(r);
+  }
+}
+
+//-------------------------------------------------------------------------
+void RaspiCarClient::flush_tx(void) {
+  ssize_t n;
+
+  while (!tx.empty() && (fd >= 0)) {
+    n = write(fd, tx.data(), tx.size());
+    if (n > 0) {
+      tx.erase(0, n);
+    } else {
+      if ((n < 0) && (errno != EAGAIN) && (errno != EINTR)) disconnect();
+      return;
+    }
+  }
+}
+
+//-------------------------------------------------------------------------
+void RaspiCarClient::read_rx(void) {
+  char buf[512];
+  ssize_t n;
+  size_t end;
+
+  while (fd >= 0) {
+    n = read(fd, buf, sizeof(buf));
+    if (n <= 0) {
+      if ((n == 0) || ((errno != EAGAIN) && (errno != EINTR))) disconnect();
+      return;
+    }
+    rx.append(buf, n);
+    while ((end = rx.find('\n')) != std::string::npos) {
+      std::string line = rx.substr(0, end);
+      rx.erase(0, end + 1);
+      if (!line.empty() && (line.back() == '\r')) line.pop_back();
+      handle_line(line);
+    }
+    if (rx.size() > CLIENT_LINE_MAX) rx.clear();      // garbage without line end
+  }
+}
+
+//-------------------------------------------------------------------------
+// Tagged reply -> handler of the request, "$T" / "$P" -> stream handlers.
+// Further lines of a multi-line reply and untagged lines are dropped.
+void RaspiCarClient::handle_line(const std::string &line) {
+  Telemetry t;
+  Pose p;
+  size_t sp;
+  int64_t tag;
+
+  if (line.empty()) return;
+  if (line[0] == '#') {
+    sp = line.find(' ');
+    if ((sp == std::string::npos) || !to_int(line.substr(1, sp - 1), &tag)) return;
+    auto it = pending.find(tag);
+    if (it == pending.end()) return;
+    ReplyHandler h = it->second.handler;
+    pending.erase(it);
+    Reply r = {false, false, line.substr(sp + 1)};
+    r.ok = reply_ok(r.text);
+    if (h) h(r);
+  } else if (line.compare(0, 2, "$T") == 0) {
+    if (telemetry_handler && parse_telemetry(line, &t)) telemetry_handler(t);
+  } else if (line.compare(0, 2, "$P") == 0) {
+    if (pose_handler && parse_pose(line.substr(2), &p)) pose_handler(p);
+  }
+}
+
+//-------------------------------------------------------------------------
+void RaspiCarClient::expire(void) {
+  std::vector<ReplyHandler> expired;
+  Reply r = {false, true, "timeout"};
+  int64_t now = now_ms();
+
+  for (auto it = pending.begin(); it != pending.end();) {
+    if (it->second.deadline <= now) {
+      expired.push_back(it->second.handler);
+      it = pending.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  for (auto &h : expired) {
+    if (h) h(r);
+  }
+}
+
+//-------------------------------------------------------------------------
+// poll
+// Waits up to timeout ms for the serial port, sends and receives, calls the
+// handlers and expires requests without reply. Returns the number of
+// requests still in flight.
+int RaspiCarClient::poll(int timeout) {
+  struct pollfd pfd;
+  int64_t now = now_ms();
+  int64_t wait = timeout;
+
+  if (fd < 0) {
+    if (!device.empty() && (now >= next_connect) && connect()) {
+      return pending.size();
+    }
+    if (!device.empty() && (next_connect - now < wait)) wait = next_connect - now;
+    if (wait > 0) ::poll(nullptr, 0, wait);
+    expire();
+    return pending.size();
+  }
+
+  for (auto &p : pending) {
+    if (p.second.deadline - now < wait) wait = p.second.deadline - now;
+  }
+  if (wait < 0) wait = 0;
+  pfd.fd = fd;
+  pfd.events = POLLIN | (tx.empty() ? 0 : POLLOUT);
+  pfd.revents = 0;
+  if (::poll(&pfd, 1, wait) > 0) {
+    if (pfd.revents & POLLIN) read_rx();
+    if ((fd >= 0) && (pfd.revents & POLLOUT)) flush_tx();
+    if ((fd >= 0) && (pfd.revents & (POLLERR | POLLHUP | POLLNVAL))) disconnect();
+  }
+  expire();
+  return pending.size();
+}
+
+//-------------------------------------------------------------------------
+// Runs the event loop until all requests are answered, false on timeout
+bool RaspiCarClient::wait_idle(int timeout) {
+  int64_t end = now_ms() + timeout;
+  int64_t left;
+
+  while (!pending.empty()) {
+    left = end - now_ms();
+    if (left <= 0) return false;
+    poll(left);
+  }
+  return true;
+}
+
+//-------------------------------------------------------------------------
+// request
+// Sends "#<seq> <cmd>" and returns at once, the handler is called by poll()
+// with the reply. Returns 0 if the port is not open, the handler then
+// gets a failed reply right away.
+uint32_t RaspiCarClient::request(const std::string &cmd, ReplyHandler h) {
+  Reply r = {false, false, "not connected"};
+
+  if (fd < 0) {
+    if (h) h(r);
+    return 0;
+  }
+  seq = seq % (CLIENT_SEQ_MAX - 1) + 1;
+  pending[seq] = {h, now_ms() + timeout_ms};
+  tx += "#" + std::to_string(seq) + " " + cmd + "\n";
+  flush_tx();
+  return seq;
+}
+
+//-------------------------------------------------------------------------
+static ReplyHandler int_reply(IntHandler h) {
+  return [h](const Reply &r) {
+    int64_t v = 0;
+    bool ok = r.ok && to_int(r.text, &v);
+    if (h) h(ok, v);
+  };
+}
+
+//-------------------------------------------------------------------------
+static ReplyHandler float_reply(FloatHandler h) {
+  return [h](const Reply &r) {
+    const char *s = r.text.c_str();
+    char *end;
+    double v = strtod(s, &end);
+    if (h) h(r.ok && (end != s), v);
+  };
+}
+
+//-------------------------------------------------------------------------
+static std::string cmd_pair(const char *cmd, int64_t a, int64_t b) {
+  return cmd + std::to_string(a) + "," + std::to_string(b);
+}
+
+//-------------------------------------------------------------------------
+// ';' and line ends would split the display command
+static std::string clean_text(const std::string &text) {
+  std::string s = text;
+
+  for (auto &c : s) {
+    if ((c == ';') || (c == '\r') || (c == '\n')) c = ' ';
+  }
+  return s;
+}
+
+//-------------------------------------------------------------------------
+uint32_t RaspiCarClient::motor_enable(bool a, bool b, ReplyHandler h) {
+  return request(cmd_pair("ME", a, b), h);
+}
+
+//-------------------------------------------------------------------------
+uint32_t RaspiCarClient::motor_power(bool a, bool b, ReplyHandler h) {
+  return request(cmd_pair("MP", a, b), h);
+}
+
+//-------------------------------------------------------------------------
+uint32_t RaspiCarClient::motor_dir(bool a, bool b, ReplyHandler h) {
+  return request(cmd_pair("MD", a, b), h);
+}
+
+//-------------------------------------------------------------------------
+uint32_t RaspiCarClient::motor_rpm(uint32_t a, uint32_t b, ReplyHandler h) {
+  return request(cmd_pair("MR", a, b), h);
+}
+
+//-------------------------------------------------------------------------
+uint32_t RaspiCarClient::motor_steps(uint32_t steps, ReplyHandler h) {
+  return request("MC" + std::to_string(steps), h);
+}
+
+//-------------------------------------------------------------------------
+uint32_t RaspiCarClient::motor_steps_speed(uint32_t rpm, ReplyHandler h) {
+  return request("MS" + std::to_string(rpm), h);
+}
+
+//-------------------------------------------------------------------------
+uint32_t RaspiCarClient::move(int32_t steps_a, int32_t steps_b, ReplyHandler h) {
+  return request(cmd_pair("ML", steps_a, steps_b), h);
+}
+
+//-------------------------------------------------------------------------
+uint32_t RaspiCarClient::arc(int32_t length, int32_t radius, ReplyHandler h) {
+  return request(cmd_pair("MA", length, radius), h);
+}
+
+//-------------------------------------------------------------------------
+uint32_t RaspiCarClient::turn(int32_t degrees, ReplyHandler h) {
+  return request("MT" + std::to_string(degrees), h);
+}
+
+//-------------------------------------------------------------------------
+// rpm 0 -> speed of the segment before
+uint32_t RaspiCarClient::queue_segment(int32_t steps_a, int32_t steps_b, uint32_t rpm, ReplyHandler h) {
+  std::string cmd = cmd_pair("MQ", steps_a, steps_b);
+
+  if (rpm > 0) cmd += "," + std::to_string(rpm);
+  return request(cmd, h);
+}
+
+//-------------------------------------------------------------------------
+uint32_t RaspiCarClient::get_queue_count(IntHandler h) {
+  return request("MQ", int_reply(h));
+}
+
+//-------------------------------------------------------------------------
+uint32_t RaspiCarClient::reset_pose(ReplyHandler h) {
+  return request("MO", h);
+}
+
+//-------------------------------------------------------------------------
+uint32_t RaspiCarClient::get_mode(IntHandler h) {
+  return request("GC", int_reply(h));
+}
+
+//-------------------------------------------------------------------------
+uint32_t RaspiCarClient::get_pose(PoseHandler h) {
+  return request("GP", [h](const Reply &r) {
+    Pose p = {};
+    bool ok = r.ok && parse_pose(r.text, &p);
+    if (h) h(ok, p);
+  });
+}
+
+//-------------------------------------------------------------------------
+uint32_t RaspiCarClient::stream_pose(uint32_t hz, ReplyHandler h) {
+  return request("GP" + std::to_string(hz), h);
+}
+
+//-------------------------------------------------------------------------
+uint32_t RaspiCarClient::get_link_stats(LinkStatsHandler h) {
+  return request("GQ", [h](const Reply &r) {
+    LinkStats s = {};
+    std::vector<std::string> f = split(r.text, ',');
+    int64_t v[6];
+    bool ok = r.ok && (f.size() == 6);
+    for (int i = 0; ok && (i < 6); i++) ok = to_int(f[i], &v[i]);
+    if (ok) s = {(uint32_t) v[0], (uint32_t) v[1], (uint32_t) v[2], (uint32_t) v[3], (uint32_t) v[4], (uint32_t) v[5]};
+    if (h) h(ok, s);
+  });
+}
+
+//-------------------------------------------------------------------------
+uint32_t RaspiCarClient::get_version(FloatHandler h) {
+  return request("GV", float_reply(h));
+}
+
+//-------------------------------------------------------------------------
+uint32_t RaspiCarClient::get_max_rpm(IntHandler h) {
+  return request("GM", [h](const Reply &r) {
+    int64_t v = strtoll(r.text.c_str(), nullptr, 10);     // right aligned
+    if (h) h(r.ok && (v > 0), v);
+  });
+}
+
+//-------------------------------------------------------------------------
+uint32_t RaspiCarClient::bat_voltage(FloatHandler h) {
+  return request("BV", float_reply(h));
+}
+
+//-------------------------------------------------------------------------
+uint32_t RaspiCarClient::bat_status(ReplyHandler h) {
+  return request("BS", h);
+}
+
+//-------------------------------------------------------------------------
+uint32_t RaspiCarClient::shutdown(ReplyHandler h) {
+  return request("BX", h);
+}
+
+//-------------------------------------------------------------------------
+uint32_t RaspiCarClient::display_clear(ReplyHandler h) {
+  return request("DC", h);
+}
+
+//-------------------------------------------------------------------------
+uint32_t RaspiCarClient::display_title(const std::string &text, ReplyHandler h) {
+  return request("DT" + clean_text(text), h);
+}
+
+//-------------------------------------------------------------------------
+uint32_t RaspiCarClient::display_msg(const std::string &text, ReplyHandler h) {
+  return request("DM" + clean_text(text), h);
+}
+
+//-------------------------------------------------------------------------
+uint32_t RaspiCarClient::set_ramp(uint32_t ramp, ReplyHandler h) {
+  return request("CR" + std::to_string(ramp), h);
+}
+
+//-------------------------------------------------------------------------
+uint32_t RaspiCarClient::set_accel(uint32_t accel, ReplyHandler h) {
+  return request("CA" + std::to_string(accel), h);
+}
+
+//-------------------------------------------------------------------------
+uint32_t RaspiCarClient::set_jerk(uint32_t jerk, ReplyHandler h) {
+  return request("CJ" + std::to_string(jerk), h);
+}
+
+//-------------------------------------------------------------------------
+// set_baud
+// The motor driver switches after the "OK" and falls back to 115200 if the
+// new rate is not confirmed by a ping within 1 s. The handler gets the
+// reply of this ping.
+uint32_t RaspiCarClient::set_baud(uint32_t rate, bool save, ReplyHandler h) {
+  std::string cmd = "CB" + std::to_string(rate) + (save ? ",1" : "");
+
+  return request(cmd, [this, rate, h](const Reply &r) {
+    if (!r.ok || (fd < 0)) {
+      if (h) h(r);
+      return;
+    }
+    tcdrain(fd);
+    baud = rate;
+    set_port_baud(rate);
+    ping([this, h](const Reply &pr) {
+      if (!pr.ok && (fd >= 0)) {
+        baud = CLIENT_BAUD_DEFAULT;
+        set_port_baud(baud);
+      }
+      if (h) h(pr);
+    });
+  });
+}
+
+//-------------------------------------------------------------------------
+// The rate is sent again after a reconnect
+uint32_t RaspiCarClient::set_telemetry(uint32_t hz, ReplyHandler h) {
+  return request("T" + std::to_string(hz), [this, hz, h](const Reply &r) {
+    if (r.ok) telemetry_hz = hz;
+    if (h) h(r);
+  });
+}
+
+//-------------------------------------------------------------------------
+uint32_t RaspiCarClient::ping(ReplyHandler h) {
+  return request("P", h);
+}
@@ -0,0 +1,157 @@
+#ifndef __RASPICAR_CLIENT__
+#define __RASPICAR_CLIENT__
+
+/*
+ * Host client for the ASCII protocol of the rp2040 motor driver
+ * Owns the serial port with non-blocking I/O. All commands are sent with a
+ * sequence tag ("#<seq> "), so several requests can be in flight; the
+ * replies are matched by the tag and passed to the handler of the request.
+ * Pushed lines ("$T" telemetry, "$P" pose stream) go to the stream handlers.
+ *
+ * The client has no thread of its own: poll() waits for I/O, dispatches the
+ * replies and retries the connection after an error. The handlers are
+ * called from poll().
+ */
+
+#include <stdint.h>
+#include <string>
+#include <map>
+#include <functional>
+
+#define CLIENT_BAUD_DEFAULT   115200
+#define CLIENT_TIMEOUT_MS        500  // reply timeout
+#define CLIENT_RECONNECT_MS     1000  // retry interval after a lost connection
+#define CLIENT_LINE_MAX          256
+#define CLIENT_SEQ_MAX        100000  // sequence tags 1 ... 99999
+
+struct Reply {
+  bool ok;                    // false -> error message, timeout or lost connection
+  bool timeout;
+  std::string text;           // reply line without the tag
+};
+
+struct Pose {
+  int32_t x, y;               // 0.1mm
+  int32_t heading;            // 0.01 degree
+  uint32_t time;              // us
+};
+
+struct Telemetry {
+  uint32_t voltage;           // 10mV
+  std::string status;         // battery status, e.g. "OK"
+  uint32_t rpm_a, rpm_b;
+  int64_t pos_a, pos_b;       // microsteps
+  int mode;
+  uint32_t loops, loop_max;   // main loop passes, longest pass in us
+};
+
+struct LinkStats {
+  uint32_t rx_overflows, rx_overruns, rx_errors;
+  uint32_t rx_high_water, tx_high_water, tx_waits;
+};
+
+typedef std::function<void(const Reply &)> ReplyHandler;
+typedef std::function<void(bool ok, int32_t value)> IntHandler;
+typedef std::function<void(bool ok, double value)> FloatHandler;
+typedef std::function<void(bool ok, const Pose &)> PoseHandler;
+typedef std::function<void(bool ok, const LinkStats &)> LinkStatsHandler;
+typedef std::function<void(const Telemetry &)> TelemetryHandler;
+typedef std::function<void(const Pose &)> PoseStreamHandler;
+
+class RaspiCarClient {
+  private:
+    struct Pending {
+      ReplyHandler handler;
+      int64_t deadline;       // ms
+    };
+
+    std::string device;
+    uint32_t baud = CLIENT_BAUD_DEFAULT;
+    int fd = -1;
+    std::string rx, tx;
+    std::map<uint32_t, Pending> pending;
+    uint32_t seq = 0;
+    uint32_t timeout_ms = CLIENT_TIMEOUT_MS;
+    uint32_t reconnect_ms = CLIENT_RECONNECT_MS;
+    int64_t next_connect = 0;
+    uint32_t telemetry_hz = 0;        // restored after a reconnect
+    uint32_t reconnects = 0;
+    TelemetryHandler telemetry_handler;
+    PoseStreamHandler pose_handler;
+
+    bool connect(void);
+    void disconnect(void);
+    bool set_port_baud(uint32_t rate);
+    void flush_tx(void);
+    void read_rx(void);
+    void handle_line(const std::string &line);
+    void expire(void);
+
+  public:
+    ~RaspiCarClient();
+    bool open(const char *dev, uint32_t rate = CLIENT_BAUD_DEFAULT);
+    void close(void);
+    bool is_open(void);
+    int get_fd(void);
+    uint32_t get_baud(void);
+    uint32_t get_pending(void);
+    uint32_t get_reconnects(void);
+    void set_timeout(uint32_t ms);
+    void set_reconnect(uint32_t ms);
+    void on_telemetry(TelemetryHandler h);
+    void on_pose(PoseStreamHandler h);
+
+    // event loop
+    int poll(int timeout);
+    bool wait_idle(int timeout);
+
+    // any command, returns the sequence number (0 -> not connected)
+    uint32_t request(const std::string &cmd, ReplyHandler h = nullptr);
+
+    // motor commands (M)
+    uint32_t motor_enable(bool a, bool b, ReplyHandler h = nullptr);
+    uint32_t motor_power(bool a, bool b, ReplyHandler h = nullptr);
+    uint32_t motor_dir(bool a, bool b, ReplyHandler h = nullptr);
+    uint32_t motor_rpm(uint32_t a, uint32_t b, ReplyHandler h = nullptr);
+    uint32_t motor_steps(uint32_t steps, ReplyHandler h = nullptr);
+    uint32_t motor_steps_speed(uint32_t rpm, ReplyHandler h = nullptr);
+    uint32_t move(int32_t steps_a, int32_t steps_b, ReplyHandler h = nullptr);
+    uint32_t arc(int32_t length, int32_t radius, ReplyHandler h = nullptr);
+    uint32_t turn(int32_t degrees, ReplyHandler h = nullptr);
+    uint32_t queue_segment(int32_t steps_a, int32_t steps_b, uint32_t rpm = 0, ReplyHandler h = nullptr);
+    uint32_t get_queue_count(IntHandler h);
+    uint32_t reset_pose(ReplyHandler h = nullptr);
+
+    // get commands (G)
+    uint32_t get_mode(IntHandler h);
+    uint32_t get_pose(PoseHandler h);
+    uint32_t stream_pose(uint32_t hz, ReplyHandler h = nullptr);
+    uint32_t get_link_stats(LinkStatsHandler h);
+    uint32_t get_version(FloatHandler h);
+    uint32_t get_max_rpm(IntHandler h);
+
+    // battery commands (B)
+    uint32_t bat_voltage(FloatHandler h);
+    uint32_t bat_status(ReplyHandler h);
+    uint32_t shutdown(ReplyHandler h = nullptr);
+
+    // display commands (D)
+    uint32_t display_clear(ReplyHandler h = nullptr);
+    uint32_t display_title(const std::string &text, ReplyHandler h = nullptr);
+    uint32_t display_msg(const std::string &text, ReplyHandler h = nullptr);
+
+    // config commands (C)
+    uint32_t set_ramp(uint32_t ramp, ReplyHandler h = nullptr);
+    uint32_t set_accel(uint32_t accel, ReplyHandler h = nullptr);
+    uint32_t set_jerk(uint32_t jerk, ReplyHandler h = nullptr);
+    uint32_t set_baud(uint32_t rate, bool save, ReplyHandler h = nullptr);
+
+    // telemetry (T) and ping (P)
+    uint32_t set_telemetry(uint32_t hz, ReplyHandler h = nullptr);
+    uint32_t ping(ReplyHandler h = nullptr);
+};
+
+bool parse_telemetry(const std::string &line, Telemetry *t);
+bool parse_pose(const std::string &text, Pose *p);
+
+#endif
@@ -0,0 +1,130 @@
+"""
+Python binding of the C++ RaspiCarClient (libraspicar.so, "make lib")
+
+The C++ client owns the serial port and matches the tagged replies, Python
+only sends command strings and picks up the results. Several requests can be
+in flight:
+
+    car = RaspiCarClient("/dev/serial0")
+    s1 = car.request("GP")
+    s2 = car.request("BV")
+    ok, pose = car.result(s1)
+    ok, voltage = car.result(s2)
+
+Classes: RaspiCarClient
+"""
+
+import ctypes
+import os
+
+RESULT_TIMEOUT = 500        # ms
+
+
+class _Telemetry(ctypes.Structure):
+    _fields_ = [("voltage", ctypes.c_uint32), ("status", ctypes.c_char * 4),
+                ("rpm_a", ctypes.c_uint32), ("rpm_b", ctypes.c_uint32),
+                ("pos_a", ctypes.c_int64), ("pos_b", ctypes.c_int64),
+                ("mode", ctypes.c_int32), ("loops", ctypes.c_uint32), ("loop_max", ctypes.c_uint32)]
+
+
+class _Pose(ctypes.Structure):
+    _fields_ = [("x", ctypes.c_int32), ("y", ctypes.c_int32),
+                ("heading", ctypes.c_int32), ("time", ctypes.c_uint32)]
+
+
+def _load(path=None):
+    if path is None:
+        path = os.path.join(os.path.dirname(os.path.abspath(__file__)), "libraspicar.so")
+    lib = ctypes.CDLL(path)
+    lib.rc_open.restype = ctypes.c_void_p
+    lib.rc_open.argtypes = [ctypes.c_char_p, ctypes.c_uint32]
+    lib.rc_close.argtypes = [ctypes.c_void_p]
+    lib.rc_is_open.argtypes = [ctypes.c_void_p]
+    lib.rc_set_timeout.argtypes = [ctypes.c_void_p, ctypes.c_uint32]
+    lib.rc_poll.argtypes = [ctypes.c_void_p, ctypes.c_int]
+    lib.rc_request.restype = ctypes.c_uint32
+    lib.rc_request.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+    lib.rc_result.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.c_int, ctypes.c_char_p, ctypes.c_int]
+    lib.rc_set_telemetry.restype = ctypes.c_uint32
+    lib.rc_set_telemetry.argtypes = [ctypes.c_void_p, ctypes.c_uint32]
+    lib.rc_set_baud.restype = ctypes.c_uint32
+    lib.rc_set_baud.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.c_int]
+    lib.rc_telemetry.restype = ctypes.c_uint32
+    lib.rc_telemetry.argtypes = [ctypes.c_void_p, ctypes.POINTER(_Telemetry)]
+    lib.rc_pose.restype = ctypes.c_uint32
+    lib.rc_pose.argtypes = [ctypes.c_void_p, ctypes.POINTER(_Pose)]
+    return lib
+
+
+class RaspiCarClient:
+    """ Motor driver client, the serial I/O runs in C++
+    - Methods: request, result, send, poll, get_pose, set_telemetry, get_telemetry, get_pose_stream,
+               set_baudrate, is_open, close
+    """
+
+    def __init__(self, device="/dev/serial0", baudrate=115200, lib=None):
+        self._lib = _load(lib)
+        self._h = self._lib.rc_open(device.encode("UTF-8"), baudrate)
+        self._buf = ctypes.create_string_buffer(256)
+
+    def request(self, cmd: str) -> int:
+        """ Sends a command without waiting, returns the sequence number (0 -> not connected) """
+        return self._lib.rc_request(self._h, cmd.encode("UTF-8"))
+
+    def result(self, seq: int, timeout=RESULT_TIMEOUT):
+        """ Waits for the reply of a request: (True, text), (False, error text) or (None, "") on timeout """
+        res = self._lib.rc_result(self._h, seq, timeout, self._buf, len(self._buf))
+        if res < 0:
+            return None, ""
+        return res == 1, self._buf.value.decode("UTF-8", errors="replace")
+
+    def send(self, cmd: str, timeout=RESULT_TIMEOUT):
+        """ Sends a command and waits for the reply, returns the reply text or None """
+        ok, text = self.result(self.request(cmd), timeout)
+        return text if ok else None
+
+    def poll(self, timeout=0):
+        """ Runs the event loop (telemetry, reconnect) for up to timeout ms """
+        return self._lib.rc_poll(self._h, timeout)
+
+    def get_pose(self):
+        """ Pose (x, y in 0.1mm, heading in 0.01 degree, time in us) or None """
+        text = self.send("GP")
+        if text is None:
+            return None
+        return tuple(int(v) for v in text.split(","))
+
+    def set_telemetry(self, hz: int) -> bool:
+        """ Telemetry rate, 0 -> off. Restored after a reconnect """
+        ok, _ = self.result(self._lib.rc_set_telemetry(self._h, hz))
+        return ok == True
+
+    def get_telemetry(self):
+        """ Last telemetry line as dict, None if nothing was received yet """
+        t = _Telemetry()
+        self.poll()
+        if self._lib.rc_telemetry(self._h, ctypes.byref(t)) == 0:
+            return None
+        return {"voltage": t.voltage / 100, "status": t.status.decode(), "rpm_a": t.rpm_a, "rpm_b": t.rpm_b,
+                "pos_a": t.pos_a, "pos_b": t.pos_b, "mode": t.mode, "loops": t.loops, "loop_max": t.loop_max}
+
+    def get_pose_stream(self):
+        """ Last pose of the pose stream (GP<hz>) or None """
+        p = _Pose()
+        self.poll()
+        if self._lib.rc_pose(self._h, ctypes.byref(p)) == 0:
+            return None
+        return p.x, p.y, p.heading, p.time
+
+    def set_baudrate(self, baudrate: int, save=False) -> bool:
+        """ Switches the motor driver and the port, confirmed by a ping """
+        ok, _ = self.result(self._lib.rc_set_baud(self._h, baudrate, save), 2 * RESULT_TIMEOUT)
+        return ok == True
+
+    def is_open(self) -> bool:
+        return self._lib.rc_is_open(self._h) != 0
+
+    def close(self):
+        if self._h:
+            self._lib.rc_close(self._h)
+            self._h = None
@@ -0,0 +1,68 @@
+/*
+ * Host test and benchmark of the SPSC queue of the motor driver
+ * A producer thread pushes a counting sequence, the consumer checks that
+ * every element arrives once and in order, then the throughput is printed.
+ *
+ * Build and run: make bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <chrono>
+#include "spsc_queue.h"
+
+#define ITEMS 5000000
+
+struct Item {
+  uint32_t seq;
+  int32_t a, b, c;        // size of a motor command
+};
+
+SpscQueue<Item, 16> queue;
+
+//-------------------------------------------------------------------------
+void producer(void) {
+  Item it = {0, 1, 2, 3};
+
+  for (uint32_t i = 0; i < ITEMS; i++) {
+    it.seq = i;
+    while (!queue.push(it)) std::this_thread::yield();
+  }
+}
+
+//-------------------------------------------------------------------------
+int main(void) {
+  Item it;
+  uint32_t expected = 0;
+
+  // single thread: full and empty conditions
+  for (uint32_t i = 0; i < 16; i++) {
+    it.seq = i;
+    if (!queue.push(it)) { printf("FAIL: push %u\n", i); return 1; }
+  }
+  if (queue.push(it)) { printf("FAIL: push to full queue\n"); return 1; }
+  for (uint32_t i = 0; i < 16; i++) {
+    if (!queue.pop(it) || (it.seq != i)) { printf("FAIL: pop %u\n", i); return 1; }
+  }
+  if (queue.pop(it)) { printf("FAIL: pop from empty queue\n"); return 1; }
+
+  // two threads: order and throughput
+  auto start = std::chrono::steady_clock::now();
+  std::thread t(producer);
+  while (expected < ITEMS) {
+    if (!queue.pop(it)) {
+      std::this_thread::yield();
+      continue;
+    }
+    if (it.seq != expected) {
+      printf("FAIL: got %u, expected %u\n", it.seq, expected);
+      exit(1);
+    }
+    expected += 1;
+  }
+  t.join();
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+  printf("OK: %u items, %.1f ns per item, %.1f M items/s\n", ITEMS, (double) ns / ITEMS, ITEMS * 1e3 / ns);
+  return 0;
+}
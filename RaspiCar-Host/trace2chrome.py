@@ -0,0 +1,143 @@
+"""
+Converts the event trace of the motor driver ("GT", TRACE in trace.h) to the
+Chrome trace format (JSON), to be opened in chrome://tracing or Perfetto
+
+    python3 trace2chrome.py --device /dev/ttyUSB0 -o trace.json
+    python3 trace2chrome.py --device /dev/ttyUSB0 --save dump.bin
+    python3 trace2chrome.py dump.bin -o trace.json
+
+The dump is the reply of "GT": a line "TRACE <events>,<now us>", the events
+of 8 bytes each (time us, arg, id, type; little endian) and the CRC-16 of
+the events. The cores are shown as threads.
+"""
+
+import argparse
+import json
+import os
+import select
+import struct
+import sys
+import termios
+import time
+import tty
+
+EVENT_SIZE = 8
+READ_TIMEOUT = 5            # s, 4096 events at 115200 baud take about 3 s
+
+EVENT_NAMES = {1: "step_isr", 2: "uart_isr", 3: "decode", 4: "lcd", 5: "adc", 6: "config"}
+PHASES = {0: "i", 1: "B", 2: "E"}
+CORE_BIT = 0x80
+
+BAUD_RATES = {115200: termios.B115200, 230400: termios.B230400, 460800: termios.B460800,
+              921600: termios.B921600, 1000000: termios.B1000000}
+
+
+def crc16_ccitt(data, crc=0xFFFF):
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def read_device(device, baud):
+    """ Sends "GT" and returns the dump (header line and binary data) """
+    fd = os.open(device, os.O_RDWR | os.O_NOCTTY)
+    try:
+        tty.setraw(fd)
+        attr = termios.tcgetattr(fd)
+        attr[4] = attr[5] = BAUD_RATES[baud]
+        termios.tcsetattr(fd, termios.TCSANOW, attr)
+        termios.tcflush(fd, termios.TCIFLUSH)
+        os.write(fd, b"GT\n")
+        data = b""
+        size = None
+        deadline = time.time() + READ_TIMEOUT
+        while time.time() < deadline:
+            if select.select([fd], [], [], 0.1)[0]:
+                data += os.read(fd, 4096)
+            if size is None:
+                start = data.find(b"TRACE ")
+                end = data.find(b"\n", start)
+                if (start >= 0) and (end > 0):
+                    data = data[start:]
+                    count = int(data[6:end - start].split(b",")[0])
+                    size = end - start + 1 + count * EVENT_SIZE + 2
+            if (size is not None) and (len(data) >= size):
+                return data[:size]
+        raise RuntimeError("no complete trace from %s (TRACE compiled in?)" % device)
+    finally:
+        os.close(fd)
+
+
+def parse_dump(data):
+    """ Returns the events (time, arg, id, type) and the time of the dump """
+    end = data.index(b"\n")
+    count, now = (int(x) for x in data[6:end].strip().split(b","))
+    raw = data[end + 1:end + 1 + count * EVENT_SIZE]
+    crc = struct.unpack_from("<H", data, end + 1 + count * EVENT_SIZE)[0]
+    if crc16_ccitt(raw) != crc:
+        raise RuntimeError("CRC error in the trace dump")
+    return [struct.unpack_from("<IHBB", raw, i * EVENT_SIZE) for i in range(count)], now
+
+
+def to_chrome(events, now):
+    """ Chrome trace events, the time starts at the oldest event """
+    age = [(now - t) & 0xFFFFFFFF for t, _, _, _ in events]
+    t0 = max(age) if age else 0
+    out = [{"name": "thread_name", "ph": "M", "pid": 0, "tid": core, "args": {"name": "core %d" % core}}
+           for core in (0, 1)]
+    open_spans = {}
+    for (t, arg, ev_id, ev_type), a in sorted(zip(events, age), key=lambda x: -x[1]):
+        core = 1 if ev_type & CORE_BIT else 0
+        ph = PHASES.get(ev_type & 0x03, "i")
+        name = EVENT_NAMES.get(ev_id, "event_%d" % ev_id)
+        key = (core, name)
+        if ph == "B":
+            open_spans[key] = open_spans.get(key, 0) + 1
+        elif ph == "E":
+            if open_spans.get(key, 0) == 0:
+                continue                # begin overwritten in the ring
+            open_spans[key] -= 1
+        e = {"name": name, "ph": ph, "ts": t0 - a, "pid": 0, "tid": core}
+        if ph == "i":
+            e["s"] = "t"
+            e["args"] = {"arg": arg}
+        out.append(e)
+    return {"traceEvents": out, "displayTimeUnit": "ms"}
+
+
+def main():
+    parser = argparse.ArgumentParser(description="motor driver trace -> Chrome trace JSON")
+    parser.add_argument("dump", nargs="?", help="dump file (from --save)")
+    parser.add_argument("--device", help="serial port of the motor driver, sends GT")
+    parser.add_argument("--baud", type=int, default=115200, choices=sorted(BAUD_RATES))
+    parser.add_argument("--save", help="writes the raw dump")
+    parser.add_argument("-o", "--output", help="JSON file (default: stdout)")
+    args = parser.parse_args()
+    if bool(args.dump) == bool(args.device):
+        parser.error("either a dump file or --device")
+
+    if args.device:
+        data = read_device(args.device, args.baud)
+        if args.save:
+            with open(args.save, "wb") as f:
+                f.write(data)
+    else:
+        with open(args.dump, "rb") as f:
+            data = f.read()
+        data = data[data.index(b"TRACE "):]
+
+    events, now = parse_dump(data)
+    trace = to_chrome(events, now)
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(trace, f)
+    else:
+        json.dump(trace, sys.stdout)
+    print("%d events" % len(events), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
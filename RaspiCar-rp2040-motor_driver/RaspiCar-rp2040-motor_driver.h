@@ -9,11 +9,26 @@
 #define PROMPT_OK "OK"
 #define INFO "RaspiCar Motor Driver (by SLW) "
 
-// EEPROM
+// Placement of the step interrupt and the code it calls (motion profile,
+// segment queue, counters, trace). By default in RAM: no XIP cache misses,
+// and the steps keep running while the flash is written. STEP_ISR_IN_FLASH
+// leaves it in flash, the steps then stall during flash writes (compare
+// the longest step interrupt latency of "GL").
+//#define STEP_ISR_IN_FLASH
+#ifdef STEP_ISR_IN_FLASH
+#define STEP_ISR_FUNC(func_name) func_name
+#else
+#define STEP_ISR_FUNC(func_name) __not_in_flash_func(func_name)
+#endif
+
+// EEPROM of older versions, taken over by the configuration journal (config_store.h)
 #define EEPROM_BASE_ADDR            0
 #define EEPROM_MOTOR_RAMP           0
 #define EEPROM_BAT_SLOPE            4
 #define EEPROM_BAT_INTERCEPT        8
 #define EEPROM_DEFINED_STEPS_SPEED 12
+#define EEPROM_MOTOR_ACCEL         16
+#define EEPROM_MOTOR_JERK          20
+#define EEPROM_SERIAL_BAUD         24
 
 #endif
\ No newline at end of file
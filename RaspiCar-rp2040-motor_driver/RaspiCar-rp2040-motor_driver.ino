@@ -4,7 +4,10 @@
  * It provides driver function for two stepper motors. Beyond that, it serves 
  * as power and battery manager. Finally, it includes a LCD display to shows 
  * status information and simplify debugging. It uses a seruial interface
- * (fixed baud rate at 115200) for communication with the Raspberry Pi. 
+ * for communication with the Raspberry Pi. It starts at 115200 baud or the
+ * rate saved in the configuration. CB<rate> switches to a faster rate, the
+ * Raspberry Pi has to confirm it with a ping within a second. Without the
+ * ping or with too many receive errors it falls back to 115200 baud.
  * 
  * SLW - October 2022
  * Last update - November 2025
@@ -15,10 +18,16 @@
 #include "motors.h"
 #include "battery.h"
 #include "command_decoder.h"
+#include "odometry.h"
+#include "frame_decoder.h"
+#include "serial_link.h"
+#include "telemetry.h"
+#include "bench.h"
+#include "trace.h"
+#include "perf.h"
+#include "config_store.h"
 
 // Pins
-#define SERIAL_TX         8      // serial interface to Raspberry Pi
-#define SERIAL_RX         9
 #define RASPI_IN          2      // reserve: additional GPIO to RaspiPi 
 #define RASPI_OUT         3      // reserve: additional GPIO to RaspiPi 
 
@@ -27,11 +36,22 @@ LCD_Display display;
 Motors motors;
 Battery bat;
 CommandDecoder cmd;
+FrameDecoder frame;
+SerialLink uart_link;
+Telemetry telemetry;
+Odometry odo;
+Bench bench;
+PerfCounters perf;
+ConfigStore config;
+#ifdef TRACE
+Trace trace;
+#endif
 char buf[BUF_SIZE];
 int buf_pnt=0;
 int i = 0;
 volatile uint8_t job_flags = 0b00000000;
 int power_down_bt_status = 0;
+MotorStatus mot_status;
 
 
 //-------------------------------------------------------------------------
@@ -45,17 +65,27 @@ void setup() {
 
   Serial.begin(115200);
 
-  // initialize serial interface to RaspPi
-  gpio_set_function(SERIAL_TX, GPIO_FUNC_UART);   // TX 
-  gpio_set_function(SERIAL_RX, GPIO_FUNC_UART);   // RX
-  uart_init(uart1, 115200);
-
   // initilaize eeprom
   EEPROM.begin(256);
 
-  // start motors
+  // load configuration (journal in flash, EEPROM of older versions)
+  config.init();
+
+  // initialize serial interface to RaspPi (baud rate from configuration)
+  uart_link.init();
+
+  // start motors (the step interrupt is started by core 1 in dual core mode)
   motors.init();
 
+  // start odometry
+  odo.init();
+
+  // start telemetry (off until requested)
+  telemetry.init();
+
+  // start performance counters ("GL")
+  perf.init();
+
   // start battery management
   bat.init();
 
@@ -67,8 +97,9 @@ void setup() {
   // start display
   display.init();
 
-  // start command decoder
+  // start command decoder, ASCII protocol
   cmd.init();
+  frame.init();
 
   delay(100);
 }
@@ -77,14 +108,35 @@ long cnt=0;
 
 //-------------------------------------------------------------------------
 void loop() {
-  char c;
+  uint8_t rx_buf[64];
+  uint32_t n, k = 0, t;
+  bool complete;
   
-  if (uart_is_readable(uart1)) {
-    c = uart_getc(uart1);
-    if (cmd.add_to_buffer(c) == true) {
-      cmd.decode_command();
+  perf.loop_tick();
+
+  // all received bytes, the protocol may change after each command
+  n = uart_link.read(rx_buf, sizeof(rx_buf));
+  while (k < n) {
+    if (frame.is_active()) {
+      if (frame.add_byte(rx_buf[k++])) {
+        TRACE_BEGIN(TRACE_DECODE);
+        t = time_us_32();
+        frame.decode_frame();
+        perf.add_decode(time_us_32() - t);
+        TRACE_END(TRACE_DECODE);
+      }
+    } else {
+      k += cmd.add_to_buffer((const char *) rx_buf + k, n - k, &complete);
+      if (complete) {
+        TRACE_BEGIN(TRACE_DECODE);
+        t = time_us_32();
+        cmd.decode_command();
+        perf.add_decode(time_us_32() - t);
+        TRACE_END(TRACE_DECODE);
+      }
     }
   }
+  uart_link.check_baud();
 
   if (job_flags & (1 << JF_REFRESH_BAT_VOLTAGE)) {
     job_flags &= ~(1 << JF_REFRESH_BAT_VOLTAGE);
@@ -93,7 +145,51 @@ void loop() {
     if (bat.get_status() == STATUS_BAT_SHUTDOWN) 
       bat.request_bat_shutdown();
     }
-    motors.check_step_time_a();
-    motors.check_step_time_b();
   }
+
+  if (job_flags & (1 << JF_ODOMETRY)) {
+    job_flags &= ~(1 << JF_ODOMETRY);
+    odo.update();
+    if (odo.stream_due()) {
+      if (frame.is_active()) frame.send_pose();
+      else cmd.send_pose(true);
+    }
+  }
+
+  if (job_flags & (1 << JF_TELEMETRY)) {
+    job_flags &= ~(1 << JF_TELEMETRY);
+    if (telemetry.due()) {
+      if (frame.is_active()) frame.send_telemetry();
+      else cmd.send_telemetry();
+    }
+  }
+
+  // the display follows the motor status, it is not updated by the commands
+  if (motors.poll_status(&mot_status)) {
+    display.mot_a_rpm(mot_status.a_rpm);
+    display.mot_a_enabled(mot_status.a_enabled);
+    display.mot_a_power(mot_status.a_power);
+    display.mot_b_rpm(mot_status.b_rpm);
+    display.mot_b_enabled(mot_status.b_enabled);
+    display.mot_b_power(mot_status.b_power);
+  }
+
+  // save changed settings while the motors stand still
+  config.run();
+
+  // changed cells of the display
+  display.flush();
+}
+
+#ifdef DUAL_CORE
+//-------------------------------------------------------------------------
+// Core 1: step generation and motion state
+void setup1() {
+  motors.init_core1();
+}
+
+//-------------------------------------------------------------------------
+void loop1() {
+  motors.run_commands();
 }
+#endif
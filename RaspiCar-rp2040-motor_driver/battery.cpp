@@ -1,56 +1,131 @@
 #include "battery.h"
+#include "trace.h"
+#include "config_store.h"
+#include "hardware/adc.h"
+#include "hardware/dma.h"
 
 struct repeating_timer bat_voltage_timer;
 
+// written by the DMA, the ring wraps at its alignment
+static volatile uint16_t adc_ring[ADC_RING_SIZE] __attribute__((aligned(ADC_RING_SIZE * 2)));
+
 //-------------------------------------------------------------------------
 void Battery::init(void) {
-  pinMode(ADC_BATTERY_GPIO, INPUT);
+  extern ConfigStore config;
+
   pinMode(LED_BAT_LOW, OUTPUT);
   digitalWrite(LED_BAT_LOW, LOW);
 
-  bat_intercept = EEPROM.read(EEPROM_BASE_ADDR + EEPROM_BAT_INTERCEPT) + 
-                  EEPROM.read(EEPROM_BASE_ADDR + EEPROM_BAT_INTERCEPT + 1) * 256;
+  bat_intercept = config.data.bat_intercept;
   if ((bat_intercept  < BAT_INTERCEPT_MIN) || (bat_intercept > BAT_INTERCEPT_MAX)) {
     bat_intercept = BAT_INTERCEPT_DEFAULT;
-    EEPROM.write(EEPROM_BASE_ADDR + EEPROM_BAT_INTERCEPT, bat_intercept % 256);
-    EEPROM.write(EEPROM_BASE_ADDR + EEPROM_BAT_INTERCEPT + 1, bat_intercept / 256);
-    EEPROM.commit();
+    config.data.bat_intercept = bat_intercept;
+    config.changed();
   }
 
-  bat_slope = EEPROM.read(EEPROM_BASE_ADDR + EEPROM_BAT_SLOPE) + 
-              EEPROM.read(EEPROM_BASE_ADDR + EEPROM_BAT_SLOPE +  1) * 256;
+  bat_slope = config.data.bat_slope;
   if ((bat_slope  < BAT_SLOPE_MIN) || (bat_slope > BAT_SLOPE_MAX)) {
     bat_slope = BAT_SLOPE_DEFAULT;
-    EEPROM.write(EEPROM_BASE_ADDR + EEPROM_BAT_SLOPE, bat_slope % 256);
-    EEPROM.write(EEPROM_BASE_ADDR + EEPROM_BAT_SLOPE + 1, bat_slope / 256);
-    EEPROM.commit();
+    config.data.bat_slope = bat_slope;
+    config.changed();
+  }
+
+  // free running ADC, each conversion is moved to the ring by the DMA
+  adc_init();
+  adc_gpio_init(ADC_BATTERY_GPIO);
+  adc_select_input(ADC_BATTERY_INPUT);
+  adc_fifo_setup(true, true, 1, false, false);
+  adc_set_clkdiv(48000000 / ADC_SAMPLE_HZ - 1);     // clk_adc 48 MHz
+  adc_dma = dma_claim_unused_channel(true);
+  start_dma();
+  adc_run(true);
+
+  add_repeating_timer_ms(BAT_TICK_MS, bat_voltage_timer_callback, NULL, &bat_voltage_timer); 
+}
+
+//-------------------------------------------------------------------------
+// The DMA writes the ring from its start, a transfer count of 2^32 lasts
+// for 24 days
+void Battery::start_dma(void) {
+  dma_channel_config cfg = dma_channel_get_default_config(adc_dma);
+
+  channel_config_set_transfer_data_size(&cfg, DMA_SIZE_16);
+  channel_config_set_read_increment(&cfg, false);
+  channel_config_set_write_increment(&cfg, true);
+  channel_config_set_ring(&cfg, true, ADC_RING_BITS);
+  channel_config_set_dreq(&cfg, DREQ_ADC);
+  dma_channel_configure(adc_dma, &cfg, adc_ring, &adc_hw->fifo, ADC_DMA_COUNT, true);
+  adc_taken = 0;
+}
+
+//-------------------------------------------------------------------------
+// Sums up the samples of the ring up to end (samples written, wraps). A
+// main loop stalled for longer than the ring loses the oldest samples.
+void Battery::add_samples(const volatile uint16_t *ring, uint32_t end) {
+  if (end - adc_taken > ADC_RING_SIZE) adc_taken = end - ADC_RING_SIZE;
+  while (adc_taken != end) {
+    dec_sum += ring[adc_taken & (ADC_RING_SIZE - 1)];
+    dec_count += 1;
+    adc_taken += 1;
+  }
+}
+
+//-------------------------------------------------------------------------
+// Mean of the samples since the last update, low pass filtered. The raw
+// value keeps the scale of the sum of 17 readings of 10 bit, so the
+// calibration (CI, CS, calc_linreg.py) stays valid.
+// Returns true if the status has changed.
+bool Battery::update_voltage(void) {
+  uint32_t x, raw;
+  uint8_t level, last = status;
+
+  if (dec_count == 0) return false;
+  x = (dec_sum << BAT_FILTER_Q) / dec_count;
+  dec_sum = 0;
+  dec_count = 0;
+  TRACE_MARK(TRACE_ADC, x >> BAT_FILTER_Q);
+  if (adc_filtered == 0) adc_filtered = x;      // first update
+  else adc_filtered += (int32_t) (x - adc_filtered) >> BAT_IIR_SHIFT;
+
+  raw = (adc_filtered * BAT_RAW_SAMPLES) >> (BAT_FILTER_Q + 2);
+  voltage_raw = raw;
+  voltage = (uint16_t) (bat_intercept + (uint32_t) bat_slope * raw / 10000);
+  if (voltage < BAT_EXTERNAL) voltage = 0;
+  if (status < 3) {    // if status unequal 'SR' and 'SX' and 'BE'
+    level = voltage_level(voltage);
+    if (level > status) status = level;
+    else if (level < status) status = min(status, voltage_level(voltage - BAT_HYSTERESIS));
   }
+  return status != last;
+}
 
-  add_repeating_timer_ms(10, bat_voltage_timer_callback, NULL, &bat_voltage_timer); 
+//-------------------------------------------------------------------------
+uint8_t Battery::voltage_level(uint16_t v) {
+  if (v > BAT_LOW) return 0;            // 'OK'
+  if (v > BAT_SHUTDOWN) return 1;       // 'BL' battery low
+  if (v > BAT_EXTERNAL) return 2;       // 'BS' battery shutdown
+  return 3;                             // 'BE' battery external
 }
 
 //-------------------------------------------------------------------------
-// Retrieves and sums up the adc value.
-// After every 16th call, returns true (to initiate display refresh), otherwise false
+// Called every BAT_TICK_MS: takes the new samples of the DMA ring and
+// updates the voltage every BAT_UPDATE_TICKS.
+// Returns true every BAT_SHOW_TICKS (to initiate display refresh) and on
+// a change of the status, otherwise false
 bool Battery::run_adc(void) {
   extern LCD_Display display;
-  
-  adc_sum += analogRead(ADC_BATTERY);
-  cnt_adc += 1;
-  if (cnt_adc > 16) {
-    cnt_adc = 0;
-    voltage_raw = adc_sum;
-    voltage = (uint16_t) (bat_intercept + (uint32_t) bat_slope * adc_sum / 10000);
-    if (voltage < BAT_EXTERNAL) voltage = 0;
-    adc_sum = 0;
-    cnt_show += 1;    
-    if (status < 3) {    // if status unequal 'SR' and 'SX' and 'BE'
-      if (voltage > BAT_LOW) status = 0; // 'OK'
-      else if (voltage > BAT_SHUTDOWN) status = 1; // 'BL' battery low
-      else if (voltage > BAT_EXTERNAL) status = 2; // 'BS' battery shutdown
-      else status = 3; // 'BE' battery external
-    }
+  bool changed = false;
+
+  if (adc_dma >= 0) {
+    if (!dma_channel_is_busy(adc_dma)) start_dma();
+    add_samples(adc_ring, ADC_DMA_COUNT - dma_channel_hw_addr(adc_dma)->transfer_count);
   }
+  cnt_update += 1;
+  if (cnt_update >= BAT_UPDATE_TICKS) {
+    cnt_update = 0;
+    changed = update_voltage();
+  }
+  cnt_show += 1;
 
   // manage power down button
   if (digitalRead(POWER_DOWN_BT) == LOW) {
@@ -68,7 +143,7 @@ bool Battery::run_adc(void) {
   }
 
   // show battery status 
-  if (cnt_show >= 16) {
+  if (cnt_show >= BAT_SHOW_TICKS) {
     cnt_show = 0;
     // manage pending shutdown via cnt_shutdown_wait
     if ((status != STATUS_SHUTDOWN_ACTIVE) && 
@@ -91,7 +166,7 @@ bool Battery::run_adc(void) {
     return true;
     
   } else {
-    return false;
+    return changed;
   }
 }
 
@@ -163,18 +238,20 @@ uint16_t Battery::get_bat_slope(void) {
 
 //-------------------------------------------------------------------------
 void Battery::set_bat_slope(uint16_t slope) {
+  extern ConfigStore config;
+
   bat_slope = slope;
-    EEPROM.write(EEPROM_BASE_ADDR + EEPROM_BAT_SLOPE, bat_slope % 256);
-    EEPROM.write(EEPROM_BASE_ADDR + EEPROM_BAT_SLOPE + 1, bat_slope / 256);
-    EEPROM.commit();
+  config.data.bat_slope = bat_slope;
+  config.changed();
 }
 
 //-------------------------------------------------------------------------
 void Battery::set_bat_intercept(uint16_t intercept) {
+  extern ConfigStore config;
+
   bat_intercept = intercept;
-  EEPROM.write(EEPROM_BASE_ADDR + EEPROM_BAT_INTERCEPT, bat_intercept % 256);
-  EEPROM.write(EEPROM_BASE_ADDR + EEPROM_BAT_INTERCEPT + 1, bat_intercept / 256);
-  EEPROM.commit();
+  config.data.bat_intercept = bat_intercept;
+  config.changed();
 }
 
 //-------------------------------------------------------------------------
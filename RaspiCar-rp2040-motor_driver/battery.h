@@ -4,7 +4,7 @@
 #include "display.h"
 
 // pin definitions
-#define ADC_BATTERY            A2
+#define ADC_BATTERY_INPUT       2      // ADC channel of ADC_BATTERY_GPIO
 #define ADC_BATTERY_GPIO       28
 #define LED_BAT_LOW            13
 #define POWER_ON               10      // system power 
@@ -18,6 +18,20 @@
 #define BAT_INTERCEPT_MIN      700
 #define BAT_INTERCEPT_MAX     1000
 
+// ADC pipeline: free running ADC -> DMA ring -> mean of each update
+// (decimation) -> IIR low pass
+#define ADC_SAMPLE_HZ       2000      // conversions per second, 20 per tick
+#define ADC_RING_BITS          9      // DMA ring of 2^9 bytes: 256 samples, 128 ms
+#define ADC_RING_SIZE       (1 << (ADC_RING_BITS - 1))
+#define ADC_DMA_COUNT 0xFFFFFFFF      // transfers until the DMA is restarted
+#define BAT_TICK_MS           10      // run_adc(), power down button
+#define BAT_UPDATE_TICKS       1      // voltage update every n ticks (100 Hz)
+#define BAT_FILTER_Q           8      // fraction bits of the filter
+#define BAT_IIR_SHIFT          3      // y += (x - y) / 8, time constant 80 ms
+#define BAT_RAW_SAMPLES       17      // raw value: as the sum of 17 readings of 10 bit (calibration)
+#define BAT_SHOW_TICKS       272      // display refresh and shutdown countdown, 2.72 s
+#define BAT_HYSTERESIS        20      // 10mV, a better status needs the threshold + 0.2V
+
 // Battery voltage range
 #define BAT_LOW               1050
 #define BAT_SHUTDOWN           950
@@ -48,16 +62,25 @@ class Battery {
     uint8_t status = 0;         // 0 -> all fine (OK), 1 -> battery low (BL), 
                                 // 2 -> battery shutdown (SB), 3 -> shutdown requested (SR)
                                 // 4 -> shutdown active
-    int cnt_adc = 0;
+    int cnt_update = 0;
     int cnt_show = 0;
     int cnt_shutdown = 0;
     long cnt_shutdown_button = 0;
     int cnt_shutdown_request_wait = 0;
     int cnt_force_shutdown = 0;
-    uint32_t adc_sum = 0;
+    int adc_dma = -1;           // DMA channel, -1 -> none
+    uint32_t adc_taken = 0;     // samples taken from the ring, wraps
+    uint32_t dec_sum = 0;       // samples of the current update
+    uint32_t dec_count = 0;
+    uint32_t adc_filtered = 0;  // IIR output, 12 bit ADC value, BAT_FILTER_Q fraction bits
+    void start_dma(void);
+    void add_samples(const volatile uint16_t *ring, uint32_t end);
+    bool update_voltage(void);
+    uint8_t voltage_level(uint16_t v);
     void decode_status(char *buf);
     void request_shutdown(void);
     void force_shutdown(void);
+    friend class Bench;
     
   public:
     void init(void);
@@ -0,0 +1,124 @@
+#include "bench.h"
+#include "util.h"
+#include "hardware/structs/systick.h"
+
+#define BENCH_RPM        RPM_MAX
+#define BENCH_EVENTS        8000  // limited run: ramp up, cruise, ramp down
+#define SYSTICK_MAX   0x00FFFFFF  // 24 bit down counter
+#define SYSTICK_ON    0x00000005  // enabled, processor clock, no interrupt
+
+static const char *bench_names[BENCH_CASES] = {
+  "crc16_ccitt_64", "next_interval", "next_interval_jerk", "get_int", "itoaf", "bat_filter", "decode_command"
+};
+
+// commands of a typical session, without motor commands (no wait for core 1)
+static const char *bench_cmds[] = {"GV", "BS", "GQ", "T", "BV", "GM"};
+#define BENCH_CMDS (sizeof(bench_cmds) / sizeof(bench_cmds[0]))
+
+static uint8_t bench_data[64];
+static uint16_t bench_adc[ADC_RING_SIZE];     // samples of the battery ADC
+
+//-------------------------------------------------------------------------
+void Bench::init(void) {
+  prof.set_accel(MOT_RAMP * RAMP_ACCEL_FACTOR);
+  prof.set_jerk(0);
+  restart(&prof);
+  prof_jerk.set_accel(MOT_RAMP * RAMP_ACCEL_FACTOR);
+  prof_jerk.set_jerk(MOT_JERK_MIN * 10);
+  restart(&prof_jerk);
+  dec.init();
+  bat.bat_intercept = BAT_INTERCEPT_DEFAULT;
+  bat.bat_slope = BAT_SLOPE_DEFAULT;
+  for (uint32_t i = 0; i < sizeof(bench_data); i++) bench_data[i] = i * 37;
+  for (uint32_t i = 0; i < ADC_RING_SIZE; i++) bench_adc[i] = 2056 + (i * 7) % 16;
+}
+
+//-------------------------------------------------------------------------
+void Bench::restart(MotionProfile *p) {
+  p->reset();
+  p->set_target_rpm(BENCH_RPM);
+  p->set_distance(BENCH_EVENTS);
+}
+
+//-------------------------------------------------------------------------
+// Runs ops iterations of a case
+void Bench::run(uint8_t nr, uint32_t ops) {
+  extern SerialLink uart_link;
+  uint8_t pnt;
+  volatile uint32_t sink = 0;
+
+  while (ops--) {
+    cnt += 1;
+    switch (nr) {
+      case 0:
+        sink = crc16_ccitt(bench_data, sizeof(bench_data), 0xFFFF);
+        break;
+      case 1:
+        if (prof.next_interval() == 0) restart(&prof);
+        break;
+      case 2:
+        if (prof_jerk.next_interval() == 0) restart(&prof_jerk);
+        break;
+      case 3:
+        strcpy(dec.buf, "MR1200,-350");
+        pnt = 2;
+        sink = dec.get_int(&pnt);
+        pnt += 1;
+        sink += dec.get_int(&pnt);
+        break;
+      case 4:
+        itoaf(cnt * 37 % 20000, s, 4, 2, false);
+        break;
+      case 5:
+        bat.add_samples(bench_adc, bat.adc_taken + ADC_SAMPLE_HZ * BAT_TICK_MS / 1000);
+        sink = bat.update_voltage();
+        break;
+      case 6:
+        strcpy(dec.buf, bench_cmds[cnt % BENCH_CMDS]);
+        uart_link.set_mute(true);
+        dec.decode_command();
+        uart_link.set_mute(false);
+        break;
+    }
+  }
+  (void) sink;
+}
+
+//-------------------------------------------------------------------------
+const char *Bench::get_name(uint8_t nr) {
+  return (nr < BENCH_CASES) ? bench_names[nr] : "";
+}
+
+//-------------------------------------------------------------------------
+// Cycles of BENCH_BATCH ops, the SysTick runs at the processor clock
+uint32_t Bench::run_batch(uint8_t nr) {
+  uint32_t start;
+
+  start = systick_hw->cvr;
+  run(nr, BENCH_BATCH);
+  return (start - systick_hw->cvr) & SYSTICK_MAX;
+}
+
+//-------------------------------------------------------------------------
+// measure
+// Returns the cycles per op of the fastest batch (interrupts in between
+// are filtered out this way), avg is set to the mean cycles per op.
+uint32_t Bench::measure(uint8_t nr, uint32_t *avg) {
+  uint32_t csr, rvr, t, t_min = SYSTICK_MAX, sum = 0;
+
+  csr = systick_hw->csr;
+  rvr = systick_hw->rvr;
+  systick_hw->rvr = SYSTICK_MAX;
+  systick_hw->cvr = 0;
+  systick_hw->csr = SYSTICK_ON;
+  run(nr, BENCH_BATCH);                     // warm up (flash cache)
+  for (uint32_t i = 0; i < BENCH_BATCHES; i++) {
+    t = run_batch(nr);
+    if (t < t_min) t_min = t;
+    sum += t;
+  }
+  systick_hw->rvr = rvr;
+  systick_hw->csr = csr;
+  *avg = sum / (BENCH_BATCHES * BENCH_BATCH);
+  return t_min / BENCH_BATCH;
+}
@@ -0,0 +1,35 @@
+#ifndef __BENCH__
+#define __BENCH__
+
+#include "RaspiCar-rp2040-motor_driver.h"
+#include "motion_profile.h"
+#include "command_decoder.h"
+#include "battery.h"
+
+#define BENCH_CASES            7
+#define BENCH_BATCH           10  // ops per measurement
+#define BENCH_BATCHES        100  // measurements per case, the fastest one counts
+
+// Hot path routines with realistic inputs, on private copies of their
+// state (the running motors, battery and serial link are not touched).
+// "GH" measures the cycles by the SysTick of the calling core, the host
+// harness (RaspiCar-Host/hotpath_bench.cpp) runs the same cases.
+class Bench {
+  private:
+    MotionProfile prof;               // trapezoidal profile
+    MotionProfile prof_jerk;          // jerk limited profile
+    CommandDecoder dec;
+    Battery bat;
+    uint32_t cnt = 0;
+    char s[12];
+    void restart(MotionProfile *p);
+    uint32_t run_batch(uint8_t nr);
+
+  public:
+    void init(void);
+    void run(uint8_t nr, uint32_t ops);
+    const char *get_name(uint8_t nr);
+    uint32_t measure(uint8_t nr, uint32_t *avg);
+};
+
+#endif
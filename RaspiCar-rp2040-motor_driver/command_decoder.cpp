@@ -1,4 +1,10 @@
 # include "command_decoder.h"
+#include "bench.h"
+#include "trace.h"
+#include "perf.h"
+#include "config_store.h"
+
+extern SerialLink uart_link;
 
 
 //-------------------------------------------------------------------------
@@ -31,6 +37,19 @@ bool CommandDecoder::add_to_buffer(char c) {
   return false;
 }
 
+//-------------------------------------------------------------------------
+// Adds a span of received chars up to the first end-of-line character.
+// Returns the number of chars taken, complete is set if a line is complete.
+uint32_t CommandDecoder::add_to_buffer(const char *s, uint32_t n, bool *complete) {
+  uint32_t i = 0;
+
+  *complete = false;
+  while ((i < n) && !*complete) {
+    *complete = add_to_buffer(s[i++]);
+  }
+  return i;
+}
+
 //-------------------------------------------------------------------------
 // get_int
 // Extracts an integer from the input buffer. 
@@ -70,42 +89,179 @@ void CommandDecoder::show_info(void) {
   extern Motors motors;
   extern Battery bat;
 
-  uart_puts(uart1, INFO);
-  uart_puts(uart1, "\r\nSoftware Version:");
+  uart_link.puts(INFO);
+  uart_link.puts("\r\nSoftware Version:");
   itoaf(SOFTWARE_VERSION, local_buf, 3, 2, false);
-  uart_puts(uart1, local_buf);
-  uart_puts(uart1, "\r\nMotor ramp: ");
-  itoa(motors.get_ramp(), local_buf, 10);
-  uart_puts(uart1, local_buf); 
-  uart_puts(uart1, "\r\nLimited steps speed: ");
-  itoa(motors.get_defined_steps_speed(), local_buf, 10);
-  uart_puts(uart1, local_buf); 
-  uart_puts(uart1, "\r\nBattery voltage: ");
+  uart_link.puts(local_buf);
+  motors.sync();
+  uart_link.puts("\r\nMotor ramp: ");
+  uart_link.put_int(motors.get_ramp()); 
+  uart_link.puts("\r\nMotor accel: ");
+  uart_link.put_int(motors.get_accel()); 
+  uart_link.puts("\r\nMotor jerk: ");
+  uart_link.put_int(motors.get_jerk()); 
+  uart_link.puts("\r\nLimited steps speed: ");
+  uart_link.put_int(motors.get_defined_steps_speed()); 
+  uart_link.puts("\r\nBattery voltage: ");
   itoaf(bat.get_voltage(), local_buf, 4, 2, false);
-  uart_puts(uart1, local_buf); 
-  uart_puts(uart1, "V\r\n");
+  uart_link.puts(local_buf); 
+  uart_link.puts("V\r\n");
+}
+
+
+//-------------------------------------------------------------------------
+// send_pose
+// Sends x, y (0.1 mm), heading (0.01 degree) and time (us) separated by
+// comma. Streamed poses start with "$P" to tell them from replies.
+void CommandDecoder::send_pose(bool stream) {
+  extern Odometry odo;
+
+  if (stream) uart_link.puts("$P");
+  uart_link.put_int(odo.get_x());
+  uart_link.puts(",");
+  uart_link.put_int(odo.get_y());
+  uart_link.puts(",");
+  uart_link.put_int(odo.get_heading());
+  uart_link.puts(",");
+  uart_link.put_uint(odo.get_time());
+  if (stream) uart_link.puts("\r\n");
+}
+
+
+//-------------------------------------------------------------------------
+// send_telemetry
+// Telemetry line "$T": battery voltage (10 mV), battery status, speed of
+// motor A and B (RPM), positions of motor A and B (microsteps, low 32 bits),
+// motor mode, main loop passes and longest pass (us) since the last line
+void CommandDecoder::send_telemetry(void) {
+  int64_t pos_a, pos_b;
+  uint32_t loops, loop_max;
+  extern Battery bat;
+  extern Motors motors;
+  extern PerfCounters perf;
+
+  motors.get_position(&pos_a, &pos_b);
+  perf.take_loop_stats(&loops, &loop_max);
+  uart_link.puts("$T");
+  uart_link.put_uint(bat.get_voltage());
+  uart_link.puts(",");
+  bat.get_decode_status(local_buf);
+  uart_link.puts(local_buf);
+  uart_link.puts(",");
+  uart_link.put_uint(motors.prof_a.get_rpm());
+  uart_link.puts(",");
+  uart_link.put_uint(motors.prof_b.get_rpm());
+  uart_link.puts(",");
+  uart_link.put_int((int32_t) pos_a);
+  uart_link.puts(",");
+  uart_link.put_int((int32_t) pos_b);
+  uart_link.puts(",");
+  uart_link.put_int(motors.get_mode());
+  uart_link.puts(",");
+  uart_link.put_uint(loops);
+  uart_link.puts(",");
+  uart_link.put_uint(loop_max);
+  uart_link.puts("\r\n");
+}
+
+
+//-------------------------------------------------------------------------
+// send_link_stats
+// Counters of the serial link: bytes lost in the receive buffer, bytes lost
+// in the UART FIFO, bytes with errors, max fill level of the receive buffer,
+// max fill level of the transmit buffer, waits for a full transmit buffer
+void CommandDecoder::send_link_stats(void) {
+  uart_link.put_uint(uart_link.get_rx_overflows());
+  uart_link.puts(",");
+  uart_link.put_uint(uart_link.get_rx_overruns());
+  uart_link.puts(",");
+  uart_link.put_uint(uart_link.get_rx_errors());
+  uart_link.puts(",");
+  uart_link.put_uint(uart_link.get_rx_high_water());
+  uart_link.puts(",");
+  uart_link.put_uint(uart_link.get_tx_high_water());
+  uart_link.puts(",");
+  uart_link.put_uint(uart_link.get_tx_waits());
+}
+
+
+//-------------------------------------------------------------------------
+// send_perf_stats
+// Performance counters since the last reset: window in ms, main loop passes
+// per s, longest pass in us, step interrupt load in 0.1 %, step interrupts
+// per s, longest step interrupt in us, bytes lost in the UART FIFO, bytes
+// lost in the receive buffer, commands per s, longest command in us,
+// longest step interrupt latency in us
+void CommandDecoder::send_perf_stats(bool reset) {
+  extern PerfCounters perf;
+  PerfStats st;
+
+  perf.take_stats(&st, reset);
+  uart_link.put_uint(st.window_ms);
+  uart_link.puts(",");
+  uart_link.put_uint(st.loops_per_s);
+  uart_link.puts(",");
+  uart_link.put_uint(st.loop_max_us);
+  uart_link.puts(",");
+  uart_link.put_uint(st.isr_load);
+  uart_link.puts(",");
+  uart_link.put_uint(st.isr_per_s);
+  uart_link.puts(",");
+  uart_link.put_uint(st.isr_max_us);
+  uart_link.puts(",");
+  uart_link.put_uint(st.rx_overruns);
+  uart_link.puts(",");
+  uart_link.put_uint(st.rx_overflows);
+  uart_link.puts(",");
+  uart_link.put_uint(st.cmds_per_s);
+  uart_link.puts(",");
+  uart_link.put_uint(st.decode_max_us);
+  uart_link.puts(",");
+  uart_link.put_uint(st.isr_latency_max_us);
 }
 
 
 //-------------------------------------------------------------------------
 void CommandDecoder::decode_get_command(uint8_t pnt) {
+  int32_t a;
+  uint32_t b, c;
   uint8_t status = 0;   // 0 -> okay, 1 -> okay, no prompt, 2 -> error
   extern Battery bat;
   extern Motors motors;
+  extern Odometry odo;
+  extern Bench bench;
   
   switch (buf[pnt]) {
 
     case 'b':               // get battery status
     case 'B':
       bat.get_decode_status(local_buf);
-      uart_puts(uart1, local_buf);
+      uart_link.puts(local_buf);
       status = 1;
       break;
 
     case 'c':               // get motor mode and status
     case 'C':
-      itoa(motors.get_mode(), local_buf, 10);
-      uart_puts(uart1, local_buf);
+      motors.sync();                      // commands before must have been executed
+      uart_link.put_int(motors.get_mode());
+      status = 1;
+      break;
+
+    case 'h':               // hot path benchmark: name, cycles per op (fastest batch, mean), GH<n> -> case n
+    case 'H':
+      pnt += 1;
+      a = get_int(&pnt);
+      bench.init();
+      for (uint8_t n = 0; n < BENCH_CASES; n++) {
+        if ((a != VALID_LIMIT) && (a != n)) continue;
+        b = bench.measure(n, &c);
+        if ((a == VALID_LIMIT) && (n > 0)) uart_link.puts("\r\n");
+        uart_link.puts(bench.get_name(n));
+        uart_link.puts(",");
+        uart_link.put_uint(b);
+        uart_link.puts(",");
+        uart_link.put_uint(c);
+      }
       status = 1;
       break;
 
@@ -115,38 +271,80 @@ void CommandDecoder::decode_get_command(uint8_t pnt) {
       status = 1;
       break;
 
+    case 'l':               // get performance counters, GLR -> read and reset
+    case 'L':
+      send_perf_stats((buf[pnt + 1] == 'r') || (buf[pnt + 1] == 'R'));
+      status = 1;
+      break;
+
     case 'm':               // get max speed
     case 'M':
       itoaf(RPM_MAX, local_buf, 5, 0, false);
-      uart_puts(uart1, local_buf); 
+      uart_link.puts(local_buf); 
+      status = 1;
+      break;
+
+    case 'p':               // get pose, GP<hz> streams the pose
+    case 'P':
+      pnt += 1;
+      a = get_int(&pnt);
+      if (a < VALID_LIMIT) {
+        odo.set_stream(a);
+      } else {
+        odo.update();
+        send_pose(false);
+        status = 1;
+      }
+      break;
+
+    case 'q':               // get serial link statistics
+    case 'Q':
+      send_link_stats();
       status = 1;
       break;
 
     case 'r':               // get battery raw voltage
     case 'R':
       itoaf(bat.get_raw_voltage(), local_buf, 5, 0, false);
-      uart_puts(uart1, local_buf); 
+      uart_link.puts(local_buf); 
       status = 1;
       break;
 
     case 's':               // get defined steps speed
     case 'S':
-      itoa(motors.get_defined_steps_speed(), local_buf, 10);
-      uart_puts(uart1, local_buf); 
+      motors.sync();
+      uart_link.put_int(motors.get_defined_steps_speed()); 
       status = 1;
       break;
 
+    case 't':               // event trace: GT -> binary dump, GT0 / GT1 -> stop / start
+    case 'T':
+#ifdef TRACE
+      pnt += 1;
+      a = get_int(&pnt);
+      if (a == VALID_LIMIT) {
+        trace.dump();
+        status = 1;
+      } else {
+        trace.set_enabled(a != 0);
+      }
+#else
+      uart_link.puts("Trace not compiled in! (TRACE in trace.h)");
+      status = 1;
+#endif
+      break;
+
     case 'u':               // get battery voltage
     case 'U':
       itoaf(bat.get_voltage(), local_buf, 4, 2, false);
-      uart_puts(uart1, local_buf); 
+      uart_link.puts(local_buf); 
       status = 1;
       break;
 
     case 'v':               // return software version number
     case 'V':
       itoaf(SOFTWARE_VERSION, local_buf, 3, 2, false);
-      uart_puts(uart1, local_buf);
+      uart_link.puts(local_buf);
       status = 1;
       break;
 
@@ -156,56 +354,141 @@ void CommandDecoder::decode_get_command(uint8_t pnt) {
 
   switch (status) {
     case 0: 
-     uart_puts(uart1, PROMPT_OK);
+     uart_link.puts(PROMPT_OK);
      break;
     case 1:
       break;
     case 2:
-      uart_puts(uart1, "Get command not recognized: ");
-      uart_puts(uart1, buf);
+      uart_link.puts("Get command not recognized: ");
+      uart_link.puts(buf);
     default:
       break;
   }
-  uart_puts(uart1, "\r\n");
+  uart_link.puts("\r\n");
 }
 
 
 //-------------------------------------------------------------------------
 void CommandDecoder::decode_config_command(uint8_t pnt) {
-  uint32_t a;
+  uint32_t a, b;
   uint8_t status = 0;   // 0 -> okay, 1 -> okay, no prompt, 2 -> error
   extern Battery bat;
   extern Motors motors;
+  extern FrameDecoder frame;
+  extern ConfigStore config;
   
   switch (buf[pnt]) {
+    case 'a':               // set acceleration
+    case 'A':
+      pnt += 1;
+      a = get_int(&pnt);    
+      if ((a >= MOT_ACCEL_MIN) && (a <= MOT_ACCEL_MAX)) {
+        motors.submit(MOP_ACCEL, a); 
+      } else {
+        uart_link.puts("Acceleration out of range! (valid range ");
+        uart_link.put_int(MOT_ACCEL_MIN);
+        uart_link.puts(" ... ");
+        uart_link.put_int(MOT_ACCEL_MAX);
+        uart_link.puts(")");
+        status = 1;
+      }
+      break;
+
+    case 'j':               // set jerk, 0 -> trapezoidal profile
+    case 'J':
+      pnt += 1;
+      a = get_int(&pnt);    
+      if ((a == 0) || ((a >= MOT_JERK_MIN) && (a <= MOT_JERK_MAX))) {
+        motors.submit(MOP_JERK, a); 
+      } else {
+        uart_link.puts("Jerk out of range! (valid range 0, ");
+        uart_link.put_int(MOT_JERK_MIN);
+        uart_link.puts(" ... ");
+        uart_link.put_int(MOT_JERK_MAX);
+        uart_link.puts(")");
+        status = 1;
+      }
+      break;
+
+    case 'p':               // protocol: CP1 -> binary frames (FOP_ASCII switches back)
+    case 'P':
+      pnt += 1;
+      a = get_int(&pnt);
+      if (a == 1) {
+        uart_link.puts(PROMPT_OK);
+        uart_link.puts("\r\n");
+        frame.set_active(true);
+        return;
+      } else if (a != 0) {
+        uart_link.puts("Protocol out of range! (0 -> ASCII, 1 -> binary)");
+        status = 1;
+      }
+      break;
+
     case 'r':               // set_ramp
     case 'R':
       pnt += 1;
       a = get_int(&pnt);    
       if ((a >= 1) && (a <= 50)) {
-        motors.set_ramp(a); 
+        motors.submit(MOP_RAMP, a); 
       } else {
-        uart_puts(uart1, "Ramp out of range (valid range: 1 ... 50)");
+        uart_link.puts("Ramp out of range (valid range: 1 ... 50)");
+        status = 1;
+      }
+      break;
+
+    case 'b':               // baud rate: CB<rate>[,1 -> save], confirmed by a ping at the new rate
+    case 'B':
+      pnt += 1;
+      a = get_int(&pnt);
+      b = get_int(&pnt);
+      if (a == VALID_LIMIT) {               // 1000000 is beyond VALID_LIMIT
+        uart_link.put_uint(uart_link.get_baud());
+        status = 1;
+      } else if (a != uart_link.get_baud() || (b == 1)) {
+        uart_link.puts(PROMPT_OK);
+        uart_link.puts("\r\n");
+        if (uart_link.start_baud_trial(a, b == 1)) return;
+        uart_link.puts("Baud rate not supported! (115200, 230400, 460800, 921600, 1000000)");
         status = 1;
       }
       break;
 
     case 'g':
     case 'G':             // get config
-      uart_puts(uart1, "Motor ramp:        ");
-      itoa(motors.get_ramp(), local_buf, 10);
-      uart_puts(uart1, local_buf);
-      uart_puts(uart1, "\r\n");
-      uart_puts(uart1, "Bat ADC intercept: ");
-      itoa(bat.get_bat_intercept(), local_buf, 10);
-      uart_puts(uart1, local_buf);
-      uart_puts(uart1, "\r\n");
-      uart_puts(uart1, "Bat ADC slope    : ");
-      itoa(bat.get_bat_slope(), local_buf, 10);
-      uart_puts(uart1, local_buf);
+      motors.sync();
+      motors.update_config();
+      uart_link.puts("Motor ramp:        ");
+      uart_link.put_int(motors.get_ramp());
+      uart_link.puts("\r\n");
+      uart_link.puts("Motor accel:       ");
+      uart_link.put_int(motors.get_accel());
+      uart_link.puts("\r\n");
+      uart_link.puts("Motor jerk:        ");
+      uart_link.put_int(motors.get_jerk());
+      uart_link.puts("\r\n");
+      uart_link.puts("Bat ADC intercept: ");
+      uart_link.put_int(bat.get_bat_intercept());
+      uart_link.puts("\r\n");
+      uart_link.puts("Bat ADC slope    : ");
+      uart_link.put_int(bat.get_bat_slope());
+      uart_link.puts("\r\n");
+      uart_link.puts("Config saves:      ");
+      uart_link.put_uint(config.get_saves());
+      uart_link.puts(config.is_dirty() ? " (changed)" : "");
       status = 1;
       break;
 
+    case 'w':             // save config now, otherwise saved when the motors stop
+    case 'W':
+      motors.sync();
+      motors.update_config();
+      if (!config.save()) {
+        uart_link.puts("Config not saved!");
+        status = 1;
+      }
+      break;
+
     case 'i':             // set bat intercept
     case 'I':
       pnt += 1;
@@ -213,13 +496,11 @@ void CommandDecoder::decode_config_command(uint8_t pnt) {
       if ((a >= BAT_INTERCEPT_MIN) && (a <= BAT_INTERCEPT_MAX)) {
         bat.set_bat_intercept(a); 
       } else {
-        uart_puts(uart1, "Bat intercept out of range! (valid range ");
-        itoa(BAT_INTERCEPT_MIN, local_buf, 10);
-        uart_puts(uart1, local_buf);
-        uart_puts(uart1, " ... ");
-        itoa(BAT_INTERCEPT_MAX, local_buf, 10);
-        uart_puts(uart1, local_buf);
-        uart_puts(uart1, ")");
+        uart_link.puts("Bat intercept out of range! (valid range ");
+        uart_link.put_int(BAT_INTERCEPT_MIN);
+        uart_link.puts(" ... ");
+        uart_link.put_int(BAT_INTERCEPT_MAX);
+        uart_link.puts(")");
         status = 1;
       }
       break;
@@ -231,13 +512,11 @@ void CommandDecoder::decode_config_command(uint8_t pnt) {
       if ((a >= BAT_SLOPE_MIN) && (a <= BAT_SLOPE_MAX)) {
         bat.set_bat_slope(a); 
       } else {
-        uart_puts(uart1, "Bat slope out of range! (valid range ");
-        itoa(BAT_SLOPE_MIN, local_buf, 10);
-        uart_puts(uart1, local_buf);
-        uart_puts(uart1, " ... ");
-        itoa(BAT_SLOPE_MAX, local_buf, 10);
-        uart_puts(uart1, local_buf);
-        uart_puts(uart1, ")");
+        uart_link.puts("Bat slope out of range! (valid range ");
+        uart_link.put_int(BAT_SLOPE_MIN);
+        uart_link.puts(" ... ");
+        uart_link.put_int(BAT_SLOPE_MAX);
+        uart_link.puts(")");
         status = 1;
       }
       break;
@@ -248,17 +527,17 @@ void CommandDecoder::decode_config_command(uint8_t pnt) {
 
   switch (status) {
     case 0: 
-     uart_puts(uart1, PROMPT_OK);
+     uart_link.puts(PROMPT_OK);
      break;
     case 1:
       break;
     case 2:
-      uart_puts(uart1, "Config command not recognized: ");
-      uart_puts(uart1, buf);
+      uart_link.puts("Config command not recognized: ");
+      uart_link.puts(buf);
     default:
       break;
   }
-  uart_puts(uart1, "\r\n");
+  uart_link.puts("\r\n");
 }
 
 
@@ -272,21 +551,21 @@ void CommandDecoder::decode_bat_command(uint8_t pnt) {
     case 'v':               // get battery voltage
     case 'V':
       itoaf(bat.get_voltage(), local_buf, 4, 2, false);
-      uart_puts(uart1, local_buf); 
+      uart_link.puts(local_buf); 
       status = 1;
       break;
 
     case 's':               // get battery status
     case 'S':
       bat.get_full_status(local_buf);
-      uart_puts(uart1, local_buf);
+      uart_link.puts(local_buf);
       status = 1;
       break;
 
     case 'r':               // get battery raw voltage
     case 'R':
       itoaf(bat.get_raw_voltage(), local_buf, 5, 0, false);
-      uart_puts(uart1, local_buf); 
+      uart_link.puts(local_buf); 
       status = 1;
       break;
 
@@ -302,17 +581,17 @@ void CommandDecoder::decode_bat_command(uint8_t pnt) {
 
   switch (status) {
     case 0: 
-     uart_puts(uart1, PROMPT_OK);
+     uart_link.puts(PROMPT_OK);
      break;
     case 1:
       break;
     case 2:
-      uart_puts(uart1, "Battery command not recognized: ");
-      uart_puts(uart1, buf);
+      uart_link.puts("Battery command not recognized: ");
+      uart_link.puts(buf);
     default:
       break;
   }
-  uart_puts(uart1, "\r\n");
+  uart_link.puts("\r\n");
 }
 
 
@@ -343,34 +622,44 @@ void CommandDecoder::decode_display_command(uint8_t pnt) {
   
   switch (status) {
     case 0: 
-     uart_puts(uart1, PROMPT_OK);
+     uart_link.puts(PROMPT_OK);
      break;
     case 1:
       break;
     case 2:
-      uart_puts(uart1, "Config command not recognized: ");
-      uart_puts(uart1, buf);
+      uart_link.puts("Config command not recognized: ");
+      uart_link.puts(buf);
     default:
       break;
   }
-    uart_puts(uart1, "\r\n");
+    uart_link.puts("\r\n");
 }
 
 //-------------------------------------------------------------------------
 void CommandDecoder::decode_motor_command(uint8_t pnt) {
-  int32_t a, b;
+  int32_t a, b, c;
   uint8_t status = 0;   // 0 -> okay, 1 -> okay, no prompt, 2 -> error
   extern Motors motors;
-  extern LCD_Display display;
+  extern Odometry odo;
 
   switch (buf[pnt]) {
 
+    case 'a':                                 // drive an arc: length, radius in mm
+    case 'A':
+      pnt += 1;
+      a = get_int(&pnt);
+      b = get_int(&pnt);
+      if (a < VALID_LIMIT) {
+        motors.submit(MOP_ARC, a, (b < VALID_LIMIT) ? b : 0);
+      }
+      break;
+
     case 'c':                                 // run a defined number of steps
     case 'C':
       pnt += 1;
       a = get_int(&pnt); 
       if (a < VALID_LIMIT) {
-        motors.run_defined_steps(a);
+        motors.submit(MOP_DEFINED_STEPS, a);
       }
       break;
 
@@ -380,10 +669,10 @@ void CommandDecoder::decode_motor_command(uint8_t pnt) {
       a = get_int(&pnt);    
       b = get_int(&pnt);
       if (a < VALID_LIMIT) {
-        motors.set_a_dir(a > 0);
+        motors.submit(MOP_DIR_A, a > 0);
       }
       if (b < VALID_LIMIT) {
-        motors.set_b_dir(b > 0);
+        motors.submit(MOP_DIR_B, b > 0);
       }     
       break;
     
@@ -393,30 +682,69 @@ void CommandDecoder::decode_motor_command(uint8_t pnt) {
       a = get_int(&pnt);    
       b = get_int(&pnt);
       if (a < VALID_LIMIT) {
-        motors.set_a_enable(a > 0);
-        display.mot_a_enabled(motors.get_a_enabled());
+        motors.submit(MOP_ENABLE_A, a > 0);
       }
       if (b < VALID_LIMIT) {
-        motors.set_b_enable(b > 0);
-        display.mot_b_enabled(motors.get_b_enabled());
+        motors.submit(MOP_ENABLE_B, b > 0);
       }     
       break;
+
+    case 'l':
+    case 'L':                                 // coordinated move, signed steps of motor A and B
+      pnt += 1;
+      a = get_int(&pnt);    
+      b = get_int(&pnt);
+      if ((a < VALID_LIMIT) && (b < VALID_LIMIT)) {
+        motors.submit(MOP_SEGMENT, a, b);
+      } else {
+        uart_link.puts("Steps for both motors required!\r\n");
+        status = 1;
+      }
+      break;
       
+    case 'o':
+    case 'O':                                 // reset the pose (odometry)
+      odo.reset();
+      break;
+
     case 'p':
     case 'P':                                 // power
       pnt += 1;
       a = get_int(&pnt);    
       b = get_int(&pnt);
       if (a < VALID_LIMIT) {
-        motors.set_a_power(a > 0);
-        display.mot_a_power(motors.get_a_power());
+        motors.submit(MOP_POWER_A, a > 0);
       }
       if (b < VALID_LIMIT) {
-        motors.set_b_power(b > 0);
-        display.mot_b_power(motors.get_b_power());
+        motors.submit(MOP_POWER_B, b > 0);
       }     
       break;
 
+    case 'q':
+    case 'Q':                         // queue a segment: signed steps of motor A and B, speed
+      pnt += 1;
+      a = get_int(&pnt);    
+      b = get_int(&pnt);
+      c = get_int(&pnt);
+      if ((a >= VALID_LIMIT) && (b >= VALID_LIMIT)) {
+        uart_link.put_int(motors.get_queue_count());      // no parameters: number of queued segments
+        uart_link.puts("\r\n");
+        status = 1;
+      } else if ((a < VALID_LIMIT) && (b < VALID_LIMIT)) {
+        if (c >= VALID_LIMIT) c = motors.get_defined_steps_speed();
+        if (motors.is_batching()) {               // the result would split the batch
+          uart_link.puts("Not in a batch!\r\n");
+          status = 1;
+        } else if (!motors.wait_result(motors.submit(MOP_QUEUE, a, b, c))) {
+          uart_link.puts("Segment queue full!\r\n");
+          status = 1;
+        }
+      } else {
+        uart_link.puts("Steps for both motors required!\r\n");
+        status = 1;
+      }
+      break;
+
     case 'r':
     case 'R':                         // runs the motor at a given speed
       pnt += 1;
@@ -424,30 +752,22 @@ void CommandDecoder::decode_motor_command(uint8_t pnt) {
       b = get_int(&pnt);
       if (a < VALID_LIMIT) {
         if (a <= RPM_MAX) {
-          motors.set_a_rpm(a);
-          display.mot_a_rpm(motors.get_a_rpm());
-          display.mot_a_enabled(motors.get_a_enabled()); 
-          display.mot_a_power(motors.get_a_power());
+          motors.submit(MOP_RPM_A, a);
         } else {
-          uart_puts(uart1, "Motor RPM A out of range! (max ");
-          itoa(RPM_MAX, local_buf, 10);
-          uart_puts(uart1, local_buf);
-          uart_puts(uart1, ")\r\n");
+          uart_link.puts("Motor RPM A out of range! (max ");
+          uart_link.put_int(RPM_MAX);
+          uart_link.puts(")\r\n");
           status = 1;
           status = 1;
         }
       };
       if (b < VALID_LIMIT) {
         if (b <= RPM_MAX) {
-          motors.set_b_rpm(b);
-          display.mot_b_rpm(motors.get_b_rpm());
-          display.mot_b_enabled(motors.get_b_enabled()); 
-          display.mot_b_power(motors.get_b_power());
+          motors.submit(MOP_RPM_B, b);
         } else {
-          uart_puts(uart1, "Motor RPM B out of range! (max ");
-          itoa(RPM_MAX, local_buf, 10);
-          uart_puts(uart1, local_buf);
-          uart_puts(uart1, ")\r\n");
+          uart_link.puts("Motor RPM B out of range! (max ");
+          uart_link.put_int(RPM_MAX);
+          uart_link.puts(")\r\n");
           status = 1;
         }
       };
@@ -458,13 +778,22 @@ void CommandDecoder::decode_motor_command(uint8_t pnt) {
       pnt += 1;
       a = get_int(&pnt);    
       if (a < VALID_LIMIT) {
-        motors.set_defined_steps_speed(a);
+        motors.submit(MOP_STEPS_SPEED, a);
       } else {
-        uart_puts(uart1, "Defined steps speed out of range!");
-        uart_puts(uart1, ")\r\n");
+        uart_link.puts("Defined steps speed out of range!");
+        uart_link.puts(")\r\n");
         status = 1;
       };
       break;    
+
+    case 't':
+    case 'T':                         // turn on the spot, degrees counter-clockwise
+      pnt += 1;
+      a = get_int(&pnt);    
+      if (a < VALID_LIMIT) {
+        motors.submit(MOP_TURN, a);
+      }
+      break;
       
     default:
       status = 2;
@@ -472,15 +801,15 @@ void CommandDecoder::decode_motor_command(uint8_t pnt) {
   
   switch (status) {
     case 0: 
-     uart_puts(uart1, PROMPT_OK);
-     uart_puts(uart1, "\r\n");
+     uart_link.puts(PROMPT_OK);
+     uart_link.puts("\r\n");
      break;
     case 1:
       break;
     case 2:
-      uart_puts(uart1, "Motor command not recognized: ");
-      uart_puts(uart1, buf);
-      uart_puts(uart1, "\r\n");
+      uart_link.puts("Motor command not recognized: ");
+      uart_link.puts(buf);
+      uart_link.puts("\r\n");
     default:
       break;
   }
@@ -488,12 +817,66 @@ void CommandDecoder::decode_motor_command(uint8_t pnt) {
 
 
 //-------------------------------------------------------------------------
+// decode_command
+// A line may start with a sequence tag "#<seq> ", the replies then carry
+// the same tag, so the Raspberry Pi can send further commands before the
+// reply arrives. A line may hold several commands separated by ';', e.g.
+// "MD1,0;MR100,100". The motor commands of such a line are executed
+// together (no step in between) and the replies are returned in one line,
+// separated by ';'.
 void CommandDecoder::decode_command(void) {
+  char line[BUF_SIZE];
+  char *cmd_start, *cmd_end;
+  uint8_t pnt = 1;
+  uint32_t seq = 0;
+  extern Motors motors;
+
+  if (buf[0] == CMD_TAG) {
+    while ((buf[pnt] >= '0') && (buf[pnt] <= '9')) {
+      seq = seq * 10 + buf[pnt] - '0';
+      pnt += 1;
+    }
+    while (buf[pnt] == ' ') pnt += 1;
+    memmove(buf, buf + pnt, strlen(buf + pnt) + 1);
+    uart_link.begin_tag(seq);
+  }
+
+  if (strchr(buf, CMD_SEPARATOR) == NULL) {
+    decode_single_command();
+    uart_link.end_tag();
+    return;
+  }
+  strcpy(line, buf);
+  motors.begin_batch();
+  uart_link.begin_join();
+  cmd_start = line;
+  while (cmd_start != NULL) {
+    cmd_end = strchr(cmd_start, CMD_SEPARATOR);
+    if (cmd_end != NULL) *cmd_end++ = '\0';
+    while (*cmd_start == ' ') cmd_start += 1;
+    if (*cmd_start != '\0') {
+      strcpy(buf, cmd_start);
+      decode_single_command();
+    }
+    cmd_start = cmd_end;
+  }
+  motors.end_batch();
+  uart_link.end_join();
+  uart_link.end_tag();
+  buf[0] = '\0';
+}
+
+
+//-------------------------------------------------------------------------
+void CommandDecoder::decode_single_command(void) {
   uint8_t pnt = 0;
+  int32_t a;
+  bool valid = true;
+  extern Telemetry telemetry;
 
   while (buf[pnt] == ' ') pnt += 1;     // skip leading blanks
   if (strlen(buf+pnt) == 0) {
-    uart_puts(uart1, "\r\n");
+    uart_link.puts("\r\n");
     return;
   }
   
@@ -523,13 +906,29 @@ void CommandDecoder::decode_command(void) {
       decode_motor_command(pnt+1);
       break;
 
+    case 't':   // telemetry: T<hz> (1 ... 100, 0 -> off), "T" returns the rate
+    case 'T':
+      pnt += 1;
+      a = get_int(&pnt);
+      if (a == VALID_LIMIT) {
+        uart_link.put_uint(telemetry.get_rate());
+      } else if ((a == 0) || ((a >= TELEMETRY_HZ_MIN) && (a <= TELEMETRY_HZ_MAX))) {
+        telemetry.set_rate(a);
+        uart_link.puts(PROMPT_OK);
+      } else {
+        uart_link.puts("Telemetry rate out of range! (1 ... 100, 0 -> off)");
+      }
+      uart_link.puts("\r\n");
+      break;
+
     case 'p':   // ping
     case 'P':
     case 'x':
     case 'X':
-      // send a ping
-      uart_puts(uart1, PROMPT_OK);
-      uart_puts(uart1, "\r\n");
+      // send a ping, confirms a new baud rate
+      uart_link.confirm_baud();
+      uart_link.puts(PROMPT_OK);
+      uart_link.puts("\r\n");
       break;
 
     case 'i':
@@ -538,10 +937,12 @@ void CommandDecoder::decode_command(void) {
       break;
 
     default:
-	  uart_puts(uart1, "Not recognized: ");
-      uart_puts(uart1, buf);
-      uart_puts(uart1, "\r\n");
+	  uart_link.puts("Not recognized: ");
+      uart_link.puts(buf);
+      uart_link.puts("\r\n");
+      valid = false;
   }  
+  if (valid) uart_link.rx_valid();      // the baud rate is fine
 
   buf[0] = '\0';
 }    
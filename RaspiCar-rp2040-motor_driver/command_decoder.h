@@ -5,9 +5,15 @@
 #include "motors.h"
 #include "display.h"
 #include "battery.h"
+#include "odometry.h"
+#include "frame_decoder.h"
+#include "serial_link.h"
+#include "telemetry.h"
 
 #define BUF_SIZE 100
 #define VALID_LIMIT 999999
+#define CMD_SEPARATOR ';'     // commands of a batch line
+#define CMD_TAG '#'           // sequence tag: "#<seq> <command>", the reply lines start with "#<seq> "
 
 class CommandDecoder {
 	private:
@@ -16,16 +22,23 @@ class CommandDecoder {
 		char local_buf[12];
 		int32_t get_int(uint8_t *pnt);
 		void show_info(void);
+		void send_link_stats(void);
+		void send_perf_stats(bool reset);
 		void decode_motor_command(uint8_t pnt);
 		void decode_get_command(uint8_t pnt);
 		void decode_bat_command(uint8_t pnt);
 		void decode_display_command(uint8_t pnt);
 		void decode_config_command(uint8_t pnt); 
+		void decode_single_command(void);
+		friend class Bench;
 		
 	public:
 		void init(void);
 		bool add_to_buffer(char c);
+		uint32_t add_to_buffer(const char *s, uint32_t n, bool *complete);
 		void decode_command(void);
+		void send_pose(bool stream);
+		void send_telemetry(void);
 };
 
 #endif 
@@ -0,0 +1,164 @@
+#include "config_store.h"
+#include "motors.h"
+#include "trace.h"
+#include <stddef.h>
+
+#define CONFIG_SECTOR_SLOTS   ((int32_t) (FLASH_SECTOR_SIZE / CONFIG_RECORD_SIZE))
+
+extern uint8_t _FS_start;               // linker script: file system, followed by the EEPROM
+extern uint8_t __flash_binary_end;      // end of the program
+
+static_assert(sizeof(ConfigRecord) == CONFIG_RECORD_SIZE, "record size");
+static_assert(sizeof(ConfigData) <= sizeof(ConfigRecord::data), "config data too large");
+
+//-------------------------------------------------------------------------
+// Loads the newest valid record of the journal, the EEPROM of older
+// versions provides the fields the record does not have
+void ConfigStore::init(void) {
+  const ConfigRecord *rec;
+
+  base = (uintptr_t) &_FS_start - XIP_BASE - CONFIG_SECTORS * FLASH_SECTOR_SIZE;
+  load_eeprom();
+  if ((uintptr_t) &__flash_binary_end - XIP_BASE > base) {
+    Serial.println("Config: program overlaps the journal");
+    base = 0;
+    return;
+  }
+  for (int32_t n = 0; n < CONFIG_SLOTS; n++) {
+    rec = get_record(n);
+    if (is_valid(rec) && ((slot < 0) || (rec->seq > seq))) {
+      slot = n;
+      seq = rec->seq;
+    }
+  }
+  if (slot < 0) {
+    dirty = true;                       // first start: save the EEPROM settings
+  } else {
+    rec = get_record(slot);
+    memcpy(&data, rec->data, min((size_t) rec->size, sizeof(data)));
+  }
+}
+
+//-------------------------------------------------------------------------
+// Settings of the EEPROM (older versions), the ranges are checked by the
+// modules. The accel falls back to the ramp of the first versions.
+void ConfigStore::load_eeprom(void) {
+  uint8_t ramp;
+
+  data.motor_accel = EEPROM.read(EEPROM_BASE_ADDR + EEPROM_MOTOR_ACCEL) +
+                     EEPROM.read(EEPROM_BASE_ADDR + EEPROM_MOTOR_ACCEL + 1) * 256;
+  if ((data.motor_accel < MOT_ACCEL_MIN) || (data.motor_accel > MOT_ACCEL_MAX)) {
+    ramp = EEPROM.read(EEPROM_BASE_ADDR + EEPROM_MOTOR_RAMP);
+    if ((ramp > 1) && (ramp < 50)) data.motor_accel = ramp * RAMP_ACCEL_FACTOR;
+  }
+  data.motor_jerk = EEPROM.read(EEPROM_BASE_ADDR + EEPROM_MOTOR_JERK) +
+                    EEPROM.read(EEPROM_BASE_ADDR + EEPROM_MOTOR_JERK + 1) * 256;
+  data.bat_slope = EEPROM.read(EEPROM_BASE_ADDR + EEPROM_BAT_SLOPE) +
+                   EEPROM.read(EEPROM_BASE_ADDR + EEPROM_BAT_SLOPE + 1) * 256;
+  data.bat_intercept = EEPROM.read(EEPROM_BASE_ADDR + EEPROM_BAT_INTERCEPT) +
+                       EEPROM.read(EEPROM_BASE_ADDR + EEPROM_BAT_INTERCEPT + 1) * 256;
+  data.defined_steps_speed = EEPROM.read(EEPROM_BASE_ADDR + EEPROM_DEFINED_STEPS_SPEED);
+  data.serial_baud = EEPROM.read(EEPROM_BASE_ADDR + EEPROM_SERIAL_BAUD);
+}
+
+//-------------------------------------------------------------------------
+const ConfigRecord *ConfigStore::get_record(int32_t n) {
+  return (const ConfigRecord *) (XIP_BASE + base + n * CONFIG_RECORD_SIZE);
+}
+
+//-------------------------------------------------------------------------
+bool ConfigStore::is_valid(const ConfigRecord *rec) {
+  if ((rec->magic != CONFIG_MAGIC) || (rec->version == 0) || (rec->size > sizeof(rec->data))) return false;
+  return crc16_ccitt((const uint8_t *) rec, offsetof(ConfigRecord, crc), 0xFFFF) == rec->crc;
+}
+
+//-------------------------------------------------------------------------
+// An erased slot can be programmed
+bool ConfigStore::is_blank(int32_t n) {
+  const uint32_t *p = (const uint32_t *) get_record(n);
+
+  for (uint8_t i = 0; i < CONFIG_RECORD_SIZE / 4; i++) {
+    if (p[i] != 0xFFFFFFFF) return false;
+  }
+  return true;
+}
+
+//-------------------------------------------------------------------------
+// A setting has changed, it is saved by run() or save()
+void ConfigStore::changed(void) {
+  dirty = true;
+}
+
+//-------------------------------------------------------------------------
+bool ConfigStore::is_dirty(void) {
+  return dirty;
+}
+
+//-------------------------------------------------------------------------
+// Appends a record to the journal. The first slot of a sector erases the
+// sector first. A slot written partially (reset during a write) cannot be
+// programmed, the journal continues with the next sector. The other
+// records of the page are programmed with 0xFF and keep their bits. The
+// main loop stalls for about 1 ms (program) or 50 ms (erase and program),
+// the step interrupt runs from RAM (Motors::flash_begin()).
+bool ConfigStore::save(void) {
+  extern Motors motors;
+  ConfigRecord rec;
+  uint8_t page[FLASH_PAGE_SIZE];
+  uint32_t offset, page_offset;
+  int32_t n = (slot + 1) % CONFIG_SLOTS;
+  bool erase;
+
+  if (base == 0) return false;
+  erase = (n % CONFIG_SECTOR_SLOTS) == 0;
+  if (!erase && !is_blank(n)) {
+    n = ((n / CONFIG_SECTOR_SLOTS + 1) * CONFIG_SECTOR_SLOTS) % CONFIG_SLOTS;
+    erase = true;
+  }
+  memset(&rec, 0xFF, sizeof(rec));
+  rec.magic = CONFIG_MAGIC;
+  rec.seq = seq + 1;
+  rec.version = CONFIG_VERSION;
+  rec.size = sizeof(data);
+  memcpy(rec.data, &data, sizeof(data));
+  rec.crc = crc16_ccitt((const uint8_t *) &rec, offsetof(ConfigRecord, crc), 0xFFFF);
+
+  offset = base + n * CONFIG_RECORD_SIZE;
+  page_offset = offset & ~(FLASH_PAGE_SIZE - 1);
+  memset(page, 0xFF, sizeof(page));
+  memcpy(page + (offset - page_offset), &rec, sizeof(rec));
+
+  TRACE_BEGIN(TRACE_CONFIG);
+  motors.flash_begin();
+  if (erase) flash_range_erase(offset & ~(FLASH_SECTOR_SIZE - 1), FLASH_SECTOR_SIZE);
+  flash_range_program(page_offset, page, FLASH_PAGE_SIZE);
+  motors.flash_end();
+  TRACE_END(TRACE_CONFIG);
+
+  // the slot is used in any case, a failed write is not repeated by run()
+  slot = n;
+  seq = rec.seq;
+  dirty = false;
+  if (memcmp(get_record(n), &rec, sizeof(rec)) != 0) return false;
+  saves += 1;
+  return true;
+}
+
+//-------------------------------------------------------------------------
+// Called by the main loop: saves the changes while both motors stand still
+void ConfigStore::run(void) {
+  extern Motors motors;
+
+  motors.update_config();
+  if (dirty && motors.is_stopped()) save();
+}
+
+//-------------------------------------------------------------------------
+uint32_t ConfigStore::get_saves(void) {
+  return saves;
+}
+
+//-------------------------------------------------------------------------
+uint32_t ConfigStore::get_seq(void) {
+  return seq;
+}
@@ -0,0 +1,66 @@
+#ifndef __CONFIG_STORE__
+#define __CONFIG_STORE__
+
+#include "RaspiCar-rp2040-motor_driver.h"
+#include "hardware/flash.h"
+
+#define CONFIG_VERSION         1
+#define CONFIG_MAGIC  0x31474643  // "CFG1"
+#define CONFIG_SECTORS         4  // flash sectors of the journal, below the file system and EEPROM
+#define CONFIG_RECORD_SIZE    64  // bytes per record, 64 records per sector
+#define CONFIG_SLOTS          ((int32_t) (CONFIG_SECTORS * FLASH_SECTOR_SIZE / CONFIG_RECORD_SIZE))
+#define CONFIG_BAUD_DEFAULT 0xFF  // serial_baud: no rate saved
+
+// Settings. New fields are appended, a record of an older version keeps
+// the defaults of the new fields.
+struct ConfigData {
+  uint16_t motor_accel;                 // RPM/s
+  uint16_t motor_jerk;                  // RPM/s^2, 0 -> trapezoidal profile
+  uint16_t bat_slope;
+  uint16_t bat_intercept;
+  uint8_t defined_steps_speed;          // RPM of MC
+  uint8_t serial_baud;                  // index of serial_baud_rates
+};
+
+// Record of the journal, one slot
+struct ConfigRecord {
+  uint32_t magic;
+  uint32_t seq;                         // the valid record with the highest seq is current
+  uint16_t version;
+  uint16_t size;                        // bytes of ConfigData of the writer
+  uint8_t data[CONFIG_RECORD_SIZE - 14];
+  uint16_t crc;                         // CRC-16 of the bytes before
+};
+
+// Configuration in a wear leveled journal in flash. Each save appends a
+// record to the next slot of the journal (one page program), a sector is
+// erased only when the journal wraps into it, after the 64 records of the
+// previous sector. The newest valid record is loaded at start, so an
+// interrupted write leaves the record before. Flash writes stall the main
+// loop, the setters only mark the configuration as changed; it is saved
+// by the main loop while both motors stand still, or by "CW".
+// Without a record, the settings of the EEPROM of older versions are taken.
+class ConfigStore {
+  private:
+    uint32_t base = 0;                  // flash offset of the journal
+    int32_t slot = -1;                  // slot of the current record, -1 -> none
+    uint32_t seq = 0;
+    bool dirty = false;
+    uint32_t saves = 0;
+    const ConfigRecord *get_record(int32_t n);
+    bool is_valid(const ConfigRecord *rec);
+    bool is_blank(int32_t n);
+    void load_eeprom(void);
+
+  public:
+    ConfigData data;
+    void init(void);
+    void changed(void);
+    bool is_dirty(void);
+    bool save(void);
+    void run(void);
+    uint32_t get_saves(void);
+    uint32_t get_seq(void);
+};
+
+#endif
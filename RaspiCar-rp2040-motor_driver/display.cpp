@@ -1,22 +1,24 @@
 #include <arduino.h>
 #include "display.h"
+#include "trace.h"
 
 PicoLCD_I2C lcd(0, 0x27, LCD_SDA, LCD_SCL, 20, 400000);
 
 // -----------------------------------------------------------------------------------------
 void LCD_Display::init(void) {
-  mot_a_is_power = true;
-  mot_a_is_enabled = true;
-  mot_b_is_power = true;
-  mot_b_is_enabled = true;
   char msg[21];
 
   strcpy(msg, "RaspiCar MotDr ");
   itoaf(SOFTWARE_VERSION, msg+15, 3, 2, false);
   msg[15] = 'V';
   
-  lcd.begin();
-  lcd.print(msg);
+  lcd.begin();                    // clears the panel
+  memset(fb, ' ', sizeof(fb));
+  memset(shown, ' ', sizeof(shown));
+  frame_start = time_us_32() - LCD_FRAME_US;
+  set_cursor(0, 0);
+  print(msg);
+  flush();
   delay(100);
   mot_a_power(false);
   mot_a_enabled(false);
@@ -24,59 +26,104 @@ void LCD_Display::init(void) {
   mot_b_power(false);
   mot_b_enabled(false);
   mot_b_rpm(0);
-  lcd.setCursor(19, 3);
-  lcd.write('V');
+  set_cursor(19, 3);
+  write('V');
+  flush();
 }
 
 // -----------------------------------------------------------------------------------------
-void LCD_Display::mot_a_enabled(bool state) {
-  if (state != mot_a_is_enabled) {
-    lcd.setCursor(LCD_X_MOTA_E, 3);
-    if (state) lcd.write('*');
-    else lcd.write('-');
-    mot_a_is_enabled = state;
+// Starts the transfer of the changed cells, called by the main loop. Not 
+// while the last frame is on the bus and not before LCD_FRAME_US.
+void LCD_Display::flush(void) {
+  uint8_t x, start, end;
+  uint8_t *p = tx;
+  uint32_t now;
+
+  if (!dirty || lcd.busy()) return;
+  now = time_us_32();
+  if (now - frame_start < LCD_FRAME_US) return;
+  TRACE_BEGIN(TRACE_LCD);
+  dirty = false;
+  for (uint8_t y = 0; (y < LCD_ROWS) && !dirty; y++) {
+    x = 0;
+    while (x < LCD_COLS) {
+      if (fb[y][x] == shown[y][x]) {
+        x++;
+        continue;
+      }
+      start = x;
+      end = x + 1;
+      for (x = x + 1; x < LCD_COLS; x++) {
+        if (fb[y][x] != shown[y][x]) end = x + 1;
+        else if (x - end >= LCD_RUN_GAP) break;
+      }
+      if (p + LCD_RUN_BYTES(end - start) > tx + sizeof(tx)) {
+        dirty = true;               // frame full, the rest follows
+        break;
+      }
+      p = lcd.encodeAt(p, start, y, fb[y] + start, end - start);
+      memcpy(shown[y] + start, fb[y] + start, end - start);
+      x = end;
+    }
+  }
+  if (p > tx) {
+    lcd.writeAsync(tx, p - tx);
+    frame_start = now;
   }
+  TRACE_END(TRACE_LCD);
+}
+
+// -----------------------------------------------------------------------------------------
+void LCD_Display::set_cursor(uint8_t x, uint8_t y) {
+  cur_x = x;
+  cur_y = y;
+}
+
+// -----------------------------------------------------------------------------------------
+void LCD_Display::write(char c) {
+  if (cur_x >= LCD_COLS) return;
+  fb[cur_y][cur_x++] = c;
+  dirty = true;
+}
+
+// -----------------------------------------------------------------------------------------
+void LCD_Display::print(const char *s) {
+  while (*s) write(*s++);
+}
+
+// -----------------------------------------------------------------------------------------
+void LCD_Display::mot_a_enabled(bool state) {
+  set_cursor(LCD_X_MOTA_E, 3);
+  write(state ? '*' : '-');
 }
 
 // -----------------------------------------------------------------------------------------
 void LCD_Display::mot_b_enabled(bool state) {
-  if (state != mot_b_is_enabled) {
-    lcd.setCursor(LCD_X_MOTB_E, 3);
-    if (state) lcd.write('*');
-    else lcd.write('-');
-    mot_b_is_enabled = state;
-  }
+  set_cursor(LCD_X_MOTB_E, 3);
+  write(state ? '*' : '-');
 }
 
 // -----------------------------------------------------------------------------------------
 void LCD_Display::mot_a_power(bool state) {
-  if (state != mot_a_is_power) {
-    lcd.setCursor(LCD_X_MOTA_P, 3);
-    if (state) lcd.write('*');
-    else lcd.write('-');
-    mot_a_is_power = state;
-  }
+  set_cursor(LCD_X_MOTA_P, 3);
+  write(state ? '*' : '-');
 }
 
 // -----------------------------------------------------------------------------------------
 void LCD_Display::mot_b_power(bool state) {
-  if (state != mot_b_is_power) {
-    lcd.setCursor(LCD_X_MOTB_P, 3);
-    if (state) lcd.write('*');
-    else lcd.write('-');
-    mot_b_is_power = state;
-  }
+  set_cursor(LCD_X_MOTB_P, 3);
+  write(state ? '*' : '-');
 }
 
 // -----------------------------------------------------------------------------------------
 void LCD_Display::mot_a_rpm(uint32_t rpm) {
-  lcd.setCursor(LCD_X_MOTA_RPM, 3);
+  set_cursor(LCD_X_MOTA_RPM, 3);
   print_dec(rpm);
 }
 
 // -----------------------------------------------------------------------------------------
 void LCD_Display::mot_b_rpm(uint32_t rpm) {
-  lcd.setCursor(LCD_X_MOTB_RPM, 3);
+  set_cursor(LCD_X_MOTB_RPM, 3);
   print_dec(rpm);
 }
 
@@ -84,69 +131,60 @@ void LCD_Display::mot_b_rpm(uint32_t rpm) {
 
 void LCD_Display::print_dec(int n) {
   char local_buf[5];
-  if (n < 1000) lcd.write(' ');
-  if (n < 100) lcd.write(' ');
-  if (n < 10) lcd.write(' ');
+  if (n < 1000) write(' ');
+  if (n < 100) write(' ');
+  if (n < 10) write(' ');
   itoa(n, local_buf, 10);
-  lcd.print(local_buf);
+  print(local_buf);
 }
 
 //-------------------------------------------------------------------------
 void LCD_Display::show_voltage(uint16_t bat_voltage) {
   char buf[8];
-  lcd.setCursor(LCD_X_BAT_VOLTAGE, 3);
-  if (bat_voltage < 900) lcd.print(" < 9");
+  set_cursor(LCD_X_BAT_VOLTAGE, 3);
+  if (bat_voltage < 900) print(" < 9");
   else {
     itoaf(bat_voltage / 10, buf, 3, 1, false);
-    lcd.print(buf);
+    print(buf);
   }
 }
 
 //-------------------------------------------------------------------------
 void LCD_Display::shutdown(void) {
-  lcd.setCursor(0, 0);
-  lcd.print("Shut down ...       ");
+  set_cursor(0, 0);
+  print("Shut down ...       ");
 }
 
 //-------------------------------------------------------------------------
 void LCD_Display::shutdown_timer(int i) {
-  lcd.setCursor(16, 0);
+  set_cursor(16, 0);
   print_dec(i);
 }
 
 //-------------------------------------------------------------------------
 void LCD_Display::clear(void) {
-  lcd.setCursor(0, 0);
-  lcd.print("                    ");
-  lcd.setCursor(0, 1);
-  lcd.print("                    ");
-  lcd.setCursor(0, 2);
-  lcd.print("                    ");
+  memset(fb, ' ', 3 * LCD_COLS);
+  dirty = true;
 }
 
 //-------------------------------------------------------------------------
 void LCD_Display::print_title(const char buf[]) {
   int l = strlen(buf);
-  lcd.setCursor(0, 0);
-  for (int i = 0; i < 20; ++i) {
-    if (i < l) lcd.write(buf[i]);
-    else lcd.write(' ');
+  set_cursor(0, 0);
+  for (int i = 0; i < LCD_COLS; ++i) {
+    if (i < l) write(buf[i]);
+    else write(' ');
   }
 }
 
 //-------------------------------------------------------------------------
 void LCD_Display::print_msg(const char buf[]) {
   int l = strlen(buf);
-  lcd.setCursor(0, 1);
-  lcd.print("                    ");
-  lcd.setCursor(0, 2);
-  lcd.print("                    ");
-  lcd.setCursor(0, 1);
-  if (l > 20) {
-    for (int i = 0; i < 20; ++i) lcd.write(buf[i]);
-    lcd.setCursor(0, 2);
-    for (int i = 0; i < l - 20; ++i) lcd.write(buf[i+20]);
-  } else {
-    lcd.print(buf);
+  memset(fb[1], ' ', 2 * LCD_COLS);
+  set_cursor(0, 1);
+  for (int i = 0; (i < l) && (i < 2 * LCD_COLS); ++i) {
+    if (i == LCD_COLS) set_cursor(0, 2);
+    write(buf[i]);
   }
+  dirty = true;
 }
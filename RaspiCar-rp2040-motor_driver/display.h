@@ -18,14 +18,33 @@
 #define LCD_X_MOTB_RPM     9
 #define LCD_X_BAT_VOLTAGE 14
 
+#define LCD_ROWS           4
+#define LCD_COLS          20
+#define LCD_RUN_GAP        1  // unchanged cells rewritten to join two runs (cheaper than a new address)
+#define LCD_FRAME_US   40000  // min time between two frames (25 Hz)
+#define LCD_TX_SIZE      256  // I2C bytes of a frame, more changes follow in the next frame
+
+// The functions write into a framebuffer, flush() sends the cells that
+// differ from the panel content to the display, a run of cells in one I2C
+// transfer. Unchanged fields (e.g. the RPM after each MR) cost no I2C time.
+// The frames are sent by the I2C interrupt at a bounded rate, changes in
+// between are coalesced in the framebuffer. No caller waits for the bus.
 class LCD_Display {
   private:
-    bool mot_a_is_power, mot_b_is_power;
-    bool mot_a_is_enabled, mot_b_is_enabled;
+    char fb[LCD_ROWS][LCD_COLS];              // content to be shown
+    char shown[LCD_ROWS][LCD_COLS];           // content of the panel (sent or on the bus)
+    uint8_t tx[LCD_TX_SIZE];                  // frame on the bus
+    uint32_t frame_start = 0;
+    uint8_t cur_x = 0, cur_y = 0;
+    bool dirty = false;
+    void set_cursor(uint8_t x, uint8_t y);
+    void write(char c);
+    void print(const char *s);
     void print_dec(int n);
     
   public:
     void init(void);
+    void flush(void);
     void mot_a_enabled(bool state);
     void mot_b_enabled(bool state);
     void mot_a_power(bool state);
@@ -0,0 +1,358 @@
+#include "frame_decoder.h"
+#include "perf.h"
+
+//-------------------------------------------------------------------------
+static uint16_t get_u16(const uint8_t *p) {
+  return p[0] | (p[1] << 8);
+}
+
+//-------------------------------------------------------------------------
+static int32_t get_i32(const uint8_t *p) {
+  return (int32_t) (p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24));
+}
+
+//-------------------------------------------------------------------------
+void FrameDecoder::init(void) {
+  active = false;
+  state = FRX_SYNC;
+}
+
+//-------------------------------------------------------------------------
+void FrameDecoder::set_active(bool status) {
+  active = status;
+  state = FRX_SYNC;
+}
+
+//-------------------------------------------------------------------------
+bool FrameDecoder::is_active(void) {
+  return active;
+}
+
+//-------------------------------------------------------------------------
+uint32_t FrameDecoder::get_crc_errors(void) {
+  return crc_errors;
+}
+
+//-------------------------------------------------------------------------
+// add_byte
+// Receiver state machine, constant time per byte. Returns true if a frame
+// with a valid CRC is complete. Bad frames are answered by FERR_CRC, the
+// receiver then hunts for the next sync byte.
+bool FrameDecoder::add_byte(uint8_t c) {
+  switch (state) {
+    case FRX_SYNC:
+      if (c == FRAME_SYNC) state = FRX_LEN;
+      break;
+
+    case FRX_LEN:
+      if ((c == 0) || (c > FRAME_PAYLOAD_MAX + 1)) {
+        state = (c == FRAME_SYNC) ? FRX_LEN : FRX_SYNC;
+        break;
+      }
+      len = c;
+      pnt = 0;
+      crc = crc16_ccitt(&c, 1, 0xFFFF);
+      state = FRX_DATA;
+      break;
+
+    case FRX_DATA:
+      data[pnt++] = c;
+      crc = crc16_ccitt(&c, 1, crc);
+      if (pnt >= len) state = FRX_CRC_LO;
+      break;
+
+    case FRX_CRC_LO:
+      crc_rx = c;
+      state = FRX_CRC_HI;
+      break;
+
+    case FRX_CRC_HI:
+      crc_rx |= c << 8;
+      state = FRX_SYNC;
+      if (crc_rx == crc) return true;
+      crc_errors += 1;
+      send_error(0, FERR_CRC);
+      break;
+
+    default:
+      state = FRX_SYNC;
+  }
+  return false;
+}
+
+//-------------------------------------------------------------------------
+void FrameDecoder::reply_begin(uint8_t opcode) {
+  reply[0] = FRAME_SYNC;
+  reply[1] = 1;
+  reply[2] = opcode;
+  reply_len = 3;
+}
+
+//-------------------------------------------------------------------------
+void FrameDecoder::reply_u8(uint8_t v) {
+  if (reply_len < FRAME_PAYLOAD_MAX + 3) {
+    reply[reply_len++] = v;
+    reply[1] += 1;
+  }
+}
+
+//-------------------------------------------------------------------------
+void FrameDecoder::reply_u16(uint16_t v) {
+  reply_u8(v & 0xFF);
+  reply_u8(v >> 8);
+}
+
+//-------------------------------------------------------------------------
+void FrameDecoder::reply_u32(uint32_t v) {
+  reply_u16(v & 0xFFFF);
+  reply_u16(v >> 16);
+}
+
+//-------------------------------------------------------------------------
+void FrameDecoder::reply_send(void) {
+  extern SerialLink uart_link;
+  uint16_t c = crc16_ccitt(reply + 1, reply_len - 1, 0xFFFF);
+
+  reply[reply_len++] = c & 0xFF;
+  reply[reply_len++] = c >> 8;
+  uart_link.write(reply, reply_len);
+}
+
+//-------------------------------------------------------------------------
+void FrameDecoder::send_error(uint8_t opcode, uint8_t err) {
+  reply_begin(FOP_ERROR);
+  reply_u8(opcode);
+  reply_u8(err);
+  reply_send();
+}
+
+//-------------------------------------------------------------------------
+// Pose frame as FOP_GET_POSE reply, also used for the pose stream
+void FrameDecoder::send_pose(void) {
+  extern Odometry odo;
+
+  reply_begin(FOP_GET_POSE);
+  reply_u32(odo.get_x());
+  reply_u32(odo.get_y());
+  reply_u32(odo.get_heading());
+  reply_u32(odo.get_time());
+  reply_send();
+}
+
+//-------------------------------------------------------------------------
+// Telemetry frame, same content as the "$T" line
+void FrameDecoder::send_telemetry(void) {
+  int64_t pos_a, pos_b;
+  uint32_t loops, loop_max;
+  extern Battery bat;
+  extern Motors motors;
+  extern PerfCounters perf;
+
+  motors.get_position(&pos_a, &pos_b);
+  perf.take_loop_stats(&loops, &loop_max);
+  reply_begin(FOP_TELEMETRY);
+  reply_u16(bat.get_voltage());
+  reply_u8(bat.get_status());
+  reply_u16(motors.prof_a.get_rpm());
+  reply_u16(motors.prof_b.get_rpm());
+  reply_u32(pos_a);
+  reply_u32(pos_b);
+  reply_u8(motors.get_mode());
+  reply_u32(loops);
+  reply_u32(loop_max);
+  reply_send();
+}
+
+//-------------------------------------------------------------------------
+// decode_motor_frame
+// Motor opcodes, same operations and limits as the ASCII M commands.
+// Returns 0 or an error code.
+uint8_t FrameDecoder::decode_motor_frame(void) {
+  uint8_t n = len - 1;
+  const uint8_t *p = data + 1;
+  uint16_t a, b;
+  int32_t sa, sb;
+  extern Motors motors;
+
+  switch (data[0]) {
+    case FOP_ENABLE:
+      if (n != 2) return FERR_LENGTH;
+      if (p[0] != 0xFF) motors.submit(MOP_ENABLE_A, p[0] > 0);
+      if (p[1] != 0xFF) motors.submit(MOP_ENABLE_B, p[1] > 0);
+      break;
+
+    case FOP_POWER:
+      if (n != 2) return FERR_LENGTH;
+      if (p[0] != 0xFF) motors.submit(MOP_POWER_A, p[0] > 0);
+      if (p[1] != 0xFF) motors.submit(MOP_POWER_B, p[1] > 0);
+      break;
+
+    case FOP_DIR:
+      if (n != 2) return FERR_LENGTH;
+      if (p[0] != 0xFF) motors.submit(MOP_DIR_A, p[0] > 0);
+      if (p[1] != 0xFF) motors.submit(MOP_DIR_B, p[1] > 0);
+      break;
+
+    case FOP_RPM:
+      if (n != 4) return FERR_LENGTH;
+      a = get_u16(p);
+      b = get_u16(p + 2);
+      if (((a != 0xFFFF) && (a > RPM_MAX)) || ((b != 0xFFFF) && (b > RPM_MAX))) return FERR_RANGE;
+      if (a != 0xFFFF) motors.submit(MOP_RPM_A, a);
+      if (b != 0xFFFF) motors.submit(MOP_RPM_B, b);
+      break;
+
+    case FOP_DRIVE:
+      if (n != 4) return FERR_LENGTH;
+      sa = (int16_t) get_u16(p);
+      sb = (int16_t) get_u16(p + 2);
+      if ((abs(sa) > RPM_MAX) || (abs(sb) > RPM_MAX)) return FERR_RANGE;
+      motors.submit(MOP_DIR_A, sa >= 0);
+      motors.submit(MOP_DIR_B, sb >= 0);
+      motors.submit(MOP_RPM_A, abs(sa));
+      motors.submit(MOP_RPM_B, abs(sb));
+      break;
+
+    case FOP_MOVE:
+      if (n != 8) return FERR_LENGTH;
+      motors.submit(MOP_SEGMENT, get_i32(p), get_i32(p + 4));
+      break;
+
+    case FOP_ARC:
+      if (n != 8) return FERR_LENGTH;
+      motors.submit(MOP_ARC, get_i32(p), get_i32(p + 4));
+      break;
+
+    case FOP_TURN:
+      if (n != 4) return FERR_LENGTH;
+      motors.submit(MOP_TURN, get_i32(p));
+      break;
+
+    case FOP_QUEUE:
+      if (n != 10) return FERR_LENGTH;
+      sa = get_i32(p);
+      sb = get_i32(p + 4);
+      if ((sa < -SEG_STEPS_MAX) || (sa > SEG_STEPS_MAX) || (sb < -SEG_STEPS_MAX) || (sb > SEG_STEPS_MAX)) {
+        return FERR_RANGE;
+      }
+      if (!motors.wait_result(motors.submit(MOP_QUEUE, sa, sb, get_u16(p + 8)))) {
+        return FERR_REJECTED;
+      }
+      break;
+
+    case FOP_SET_ACCEL:
+      if (n != 2) return FERR_LENGTH;
+      a = get_u16(p);
+      if ((a < MOT_ACCEL_MIN) || (a > MOT_ACCEL_MAX)) return FERR_RANGE;
+      motors.submit(MOP_ACCEL, a);
+      break;
+
+    case FOP_SET_JERK:
+      if (n != 2) return FERR_LENGTH;
+      a = get_u16(p);
+      if ((a != 0) && ((a < MOT_JERK_MIN) || (a > MOT_JERK_MAX))) return FERR_RANGE;
+      motors.submit(MOP_JERK, a);
+      break;
+
+    case FOP_SET_SPEED:
+      if (n != 2) return FERR_LENGTH;
+      a = get_u16(p);
+      if ((a < RPM_MIN) || (a > RPM_MAX)) return FERR_RANGE;
+      motors.submit(MOP_STEPS_SPEED, a);
+      break;
+
+    default:
+      return FERR_OPCODE;
+  }
+  return 0;
+}
+
+//-------------------------------------------------------------------------
+// decode_frame
+// Executes a received frame and sends the reply (opcode echo) or an
+// error frame.
+void FrameDecoder::decode_frame(void) {
+  uint8_t opcode = data[0];
+  uint8_t n = len - 1;
+  uint8_t err = 0;
+  char text[FRAME_PAYLOAD_MAX + 1];
+  extern Motors motors;
+  extern Battery bat;
+  extern LCD_Display display;
+  extern Odometry odo;
+  extern SerialLink uart_link;
+  extern Telemetry telemetry;
+
+  reply_begin(opcode);
+  switch (opcode) {
+    case FOP_PING:                        // confirms a new baud rate
+      uart_link.confirm_baud();
+      break;
+
+    case FOP_VERSION:
+      reply_u16(SOFTWARE_VERSION);
+      break;
+
+    case FOP_RESET_POSE:
+      odo.reset();
+      break;
+
+    case FOP_GET_MODE:
+      motors.sync();
+      reply_u8(motors.get_mode());
+      reply_u8(motors.get_queue_count());
+      break;
+
+    case FOP_GET_POSE:
+      odo.update();
+      send_pose();
+      return;
+
+    case FOP_GET_BAT:
+      reply_u16(bat.get_voltage());
+      reply_u8(bat.get_status());
+      break;
+
+    case FOP_SHUTDOWN:
+      display.print_msg("Shutting down");
+      bat.start_shutdown();
+      break;
+
+    case FOP_DISPLAY_CLEAR:
+      display.clear();
+      break;
+
+    case FOP_DISPLAY_TITLE:
+    case FOP_DISPLAY_MSG:
+      memcpy(text, data + 1, n);
+      text[n] = '\0';
+      if (opcode == FOP_DISPLAY_TITLE) display.print_title(text);
+      else display.print_msg(text);
+      break;
+
+    case FOP_SET_TELEMETRY:
+      if (n != 1) {
+        err = FERR_LENGTH;
+      } else if (data[1] > TELEMETRY_HZ_MAX) {
+        err = FERR_RANGE;
+      } else {
+        telemetry.set_rate(data[1]);
+      }
+      break;
+
+    case FOP_ASCII:
+      reply_send();
+      active = false;
+      return;
+
+    default:
+      err = decode_motor_frame();
+  }
+
+  if (err) {
+    send_error(opcode, err);
+  } else {
+    uart_link.rx_valid();
+    reply_send();
+  }
+}
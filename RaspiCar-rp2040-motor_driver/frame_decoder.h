@@ -0,0 +1,95 @@
+#ifndef __FRAME_DECODER__
+#define __FRAME_DECODER__
+
+#include "RaspiCar-rp2040-motor_driver.h"
+#include "motors.h"
+#include "display.h"
+#include "battery.h"
+#include "odometry.h"
+#include "serial_link.h"
+#include "telemetry.h"
+
+// Binary frame: sync, len, opcode, payload (little endian), CRC-16 (low byte
+// first). len counts opcode and payload, the CRC covers len ... payload.
+#define FRAME_SYNC          0xA5
+#define FRAME_PAYLOAD_MAX     48
+#define FRAME_OVERHEAD         5  // sync, len, opcode, CRC
+
+// Opcodes, replies echo the opcode with the reply payload
+#define FOP_PING            0x01  // -
+#define FOP_VERSION         0x02  // -> u16 version
+#define FOP_ENABLE          0x10  // u8 a, u8 b (0xFF -> unchanged)
+#define FOP_POWER           0x11  // u8 a, u8 b (0xFF -> unchanged)
+#define FOP_DIR             0x12  // u8 a, u8 b (0xFF -> unchanged)
+#define FOP_RPM             0x13  // u16 a, u16 b (0xFFFF -> unchanged)
+#define FOP_DRIVE           0x14  // i16 a, i16 b: RPM, sign -> direction
+#define FOP_MOVE            0x15  // i32 a, i32 b: signed steps (ML)
+#define FOP_ARC             0x16  // i32 length, i32 radius in mm (MA)
+#define FOP_TURN            0x17  // i32 degrees (MT)
+#define FOP_QUEUE           0x18  // i32 a, i32 b, u16 rpm (MQ)
+#define FOP_RESET_POSE      0x19  // - (MO)
+#define FOP_GET_MODE        0x20  // -> u8 mode, u8 queued segments
+#define FOP_GET_POSE        0x21  // -> i32 x, i32 y, i32 heading, u32 time (GP)
+#define FOP_TELEMETRY       0x22  // pushed: u16 voltage, u8 status, u16 rpm a, u16 rpm b,
+                                  // i32 pos a, i32 pos b, u8 mode, u32 loops, u32 loop max us
+#define FOP_GET_BAT         0x30  // -> u16 voltage in 10mV, u8 status
+#define FOP_SHUTDOWN        0x31  // - (BX)
+#define FOP_DISPLAY_CLEAR   0x40  // - (DC)
+#define FOP_DISPLAY_TITLE   0x41  // text (DT)
+#define FOP_DISPLAY_MSG     0x42  // text (DM)
+#define FOP_SET_ACCEL       0x50  // u16 RPM/s (CA)
+#define FOP_SET_JERK        0x51  // u16 RPM/s^2 (CJ)
+#define FOP_SET_SPEED       0x52  // u16 RPM (MS)
+#define FOP_SET_TELEMETRY   0x53  // u8 Hz, 0 -> off (T)
+#define FOP_ASCII           0x7F  // - back to the ASCII protocol
+#define FOP_ERROR           0xFF  // -> u8 opcode, u8 error code
+
+// Error codes
+#define FERR_CRC               1  // opcode 0
+#define FERR_OPCODE            2
+#define FERR_LENGTH            3
+#define FERR_RANGE             4
+#define FERR_REJECTED          5  // e.g. segment queue full
+
+// Receiver states
+#define FRX_SYNC               0
+#define FRX_LEN                1
+#define FRX_DATA               2
+#define FRX_CRC_LO             3
+#define FRX_CRC_HI             4
+
+// Compact binary protocol next to the ASCII CommandDecoder. It is switched
+// on by the ASCII command CP1 and back by FOP_ASCII. The frames map onto
+// the same Motors, Battery and LCD_Display operations.
+class FrameDecoder {
+  private:
+    bool active = false;
+    uint8_t state = FRX_SYNC;
+    uint8_t len = 0;
+    uint8_t pnt = 0;
+    uint8_t data[FRAME_PAYLOAD_MAX + 1];          // opcode and payload
+    uint16_t crc = 0;                             // calculated while receiving
+    uint16_t crc_rx = 0;                          // received
+    uint8_t reply[FRAME_PAYLOAD_MAX + FRAME_OVERHEAD];
+    uint8_t reply_len = 0;
+    uint32_t crc_errors = 0;
+    void reply_begin(uint8_t opcode);
+    void reply_u8(uint8_t v);
+    void reply_u16(uint16_t v);
+    void reply_u32(uint32_t v);
+    void reply_send(void);
+    void send_error(uint8_t opcode, uint8_t err);
+    uint8_t decode_motor_frame(void);
+
+  public:
+    void init(void);
+    void set_active(bool status);
+    bool is_active(void);
+    bool add_byte(uint8_t c);
+    void decode_frame(void);
+    void send_pose(void);
+    void send_telemetry(void);
+    uint32_t get_crc_errors(void);
+};
+
+#endif
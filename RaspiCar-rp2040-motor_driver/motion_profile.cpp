@@ -0,0 +1,217 @@
+#include "motion_profile.h"
+#include "motors.h"
+
+//-------------------------------------------------------------------------
+// Converts a speed in RPM to the velocity format of the profile engine
+uint32_t rpm_to_velocity(uint32_t rpm) {
+  return ((uint64_t) rpm << 32) / CONVERSION_FACTOR;
+}
+
+//-------------------------------------------------------------------------
+// Sets the max acceleration in RPM/s. The start/stop velocity is the speed
+// reached after the first event from standstill, at least RPM_MIN.
+void MotionProfile::set_accel(uint32_t rpm_per_s) {
+  a_max = ((uint64_t) rpm_per_s << 48) / CONVERSION_FACTOR / 1000000;
+  if (a_max == 0) a_max = 1;
+  if (a > a_max) a = a_max;
+  v_min = isqrt64((uint64_t) a_max << 17);
+  if (v_min < rpm_to_velocity(RPM_MIN)) v_min = rpm_to_velocity(RPM_MIN);
+  c_min = PROFILE_VC_ONE / v_min;
+  inv_2a = (1ULL << 47) / a_max;
+  t_jerk = (j == 0) ? 0 : ((uint64_t) a_max * inv_2j) >> 32;
+}
+
+//-------------------------------------------------------------------------
+// Sets the jerk in RPM/s^2. 0 selects the trapezoidal profile, other values
+// should not be below MOT_JERK_MIN to keep inv_2j within 32 bits.
+void MotionProfile::set_jerk(uint32_t rpm_per_s2) {
+  uint64_t x;
+
+  if (rpm_per_s2 == 0) {
+    j = 0;
+    t_jerk = 0;
+    return;
+  }
+  x = ((uint64_t) rpm_per_s2 << 32) / CONVERSION_FACTOR;
+  x = (((x << 16) / 1000000) << 16) / 1000000;
+  j = (x > 0) ? x : 1;
+  x = (1ULL << 48) / (2 * (uint64_t) j);
+  inv_2j = (x > 0xFFFFFFFF) ? 0xFFFFFFFF : x;
+  t_jerk = ((uint64_t) a_max * inv_2j) >> 32;
+}
+
+//-------------------------------------------------------------------------
+// Sets the target speed. 0 ramps down to the stop velocity and stops.
+void MotionProfile::set_target_rpm(uint32_t rpm) {
+  set_target_velocity(rpm_to_velocity(rpm));
+}
+
+//-------------------------------------------------------------------------
+// Sets the target speed in the velocity format, for the step interrupt
+void STEP_ISR_FUNC(MotionProfile::set_target_velocity)(uint32_t velocity) {
+  v_target = velocity;
+  v_exit = 0;
+  dist = 0;
+  braking = false;
+}
+
+//-------------------------------------------------------------------------
+// Limits the run to the given number of events. The profile brakes down to
+// the exit velocity (default: start/stop velocity) in time and creeps at
+// that speed if it arrives early, so the last event is reached without an
+// abrupt stop.
+void STEP_ISR_FUNC(MotionProfile::set_distance)(uint32_t events) {
+  dist = events;
+  braking = false;
+}
+
+//-------------------------------------------------------------------------
+// Velocity at the end of a limited run, 0 -> brake down to the start/stop
+// velocity. May be raised while running, e.g. when the next segment arrives.
+void STEP_ISR_FUNC(MotionProfile::set_exit_velocity)(uint32_t velocity) {
+  v_exit = velocity;
+}
+
+//-------------------------------------------------------------------------
+// Takes over the velocity of the profile of the other motor, used when the
+// leading motor changes between two segments
+void STEP_ISR_FUNC(MotionProfile::continue_from)(const MotionProfile &prof) {
+  v = prof.v;
+  c = prof.c;
+  c_frac = prof.c_frac;
+  a = 0;
+}
+
+//-------------------------------------------------------------------------
+uint32_t MotionProfile::get_a_max(void) {
+  return a_max;
+}
+
+//-------------------------------------------------------------------------
+// Stops immediately, the next start begins at the start velocity
+void STEP_ISR_FUNC(MotionProfile::reset)(void) {
+  v = 0;
+  a = 0;
+  c_frac = 0;
+  dist = 0;
+  braking = false;
+}
+
+//-------------------------------------------------------------------------
+bool MotionProfile::is_running(void) {
+  return v != 0;
+}
+
+//-------------------------------------------------------------------------
+// Current (not target) speed
+uint32_t MotionProfile::get_rpm(void) {
+  return ((uint64_t) v * CONVERSION_FACTOR + (1ULL << 31)) >> 32;
+}
+
+//-------------------------------------------------------------------------
+// Returns true as soon as the events left are needed to brake down to
+// v_end: (v^2 - v_end^2) / 2a, plus v * a_max / 2j for the jerk limited
+// ramp. If a_max isn't reached (dv * j < a_max^2), the S-curve needs
+// v * sqrt(dv / j), which is checked only when the first estimate is hit.
+bool STEP_ISR_FUNC(MotionProfile::brake_point)(uint32_t v_end) {
+  uint64_t n;
+  uint32_t dv;
+
+  if (v <= v_end) return false;
+  dv = v - v_end;
+  n = umul64x32((umul32x32(v, v) - umul32x32(v_end, v_end)) >> 24, inv_2a) >> 40;
+  if (j != 0) {
+    n += umul32x32(v, t_jerk) >> 32;
+    n += n >> 4;                // margin for the tail of the ramp, see next_interval()
+  }
+  if (dist > n) return false;
+  if ((j != 0) && (umul32x32(a_max, a_max) > umul32x32(dv, j))) {
+    n = umul32x32(v, isqrt64(umul32x32(dv, inv_2j) >> 15)) >> 32;
+    return dist <= n + (n >> 4);
+  }
+  return true;
+}
+
+//-------------------------------------------------------------------------
+// next_interval
+// Advances the profile by one event and returns the time to the next event
+// in microseconds, 0 -> profile has stopped. Called from the step timer,
+// uses multiplications and shifts only. The 64 bit products are taken by
+// umul32x32() / umul64x32() in RAM, see util.cpp.
+uint32_t STEP_ISR_FUNC(MotionProfile::next_interval)(void) {
+  uint32_t vt, v_end, diff, dv, da, us;
+  uint64_t p;
+  int64_t e, ee;
+  bool up, refine = false;
+
+  if (v == 0) {                     // start from standstill
+    if (v_target == 0) return 0;
+    v = (v_target < v_min) ? v_target : v_min;
+    c = c_min;
+    a = 0;
+    refine = true;
+  }
+
+  vt = (v_target == 0) ? v_min : v_target;
+  if (dist > 0) {
+    dist -= 1;
+    v_end = (v_exit > v_min) ? v_exit : v_min;
+    if (!braking && (vt > v_end)) braking = brake_point(v_end);
+    if (braking) vt = v_end;
+  }
+  if (v != vt) {
+    up = v < vt;
+    diff = up ? vt - v : v - vt;
+    if (j == 0) {
+      a = a_max;
+    } else {
+      // S-curve: ramp the acceleration up, and down again as soon as the
+      // remaining speed change equals a^2 / 2j
+      if (up != a_up) {
+        a = 0;
+        a_up = up;
+      }
+      da = umul32x32(j, c) >> 24;
+      if (da == 0) da = 1;
+      if ((umul64x32(umul32x32(a, a) >> 24, inv_2j) >> 24) >= diff) {
+        a = (a > da + (a_max >> 4)) ? a - da : a_max >> 4;
+      } else if (a < a_max) {
+        a = (a_max - a > da) ? a + da : a_max;
+      }
+    }
+    dv = umul32x32(a, c) >> 24;
+    if (dv == 0) dv = 1;
+    if (dv >= diff) v = vt;
+    else if (up) v += dv;
+    else v -= dv;
+    refine = true;
+  }
+
+  if (refine) {
+    // c = 2^40 / v, refined from the previous interval (Newton-Raphson)
+    for (uint8_t i = 0; i < PROFILE_NR_LOOPS; ++i) {
+      p = umul32x32(v, c);
+      if (p > PROFILE_VC_ONE + (PROFILE_VC_ONE >> 1)) {
+        c >>= 1;
+      } else if (p < (PROFILE_VC_ONE >> 1)) {
+        c <<= 1;
+      } else {
+        e = (int64_t) (PROFILE_VC_ONE - p);
+        ee = e >> 8;                // |e| <= 2^39: c * ee >> 32, rounded down
+        if (ee >= 0) c += umul32x32(c, ee) >> 32;
+        else c -= (umul32x32(c, -ee) + 0xFFFFFFFF) >> 32;
+        if ((e < (1LL << 28)) && (e > -(1LL << 28))) break;
+      }
+    }
+  }
+
+  if ((v_target == 0) && (v <= v_min)) {
+    reset();
+    return 0;
+  }
+
+  c_frac += c & ((1 << PROFILE_C_SHIFT) - 1);
+  us = (c >> PROFILE_C_SHIFT) + (c_frac >> PROFILE_C_SHIFT);
+  c_frac &= (1 << PROFILE_C_SHIFT) - 1;
+  return us;
+}
@@ -0,0 +1,52 @@
+#ifndef __MOTION_PROFILE__
+#define __MOTION_PROFILE__
+
+#include "RaspiCar-rp2040-motor_driver.h"
+
+// Fixed-point formats of the profile engine
+//   c: half step interval (time between two timer events), Q24.8 microseconds
+//   v: step rate, scaled such that v * c = 2^40 (1 RPM = 458130)
+//   a: acceleration, Q16 v-units per microsecond
+//   j: jerk, Q16 a-units per microsecond
+#define PROFILE_C_SHIFT        8
+#define PROFILE_VC_ONE         (1ULL << 40)
+#define PROFILE_NR_LOOPS       8       // max refinement steps of the interval per event
+
+class MotionProfile {
+  private:
+    uint32_t c = 0;             // current interval, Q24.8 us
+    uint32_t c_frac = 0;        // fractional microseconds carried to the next interval
+    uint32_t v = 0;             // current velocity, 0 -> standing still
+    uint32_t v_target = 0;      // target velocity, 0 -> ramp down and stop
+    uint32_t v_min = 0;         // start/stop velocity
+    uint32_t c_min = 0;         // interval at v_min
+    uint32_t a = 0;             // current acceleration (jerk limited profile)
+    uint32_t a_max = 0;         // max acceleration
+    uint32_t j = 0;             // jerk, 0 -> trapezoidal profile
+    uint32_t inv_2j = 0;        // 2^48 / (2 * j)
+    uint32_t inv_2a = 0;        // 2^47 / a_max, braking distance
+    uint32_t t_jerk = 0;        // a_max / 2j in us, extra braking distance of the S-curve
+    uint32_t dist = 0;          // limited run: events left, 0 -> unlimited
+    uint32_t v_exit = 0;        // limited run: velocity at the end, 0 -> v_min
+    bool braking = false;       // limited run: brake point passed
+    bool a_up = true;           // direction of the current speed change
+    bool brake_point(uint32_t v_end);
+
+  public:
+    void set_accel(uint32_t rpm_per_s);
+    void set_jerk(uint32_t rpm_per_s2);
+    void set_target_rpm(uint32_t rpm);
+    void set_target_velocity(uint32_t velocity);
+    void set_distance(uint32_t events);
+    void set_exit_velocity(uint32_t velocity);
+    void continue_from(const MotionProfile &prof);
+    void reset(void);
+    bool is_running(void);
+    uint32_t get_rpm(void);
+    uint32_t get_a_max(void);
+    uint32_t next_interval(void);
+};
+
+uint32_t rpm_to_velocity(uint32_t rpm);
+
+#endif
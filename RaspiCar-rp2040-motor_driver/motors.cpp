@@ -1,10 +1,45 @@
 #include "motors.h"
+#include "config_store.h"
+#include "hardware/irq.h"
 
-struct repeating_timer mot_a_timer;
-struct repeating_timer mot_b_timer;
+//----------------------------------------------------------------------
+// Disables the interrupts of the calling core but the step interrupt
+// (in RAM), returns the disabled ones
+static uint32_t mask_irqs(uint32_t step_irq) {
+  uint32_t irqs = 0;
+
+  for (uint32_t i = 0; i < NVIC_IRQS; i++) {
+    if (irq_is_enabled(i)) irqs |= 1u << i;
+  }
+#ifndef STEP_ISR_IN_FLASH
+  irqs &= ~(1u << step_irq);
+#endif
+  for (uint32_t i = 0; i < NVIC_IRQS; i++) {
+    if (irqs & (1u << i)) irq_set_enabled(i, false);
+  }
+  return irqs;
+}
+
+//----------------------------------------------------------------------
+static void unmask_irqs(uint32_t irqs) {
+  for (uint32_t i = 0; i < NVIC_IRQS; i++) {
+    if (irqs & (1u << i)) irq_set_enabled(i, true);
+  }
+}
+
+//----------------------------------------------------------------------
+static bool same_status(const MotorStatus *s1, const MotorStatus *s2) {
+  return (s1->seq == s2->seq) && (s1->result == s2->result) &&
+         (s1->a_enabled == s2->a_enabled) && (s1->b_enabled == s2->b_enabled) &&
+         (s1->a_power == s2->a_power) && (s1->b_power == s2->b_power) &&
+         (s1->a_rpm == s2->a_rpm) && (s1->b_rpm == s2->b_rpm) &&
+         (s1->mode == s2->mode) && (s1->queue_count == s2->queue_count);
+}
 
 //----------------------------------------------------------------------
 void Motors::init(void) {
+  extern ConfigStore config;
+
   pinMode(MOTA_PWR, OUTPUT);
   digitalWrite(MOTA_PWR, HIGH);
   pinMode(MOTA_STEP, OUTPUT);
@@ -18,51 +53,359 @@ void Motors::init(void) {
   pinMode(MOTB_DIR, OUTPUT);
   digitalWrite(MOTB_DIR, HIGH);
   
-  add_repeating_timer_us(a_step_time, mot_a_timer_callback, NULL, &mot_a_timer);
-  add_repeating_timer_us(b_step_time, mot_b_timer_callback, NULL, &mot_b_timer);
-
-  // get ramp from eeprom
-  mot_ramp = EEPROM.read(EEPROM_BASE_ADDR + EEPROM_MOTOR_RAMP);
-  if ((mot_ramp <= 1) || (mot_ramp >= 50)) {
-    mot_ramp = MOT_RAMP;
-    EEPROM.write(EEPROM_BASE_ADDR + EEPROM_MOTOR_RAMP, mot_ramp);
+  // get acceleration from the configuration
+  mot_accel = config.data.motor_accel;
+  if ((mot_accel < MOT_ACCEL_MIN) || (mot_accel > MOT_ACCEL_MAX)) {
+    mot_accel = MOT_RAMP * RAMP_ACCEL_FACTOR;
   }
 
-  // get defined steps speed from eeprom
-  defined_steps_speed = EEPROM.read(EEPROM_BASE_ADDR + EEPROM_DEFINED_STEPS_SPEED);
+  // get jerk from the configuration
+  mot_jerk = config.data.motor_jerk;
+  if ((mot_jerk != 0) && ((mot_jerk < MOT_JERK_MIN) || (mot_jerk > MOT_JERK_MAX))) {
+    mot_jerk = 0;
+  }
+
+  prof_a.set_accel(mot_accel);
+  prof_b.set_accel(mot_accel);
+  prof_a.set_jerk(mot_jerk);
+  prof_b.set_jerk(mot_jerk);
+
+  // get defined steps speed from the configuration
+  defined_steps_speed = config.data.defined_steps_speed;
   if ((defined_steps_speed <= RPM_MIN) || (defined_steps_speed >= RPM_MAX)) {
     defined_steps_speed = DEFINED_STEPS_SPEED;
-    EEPROM.write(EEPROM_BASE_ADDR + EEPROM_DEFINED_STEPS_SPEED, defined_steps_speed);
   }
+  update_config();                    // defaults replace invalid settings
+
+#ifdef DUAL_CORE
+  // the step interrupt is set up by core 1
+  __dmb();
+  core1_start = true;
+#else
+  init_stepping();
+#endif
+}
+
+#ifdef DUAL_CORE
+//----------------------------------------------------------------------
+// Core 1: waits for init() on core 0, then takes over the step interrupt.
+// The interrupt is enabled in the NVIC of the calling core.
+void Motors::init_core1(void) {
+  while (!core1_start) tight_loop_contents();
+  __dmb();
+  init_stepping();
+}
+
+//----------------------------------------------------------------------
+// run_commands
+// Core 1: executes the queued commands and publishes a status snapshot
+// whenever something has changed. Steps run in the interrupt in between.
+void Motors::run_commands(void) {
+  MotorCommand mc;
+  MotorCommand cmds[MOT_BATCH_MAX];
+  MotorStatus s;
+  uint32_t irq_status;
+  int32_t i, n;
+
+  if (flash_park == FLASH_PARK_REQUEST) park_core1();
+  while (cmd_queue.pop(mc)) {
+    if (mc.op == MOP_BATCH) {
+      // the commands of a batch are taken first (core 0 may still be pushing
+      // them), then executed with no step in between
+      n = (mc.a < MOT_BATCH_MAX) ? mc.a : MOT_BATCH_MAX;
+      i = 0;
+      while (i < n) {
+        if (cmd_queue.pop(cmds[i])) i += 1;
+      }
+      irq_status = save_and_disable_interrupts();
+      for (i = 0; i < n; i++) {
+        exec_result = execute(cmds[i]);
+        exec_seq = cmds[i].seq;
+      }
+      restore_interrupts(irq_status);
+    } else {
+      exec_result = execute(mc);
+      exec_seq = mc.seq;
+    }
+  }
+  make_status(&s, exec_seq, exec_result);
+  if (!same_status(&s, &published)) {
+    if (status_queue.push(s)) published = s;    // full -> retry next time
+  }
+}
 
+//----------------------------------------------------------------------
+// Core 1: waits in RAM while core 0 writes the flash, only the step
+// interrupt (in RAM) stays enabled
+void __not_in_flash_func(Motors::park_core1)(void) {
+  uint32_t irqs = mask_irqs(step_irq);
+
+  __dmb();
+  flash_park = FLASH_PARKED;
+  while (flash_park != FLASH_PARK_NONE) tight_loop_contents();
+  __dmb();
+  unmask_irqs(irqs);
+}
+
+//----------------------------------------------------------------------
+// Core 0: takes the status snapshots from core 1, the last one counts
+void Motors::receive_status(void) {
+  MotorStatus s;
+
+  while (status_queue.pop(s)) {
+    last_status = s;
+    status_new = true;
+  }
+}
+#endif
+
+//----------------------------------------------------------------------
+// submit
+// Passes a motor command to the core owning the motion state. In dual core
+// mode it is queued (waits while the queue is full), otherwise it is
+// executed right away. Returns the sequence number for wait_result().
+uint32_t Motors::submit(uint8_t op, int32_t a, int32_t b, int32_t c) {
+  MotorCommand mc;
+
+  mc.seq = ++cmd_seq;
+  mc.op = op;
+  mc.a = a;
+  mc.b = b;
+  mc.c = c;
+  if (batching) {
+    if (batch_len >= MOT_BATCH_MAX) flush_batch();
+    batch[batch_len++] = mc;
+    return mc.seq;
+  }
+#ifdef DUAL_CORE
+  while (!cmd_queue.push(mc)) tight_loop_contents();
+#else
+  make_status(&last_status, mc.seq, execute(mc));
+  status_new = true;
+#endif
+  return mc.seq;
+}
+
+//----------------------------------------------------------------------
+// Waits until the command is executed, returns its result. Not for a
+// command of the open batch, the batch is passed on with end_batch().
+bool Motors::wait_result(uint32_t seq) {
+  if (!batching) flush_batch();
+#ifdef DUAL_CORE
+  do {
+    receive_status();
+  } while ((int32_t) (last_status.seq - seq) < 0);
+#endif
+  return last_status.result;
+}
+
+//----------------------------------------------------------------------
+// flash_begin
+// Prepares a flash write on core 0 (configuration save). No code may run
+// from flash while it is written: the other interrupts of both cores are
+// disabled, core 1 waits in RAM, the step interrupt runs from RAM and the
+// motors keep going. With STEP_ISR_IN_FLASH the steps stall.
+void Motors::flash_begin(void) {
+#ifdef DUAL_CORE
+  flash_park = FLASH_PARK_REQUEST;
+  while (flash_park != FLASH_PARKED) tight_loop_contents();
+  __dmb();
+#endif
+  flash_irqs = mask_irqs(step_irq);
+}
+
+//----------------------------------------------------------------------
+void Motors::flash_end(void) {
+  unmask_irqs(flash_irqs);
+#ifdef DUAL_CORE
+  __dmb();
+  flash_park = FLASH_PARK_NONE;
+#endif
+}
+
+//----------------------------------------------------------------------
+// Waits until all submitted commands are executed, in an open batch the
+// ones passed on before it
+void Motors::sync(void) {
+  wait_result((batch_len > 0) ? batch[0].seq - 1 : cmd_seq);
+}
+
+//----------------------------------------------------------------------
+// begin_batch
+// The following commands are collected and executed together, with the
+// step interrupt disabled, e.g. direction and speed change at the same step.
+void Motors::begin_batch(void) {
+  batching = true;
+}
+
+//----------------------------------------------------------------------
+void Motors::end_batch(void) {
+  flush_batch();
+  batching = false;
+}
+
+//----------------------------------------------------------------------
+bool Motors::is_batching(void) {
+  return batching;
+}
+
+//----------------------------------------------------------------------
+// Passes the collected commands on in one go. A batch header tells core 1
+// how many commands to execute at once.
+void Motors::flush_batch(void) {
+  uint8_t i;
+#ifdef DUAL_CORE
+  MotorCommand mc;
+#else
+  uint32_t irq_status;
+  bool result = true;
+#endif
+
+  if (batch_len == 0) return;
+#ifdef DUAL_CORE
+  mc.seq = batch[0].seq;
+  mc.op = MOP_BATCH;
+  mc.a = batch_len;
+  mc.b = 0;
+  mc.c = 0;
+  while (!cmd_queue.push(mc)) tight_loop_contents();
+  for (i = 0; i < batch_len; i++) {
+    while (!cmd_queue.push(batch[i])) tight_loop_contents();
+  }
+#else
+  irq_status = save_and_disable_interrupts();
+  for (i = 0; i < batch_len; i++) {
+    result = execute(batch[i]);
+  }
+  restore_interrupts(irq_status);
+  make_status(&last_status, batch[batch_len - 1].seq, result);
+  status_new = true;
+#endif
+  batch_len = 0;
+}
+
+//----------------------------------------------------------------------
+// poll_status
+// Copies the latest status snapshot to s, returns false if nothing has
+// changed since the last call.
+bool Motors::poll_status(MotorStatus *s) {
+#ifdef DUAL_CORE
+  receive_status();
+#else
+  MotorStatus now;
+
+  make_status(&now, last_status.seq, last_status.result);
+  if (!same_status(&now, &last_status)) {
+    last_status = now;
+    status_new = true;
+  }
+#endif
+  if (!status_new) return false;
+  status_new = false;
+  *s = last_status;
+  return true;
+}
+
+//----------------------------------------------------------------------
+// Executes a motor command, returns false if it was rejected
+bool Motors::execute(const MotorCommand &mc) {
+  switch (mc.op) {
+    case MOP_ENABLE_A:      set_a_enable(mc.a != 0); break;
+    case MOP_ENABLE_B:      set_b_enable(mc.a != 0); break;
+    case MOP_POWER_A:       set_a_power(mc.a != 0); break;
+    case MOP_POWER_B:       set_b_power(mc.a != 0); break;
+    case MOP_DIR_A:         set_a_dir(mc.a != 0); break;
+    case MOP_DIR_B:         set_b_dir(mc.a != 0); break;
+    case MOP_RPM_A:         set_a_rpm(mc.a); break;
+    case MOP_RPM_B:         set_b_rpm(mc.a); break;
+    case MOP_RAMP:          set_ramp(mc.a); break;
+    case MOP_ACCEL:         set_accel(mc.a); break;
+    case MOP_JERK:          set_jerk(mc.a); break;
+    case MOP_STEPS_SPEED:   set_defined_steps_speed(mc.a); break;
+    case MOP_DEFINED_STEPS: run_defined_steps(mc.a); break;
+    case MOP_SEGMENT:       run_segment(mc.a, mc.b); break;
+    case MOP_ARC:           run_arc(mc.a, mc.b); break;
+    case MOP_TURN:          run_turn(mc.a); break;
+    case MOP_QUEUE:         return queue_segment(mc.a, mc.b, mc.c);
+    default:                return false;
+  }
+  return true;
+}
+
+//----------------------------------------------------------------------
+void Motors::make_status(MotorStatus *s, uint32_t seq, bool result) {
+  s->seq = seq;
+  s->result = result;
+  s->a_enabled = a_enabled;
+  s->b_enabled = b_enabled;
+  s->a_power = a_power;
+  s->b_power = b_power;
+  s->a_rpm = a_rpm_target;
+  s->b_rpm = b_rpm_target;
+  s->mode = mode;
+  s->queue_count = queue.count();
 }
 
 //----------------------------------------------------------------------
 void Motors::set_a_enable(bool status) {
+  uint32_t irq_status = save_and_disable_interrupts();
+  flush_queue();
   mode = 0;
-  a_enabled = status;
-  if (!a_enabled) a_step_time_target = MOT_STEP_TIME_MAX; 
+  if (status) {
+    wake_a();
+  } else {
+    halt_a();
+    a_rpm_target = 0;
+    prof_a.set_target_rpm(0);
+    prof_a.reset();
+  }
+  restore_interrupts(irq_status);
 }
 
 //----------------------------------------------------------------------
 void Motors::set_b_enable(bool status) {
+  uint32_t irq_status = save_and_disable_interrupts();
+  flush_queue();
   mode = 0;
-  b_enabled = status;
-  if (!b_enabled) b_step_time_target = MOT_STEP_TIME_MAX; 
+  if (status) {
+    wake_b();
+  } else {
+    halt_b();
+    b_rpm_target = 0;
+    prof_b.set_target_rpm(0);
+    prof_b.reset();
+  }
+  restore_interrupts(irq_status);
 }
 
 //----------------------------------------------------------------------
 void Motors::set_a_power(bool status) {
+  uint32_t irq_status;
+
   a_power = status;
   digitalWrite(MOTA_PWR, !status);
-  if (!a_power) a_step_time_target = MOT_STEP_TIME_MAX;
+  if (!a_power) {
+    irq_status = save_and_disable_interrupts();
+    flush_queue();
+    a_rpm_target = 0;
+    prof_a.set_target_rpm(0);
+    restore_interrupts(irq_status);
+  }
 }
 
 //----------------------------------------------------------------------
 void Motors::set_b_power(bool status) {
+  uint32_t irq_status;
+
   b_power = status;
   digitalWrite(MOTB_PWR, !status);
-  if (!b_power) b_step_time_target = MOT_STEP_TIME_MAX;
+  if (!b_power) {
+    irq_status = save_and_disable_interrupts();
+    flush_queue();
+    b_rpm_target = 0;
+    prof_b.set_target_rpm(0);
+    restore_interrupts(irq_status);
+  }
 }
 
 //----------------------------------------------------------------------
@@ -97,174 +440,111 @@ void Motors::set_b_dir(bool status) {
   digitalWrite(MOTB_DIR, status);
 }
 
-//----------------------------------------------------------------------
-void Motors::check_step_time_a(void) {
-  if (a_step_time > a_step_time_target) {   // faster
-    a_step_time = calc_step_time(a_step_time, true);
-    if (a_step_time < a_step_time_target) a_step_time = a_step_time_target;
-    mot_a_timer.delay_us = a_step_time;
-  } else if (a_step_time < a_step_time_target) {   // slower
-    a_step_time = calc_step_time(a_step_time, false);
-    if (a_step_time > a_step_time_target) a_step_time = a_step_time_target;
-    mot_a_timer.delay_us = a_step_time;
-  }
-  if (a_step_time >= MOT_STEP_TIME_MAX) {
-    set_a_enable(false);
-  }
-}
-
-//----------------------------------------------------------------------
-void Motors::check_step_time_b(void) {
-  if (b_step_time > b_step_time_target) {           // faster
-    b_step_time = calc_step_time(b_step_time, true);
-    if (b_step_time < b_step_time_target) b_step_time = b_step_time_target;
-    mot_b_timer.delay_us = b_step_time;
-  } else if (b_step_time < b_step_time_target) {    // slower
-    b_step_time = calc_step_time(b_step_time, false);
-    if (b_step_time > b_step_time_target) b_step_time = b_step_time_target;
-    mot_b_timer.delay_us = b_step_time;
-  }
-    if (b_step_time >= MOT_STEP_TIME_MAX) {
-    set_b_enable(false);
-  }
-}
-
-//-------------------------------------------------------------------------
-uint32_t Motors::calc_step_time(uint32_t current_step_time, bool up) {
-  uint32_t new_step_time;
-  int rpm = CONVERSION_FACTOR / current_step_time;
-  int new_rpm;
-  
-  if (up) {               // faster - reduce step_time
-    new_rpm = rpm + mot_ramp;
-    if (new_rpm > RPM_MAX) new_rpm = RPM_MAX;
-    new_step_time = CONVERSION_FACTOR / new_rpm;
-    if (new_step_time >= current_step_time) new_step_time = current_step_time - 1;  
-  } else {                // slower - increase step_time
-    new_rpm = rpm - mot_ramp;
-    if (new_rpm < RPM_MIN) new_rpm = RPM_MIN;
-    new_step_time = CONVERSION_FACTOR / new_rpm;
-    if (new_step_time <= current_step_time) new_step_time = current_step_time + 1;  
-  }
-  return new_step_time;
-}
-
 //-------------------------------------------------------------------
 void Motors::set_a_steptime(uint32_t steptime) {
-  a_step_time_target = steptime;
-  if (a_step_time_target < MOT_STEP_TIME_MIN)
-   a_step_time_target = MOT_STEP_TIME_MIN;
-  else if (a_step_time_target > MOT_STEP_TIME_MAX)
-   a_step_time_target = MOT_STEP_TIME_MAX;
+  if (steptime < MOT_STEP_TIME_MIN) steptime = MOT_STEP_TIME_MIN;
+  else if (steptime > MOT_STEP_TIME_MAX) steptime = MOT_STEP_TIME_MAX;
+  a_rpm_target = (steptime >= MOT_STEP_TIME_MAX) ? 0 : CONVERSION_FACTOR / steptime;
+  prof_a.set_target_rpm(a_rpm_target);
 }
 
 //-------------------------------------------------------------------
 void Motors::set_b_steptime(uint32_t steptime) {
-  b_step_time_target = steptime;
-  if (b_step_time_target < MOT_STEP_TIME_MIN)
-    b_step_time_target = MOT_STEP_TIME_MIN;
-  else if (b_step_time_target > MOT_STEP_TIME_MAX)
-    b_step_time_target = MOT_STEP_TIME_MAX;
+  if (steptime < MOT_STEP_TIME_MIN) steptime = MOT_STEP_TIME_MIN;
+  else if (steptime > MOT_STEP_TIME_MAX) steptime = MOT_STEP_TIME_MAX;
+  b_rpm_target = (steptime >= MOT_STEP_TIME_MAX) ? 0 : CONVERSION_FACTOR / steptime;
+  prof_b.set_target_rpm(b_rpm_target);
 }
 
 //-------------------------------------------------------------------
 void Motors::set_a_rpm(uint32_t rpm) {
+  uint32_t irq_status;
+
+  if (rpm > RPM_MAX) rpm = RPM_MAX;
+  irq_status = save_and_disable_interrupts();
+  flush_queue();
   mode = 0;
-  if (rpm == 0) {
-    a_step_time_target = MOT_STEP_TIME_MAX;
-    a_enabled = false;
-  } else {
-    a_step_time_target = CONVERSION_FACTOR / rpm;
-    if (a_step_time_target < MOT_STEP_TIME_MIN)
-      a_step_time_target = MOT_STEP_TIME_MIN;
-    else if (a_step_time_target > MOT_STEP_TIME_MAX)
-      a_step_time_target = MOT_STEP_TIME_MAX;
-    a_enabled = true;
-  }
+  a_rpm_target = rpm;
+  prof_a.set_target_rpm(rpm);
+  if (rpm > 0) wake_a();
+  restore_interrupts(irq_status);
 }
 
 //-------------------------------------------------------------------
 void Motors::set_b_rpm(uint32_t rpm) {
+  uint32_t irq_status;
+
+  if (rpm > RPM_MAX) rpm = RPM_MAX;
+  irq_status = save_and_disable_interrupts();
+  flush_queue();
   mode = 0;
-  if (rpm == 0) {
-    b_step_time_target = MOT_STEP_TIME_MAX;
-    b_enabled = false;
-  } else {
-    b_step_time_target = CONVERSION_FACTOR / rpm;
-    if (b_step_time_target < MOT_STEP_TIME_MIN)
-      b_step_time_target = MOT_STEP_TIME_MIN;
-    else if (b_step_time_target > MOT_STEP_TIME_MAX)
-      b_step_time_target = MOT_STEP_TIME_MAX;
-    b_enabled = true;
-  }
+  b_rpm_target = rpm;
+  prof_b.set_target_rpm(rpm);
+  if (rpm > 0) wake_b();
+  restore_interrupts(irq_status);
 }
 
 //-------------------------------------------------------------------
 uint32_t Motors::get_a_rpm(void) {
-  if (a_step_time_target >= MOT_STEP_TIME_MAX) return 0; 
-  return CONVERSION_FACTOR / a_step_time_target;
+  return a_rpm_target;
 }
 
 //-------------------------------------------------------------------
 uint32_t Motors::get_b_rpm(void) {
-  if (b_step_time_target >= MOT_STEP_TIME_MAX) return 0; 
-  return CONVERSION_FACTOR / b_step_time_target;
+  return b_rpm_target;
 }
 
 //-------------------------------------------------------------------
+// The ramp (RPM per 10ms) is kept for compatibility, it sets the acceleration
 void  Motors::set_ramp(uint32_t ramp) {
   if (ramp <= 100) {
-    if (ramp != mot_ramp) {
-      mot_ramp = ramp;
-      EEPROM.write(EEPROM_BASE_ADDR + EEPROM_MOTOR_RAMP, mot_ramp);
-      EEPROM.commit();
-    }
+    set_accel(ramp * RAMP_ACCEL_FACTOR);
   }
 }
 
 //-------------------------------------------------------------------
 uint32_t  Motors::get_ramp(void) {
-  return mot_ramp;
+  return (mot_accel + RAMP_ACCEL_FACTOR / 2) / RAMP_ACCEL_FACTOR;
 }
 
 //-------------------------------------------------------------------
-bool mot_a_timer_callback(struct repeating_timer *t) {
-  extern Motors motors;
-  if (motors.a_enabled) {
-    if (digitalRead(MOTA_STEP) == HIGH)
-      digitalWrite(MOTA_STEP, LOW);
-    else {
-      digitalWrite(MOTA_STEP, HIGH);
-      motors.a_step_cnt += 1;
-      if ((motors.mode == 1) && (motors.a_step_cnt == motors.steps_target)) {
-        motors.a_enabled = false;
-        motors.b_enabled = false;
-        motors.mode = 0;
-      };
-    };
-  };
+void Motors::set_accel(uint32_t accel) {
+  uint32_t irq_status;
+
+  if ((accel >= MOT_ACCEL_MIN) && (accel <= MOT_ACCEL_MAX)) {
+    if (accel != mot_accel) {
+      mot_accel = accel;
+      irq_status = save_and_disable_interrupts();
+      prof_a.set_accel(mot_accel);
+      prof_b.set_accel(mot_accel);
+      restore_interrupts(irq_status);
+    }
+  }
+}
 
-  return true;
+//-------------------------------------------------------------------
+uint32_t Motors::get_accel(void) {
+  return mot_accel;
 }
 
 //-------------------------------------------------------------------
-bool mot_b_timer_callback(struct repeating_timer *t) {
-  extern Motors motors;
-  if (motors.b_enabled) {
-    if (digitalRead(MOTB_STEP) == HIGH)
-      digitalWrite(MOTB_STEP, LOW);
-    else {
-      digitalWrite(MOTB_STEP, HIGH);
-      motors.b_step_cnt += 1;
-      if ((motors.mode == 1) && (motors.b_step_cnt == motors.steps_target)) {
-        motors.a_enabled = false;
-        motors.b_enabled = false;
-        motors.mode = 0;
-      };
-    };
-  };
-  
-  return true;
+void Motors::set_jerk(uint32_t jerk) {
+  uint32_t irq_status;
+
+  if ((jerk == 0) || ((jerk >= MOT_JERK_MIN) && (jerk <= MOT_JERK_MAX))) {
+    if (jerk != mot_jerk) {
+      mot_jerk = jerk;
+      irq_status = save_and_disable_interrupts();
+      prof_a.set_jerk(mot_jerk);
+      prof_b.set_jerk(mot_jerk);
+      restore_interrupts(irq_status);
+    }
+  }
+}
+
+//-------------------------------------------------------------------
+uint32_t Motors::get_jerk(void) {
+  return mot_jerk;
 }
 
 //-------------------------------------------------------------------
@@ -272,33 +552,216 @@ int Motors::get_mode(void) {
   return mode;
 }
 
+//-------------------------------------------------------------------
+// Both motors stand still (current speed, not target)
+bool Motors::is_stopped(void) {
+  return !prof_a.is_running() && !prof_b.is_running();
+}
+
 //-------------------------------------------------------------------
 void Motors::run_defined_steps(uint32_t steps) {
-  Serial.println(steps);
+  run_sync(steps * 8, steps * 8, defined_steps_speed);
+}
+
+//-------------------------------------------------------------------
+// run_sync
+// Runs both motors for the given number of steps at the given speed. The
+// motor with more steps leads, the other one steps in proportion, so both
+// start and finish together.
+void Motors::run_sync(uint32_t steps_a, uint32_t steps_b, uint32_t rpm) {
+  MotionSegment s;
+  uint32_t irq_status;
+
+  if ((steps_a == 0) && (steps_b == 0)) return;
+  init_segment(&s, steps_a, steps_b, rpm);
+  irq_status = save_and_disable_interrupts();
+  flush_queue();
+  setup_sync(&s);
+
+  // switch mode to defined number of steps and enable motors
+  start_sync();
+  restore_interrupts(irq_status);
+}
+
+//-------------------------------------------------------------------
+// Prepares step counters, leading motor and profiles of a limited run
+// from a segment (speeds calculated by init_segment()). Called with
+// interrupts disabled, also by the step interrupt.
+void STEP_ISR_FUNC(Motors::setup_sync)(const MotionSegment *s) {
+  uint32_t steps_a = abs(s->steps_a), steps_b = abs(s->steps_b);
+  uint32_t master_steps, slave_steps;
 
-  // prepare step counters
-  steps_target = steps * 8;
   a_step_cnt = 0;
   b_step_cnt = 0;
-  // set motor speed to default value
-  a_step_time_target = CONVERSION_FACTOR / defined_steps_speed;
-  b_step_time_target = CONVERSION_FACTOR / defined_steps_speed;
-  // switch mode to defined number of steps
-  mode = 1;
-  // enable motors
-  a_enabled = true;
-  b_enabled = true;
+  sync_a_leads = steps_a >= steps_b;
+  if (sync_a_leads) {
+    master_steps = steps_a;
+    slave_steps = steps_b;
+    sync_prof = &prof_a;
+    a_rpm_target = s->rpm;
+    b_rpm_target = s->rpm_follow;
+    prof_a.set_target_velocity(s->v_cruise);
+    prof_b.set_target_velocity(s->v_follow);
+  } else {
+    master_steps = steps_b;
+    slave_steps = steps_a;
+    sync_prof = &prof_b;
+    a_rpm_target = s->rpm_follow;
+    b_rpm_target = s->rpm;
+    prof_a.set_target_velocity(s->v_follow);
+    prof_b.set_target_velocity(s->v_cruise);
+  }
+  steps_target = master_steps;
+  sync_master_events = 2 * master_steps;       // two events per step
+  sync_slave_events = 2 * slave_steps;
+  sync_events_left = sync_master_events;
+  sync_err = sync_master_events / 2;
+#ifdef STEP_BACKEND_PWM
+  sync_ratio = s->ratio;
+#endif
+  sync_prof->set_distance(sync_master_events);
+}
 
+//-------------------------------------------------------------------
+// run_segment
+// Coordinated move with signed step counts (1 -> 8 microsteps, as MC) at
+// the defined steps speed. Both wheels start, ramp and finish together.
+void Motors::run_segment(int32_t steps_a, int32_t steps_b) {
+  run_signed_steps((int64_t) steps_a * 8, (int64_t) steps_b * 8);
+}
+
+//-------------------------------------------------------------------
+// run_arc
+// Drives the center of the car along an arc of the given length in mm,
+// radius 0 -> straight line. A positive radius turns left, a negative
+// length drives backwards. Motor A is the right wheel.
+void Motors::run_arc(int32_t length, int32_t radius) {
+  int64_t len_a, len_b;
+
+  if (radius == 0) {
+    len_a = length;
+    len_b = length;
+  } else {
+    len_a = (int64_t) length * (2 * radius + WHEEL_TRACK) / (2 * radius);
+    len_b = (int64_t) length * (2 * radius - WHEEL_TRACK) / (2 * radius);
+  }
+  run_signed_steps(mm_to_steps(len_a), mm_to_steps(len_b));
+}
+
+//-------------------------------------------------------------------
+// run_turn
+// Turns the car on the spot by the given angle in degrees, positive ->
+// counter-clockwise (left)
+void Motors::run_turn(int32_t angle) {
+  int64_t len;
+
+  // wheel path: pi * track * angle / 360, pi ~ 355 / 113
+  len = (int64_t) angle * WHEEL_TRACK * 355 / (360 * 113);
+  run_signed_steps(mm_to_steps(len), -mm_to_steps(len));
+}
+
+//-------------------------------------------------------------------
+// Wheel path in mm -> microsteps, pi ~ 355 / 113
+int64_t Motors::mm_to_steps(int64_t len) {
+  return len * STEPS_PER_ROTATION * 113 / (355 * WHEEL_DIAMETER);
+}
+
+//-------------------------------------------------------------------
+// Sets the directions from the signs and starts a limited run
+void Motors::run_signed_steps(int64_t steps_a, int64_t steps_b) {
+  set_a_dir(steps_a >= 0);
+  set_b_dir(steps_b >= 0);
+  if (steps_a < 0) steps_a = -steps_a;
+  if (steps_b < 0) steps_b = -steps_b;
+  run_sync(steps_a, steps_b, defined_steps_speed);
+}
+
+//-------------------------------------------------------------------
+// queue_segment
+// Appends a segment with signed step counts (1 -> 8 microsteps, as MC) to
+// the motion queue and plans the junction velocities. The queue starts
+// right away if no limited run is active. Returns false if the queue is full
+// or a step count is beyond SEG_STEPS_MAX.
+bool Motors::queue_segment(int32_t steps_a, int32_t steps_b, uint32_t rpm) {
+  int64_t micro_a = (int64_t) steps_a * 8, micro_b = (int64_t) steps_b * 8;
+  uint32_t irq_status, a_plan;
+  MotionSegment *s;
+
+  if ((steps_a == 0) && (steps_b == 0)) return true;
+  if ((micro_a < -8LL * SEG_STEPS_MAX) || (micro_a > 8LL * SEG_STEPS_MAX)) return false;
+  if ((micro_b < -8LL * SEG_STEPS_MAX) || (micro_b > 8LL * SEG_STEPS_MAX)) return false;
+  if (rpm > RPM_MAX) rpm = RPM_MAX;
+  else if (rpm < RPM_MIN) rpm = RPM_MIN;
+  if (!queue.push((int32_t) micro_a, (int32_t) micro_b, rpm, rpm_to_velocity(JUNCTION_JUMP_RPM))) return false;
+
+  // the S-curve needs more distance to brake, plan with half the acceleration
+  a_plan = prof_a.get_a_max();
+  if (mot_jerk != 0) a_plan /= 2;
+  queue.plan(a_plan);
+
+  irq_status = save_and_disable_interrupts();
+  s = queue.peek();
+  if (seg_running) {
+    sync_prof->set_exit_velocity(s->v_exit);    // head is the running segment
+  } else if (mode == 0) {
+    if (next_segment()) start_sync();
+  }
+  restore_interrupts(irq_status);
+  return true;
+}
+
+//-------------------------------------------------------------------
+// next_segment
+// Loads the next queued segment as limited run, called when a limited run
+// has ended or to start the queue. Called with interrupts disabled.
+bool STEP_ISR_FUNC(Motors::next_segment)(void) {
+  MotionSegment *s;
+
+  if (seg_running) queue.pop();
+  s = queue.peek();
+  seg_running = s != 0;
+  if (s == 0) return false;
+  a_dir = s->steps_a >= 0;
+  b_dir = s->steps_b >= 0;
+  gpio_put(MOTA_DIR, a_dir);
+  gpio_put(MOTB_DIR, b_dir);
+  setup_sync(s);
+  sync_prof->set_exit_velocity(s->v_exit);
+  return true;
+}
+
+//-------------------------------------------------------------------
+// Drops all queued segments. Called with interrupts disabled.
+void Motors::flush_queue(void) {
+  queue.clear();
+  seg_running = false;
+}
+
+//-------------------------------------------------------------------
+uint8_t Motors::get_queue_count(void) {
+  return queue.count();
+}
+
+//-------------------------------------------------------------------
+// get_position
+// Reads both position counters consistently while the step interrupt may
+// update them (sequence lock, retries if an update was in progress)
+void Motors::get_position(int64_t *pos_a, int64_t *pos_b) {
+  uint32_t seq;
+
+  do {
+    seq = pos_seq;
+    __dmb();
+    *pos_a = a_pos;
+    *pos_b = b_pos;
+    __dmb();
+  } while ((seq & 1) || (seq != pos_seq));
 }
 
 //-------------------------------------------------------------------
 void Motors::set_defined_steps_speed(uint32_t speed) {
   if ((speed >= RPM_MIN) && (speed <= RPM_MAX)) {
-    if (speed != defined_steps_speed) {
-      defined_steps_speed = speed;
-      EEPROM.write(EEPROM_BASE_ADDR + EEPROM_DEFINED_STEPS_SPEED, defined_steps_speed);
-      EEPROM.commit();
-    }
+    defined_steps_speed = speed;
   }
 }
 
@@ -307,3 +770,21 @@ int Motors::get_defined_steps_speed(void) {
   return defined_steps_speed;
 }
 
+//-------------------------------------------------------------------
+// update_config
+// Core 0: takes the settings into the configuration. The setters run with
+// the commands on core 1, the configuration is only written on core 0, so
+// a save cannot lose a change made while it writes the flash.
+void Motors::update_config(void) {
+  extern ConfigStore config;
+  uint32_t accel = mot_accel, jerk = mot_jerk, speed = defined_steps_speed;
+
+  if ((accel != config.data.motor_accel) || (jerk != config.data.motor_jerk) ||
+      (speed != config.data.defined_steps_speed)) {
+    config.data.motor_accel = accel;
+    config.data.motor_jerk = jerk;
+    config.data.defined_steps_speed = speed;
+    config.changed();
+  }
+}
+
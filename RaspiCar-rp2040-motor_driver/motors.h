@@ -2,6 +2,9 @@
 #define __MOTORS__
 
 #include "RaspiCar-rp2040-motor_driver.h"
+#include "motion_profile.h"
+#include "segment_queue.h"
+#include "spsc_queue.h"
 
 // pin definitions
 #define MOTA_PWR         21
@@ -11,40 +14,198 @@
 #define MOTB_STEP        17
 #define MOTB_DIR         16
 
+// Step generation backend. By default a single timer alarm toggles the
+// step pins. With STEP_BACKEND_PWM the PWM slices generate the step signal
+// and an interrupt is only raised once per step (PWM wrap).
+// #define STEP_BACKEND_PWM
+
+// Dual core mode. Core 1 owns the step generation and the motion state, it
+// executes the motor commands from core 0 (UART, decoder, display, battery).
+// Commands and status snapshots are passed by lock-free SPSC queues.
+#define DUAL_CORE
+
 // Motor step time
 #define MOT_STEP_TIME_MAX 150000
+#ifdef STEP_BACKEND_PWM
+#define MOT_STEP_TIME_MIN     15
+#else
 #define MOT_STEP_TIME_MIN     60
+#endif
 #define CONVERSION_FACTOR   9375  // 60'000'000 usec per minute, 3200 steps per rotation, 2 timer calls per step
 #define MOT_RAMP              15  // limit: 0 ... 100
+#define RAMP_ACCEL_FACTOR    100  // 1 ramp unit -> 1 RPM per 10ms = 100 RPM/s
+#define MOT_ACCEL_MIN        100  // RPM/s
+#define MOT_ACCEL_MAX       5000
+#define MOT_JERK_MIN        1000  // RPM/s^2, 0 -> trapezoidal profile
+#define MOT_JERK_MAX       60000
+#ifdef STEP_BACKEND_PWM
+#define RPM_MAX              300  // set rounds per minute
+#else
 #define RPM_MAX              120  // set rounds per minute
+#endif
 #define RPM_MIN                1
+#ifdef STEP_BACKEND_PWM
+#define JUNCTION_JUMP_RPM      0  // PWM backend stops between queued segments
+#else
+#define JUNCTION_JUMP_RPM     10  // max speed jump of a motor between queued segments
+#endif
 #define DEFINED_STEPS_SPEED   20  // limit: RPM_MIN ... RPM_MAX
 
+// Geometry of the car for the segment commands (to be calibrated)
+#define STEPS_PER_ROTATION  3200  // microsteps
+#define WHEEL_DIAMETER        65  // mm
+#define WHEEL_TRACK          140  // mm, distance between the wheels
+
+// Motor commands (op codes of MotorCommand)
+#define MOP_ENABLE_A           0  // a: enable
+#define MOP_ENABLE_B           1
+#define MOP_POWER_A            2  // a: power on
+#define MOP_POWER_B            3
+#define MOP_DIR_A              4  // a: forward
+#define MOP_DIR_B              5
+#define MOP_RPM_A              6  // a: RPM
+#define MOP_RPM_B              7
+#define MOP_RAMP               8  // a: RPM per 10ms
+#define MOP_ACCEL              9  // a: RPM/s
+#define MOP_JERK              10  // a: RPM/s^2
+#define MOP_STEPS_SPEED       11  // a: RPM
+#define MOP_DEFINED_STEPS     12  // a: steps
+#define MOP_SEGMENT           13  // a, b: signed steps
+#define MOP_ARC               14  // a: length, b: radius in mm
+#define MOP_TURN              15  // a: degrees
+#define MOP_QUEUE             16  // a, b: signed steps, c: RPM
+#define MOP_BATCH             17  // a: number of commands that follow, executed at once
+
+#define MOT_BATCH_MAX         16  // commands of a batch
+
+#define MOT_CMD_QUEUE_SIZE    16  // power of 2
+#define MOT_STATUS_QUEUE_SIZE  8  // power of 2
+
+// Flash writes: core 1 waits in RAM (flash_park)
+#define FLASH_PARK_NONE        0
+#define FLASH_PARK_REQUEST     1
+#define FLASH_PARKED           2
+#define NVIC_IRQS             32  // interrupt lines of each core
+
+struct MotorCommand {
+  uint32_t seq;               // sequence number, acknowledged by MotorStatus
+  uint8_t op;
+  int32_t a, b, c;
+};
+
+// Snapshot of the motion state, published after each command and on changes
+struct MotorStatus {
+  uint32_t seq;               // last executed command
+  bool result;                // result of this command, false -> rejected
+  bool a_enabled, b_enabled;
+  bool a_power, b_power;
+  uint32_t a_rpm, b_rpm;      // target speed
+  int mode;
+  uint8_t queue_count;
+};
+
 // Function prototypes
-bool mot_a_timer_callback(struct repeating_timer *t);
-bool mot_b_timer_callback(struct repeating_timer *t);
+#ifdef STEP_BACKEND_PWM
+void pwm_wrap_irq(void);
+#else
+void step_alarm_irq(void);
+#endif
 
 
 class Motors {
   private:
     bool a_dir = true;
     bool b_dir = true;
-	  int mot_ramp = MOT_RAMP;
-	  uint32_t calc_step_time(uint32_t current_step_time, bool up);
-    uint32_t a_step_time_target = MOT_STEP_TIME_MAX, b_step_time_target = MOT_STEP_TIME_MAX;
+    uint32_t mot_accel = MOT_RAMP * RAMP_ACCEL_FACTOR;   // RPM/s
+    uint32_t mot_jerk = 0;                               // RPM/s^2
+    uint32_t a_rpm_target = 0, b_rpm_target = 0;
     uint32_t defined_steps_speed;
+    MotionProfile *sync_prof = 0;               // limited mode: profile of the leading motor
+    bool sync_a_leads = true;
+    uint32_t sync_master_events = 0, sync_slave_events = 0;
+    uint32_t sync_events_left = 0;
+    uint32_t sync_err = 0;
+#ifdef STEP_BACKEND_PWM
+    uint32_t a_steps_goal = 0, b_steps_goal = 0; // limited mode: steps to run
+    bool a_pwm_edge = false, b_pwm_edge = false; // the next PWM period has a step
+    uint32_t a_period = 0, b_period = 0;        // last loaded PWM period in us
+    uint32_t sync_ratio = 0;                    // period ratio slave / master, Q16
+    uint32_t sync_frac = 0;                     // remainder of the slave period, Q16
+    uint32_t sync_lead_steps = 0, sync_follow_steps = 0;  // steps counted in sync_lag
+    int64_t sync_lag = 0;                       // slave behind the step ratio, 1/sync_master_events steps
+    uint32_t pwm_period_a(void);
+    uint32_t pwm_period_b(void);
+    void lead_step(uint32_t steps);
+    uint32_t follow_period(uint32_t lead_period, uint32_t steps);
+#else
+    bool a_level = true, b_level = true;        // step pin state
+    uint32_t a_next = 0, b_next = 0;            // timer value of the next event
+    uint32_t sync_master_mask = 0, sync_slave_mask = 0;
+    volatile uint32_t step_due = 0;             // timer value the step interrupt is due at
+    void set_sync_masks(void);
+#endif
+    SegmentQueue queue;
+    bool seg_running = false;                   // the limited run is the head of the queue
+    void setup_sync(const MotionSegment *s);
+    bool next_segment(void);
+    void flush_queue(void);
+    // step generation backend
+    uint32_t step_irq = 0;                      // interrupt of the backend
+    void init_stepping(void);
+    void wake_a(void);
+    void wake_b(void);
+    void halt_a(void);
+    void halt_b(void);
+    void start_sync(void);
+    int64_t mm_to_steps(int64_t len);
+    void run_signed_steps(int64_t steps_a, int64_t steps_b);
+    // command interface between the cores
+    uint32_t cmd_seq = 0;                       // core 0: last submitted command
+    MotorStatus last_status = {};               // core 0: last received status
+    bool status_new = false;
+    MotorCommand batch[MOT_BATCH_MAX];          // core 0: commands of the open batch
+    uint8_t batch_len = 0;
+    bool batching = false;
+    void flush_batch(void);
+    bool execute(const MotorCommand &mc);
+    void make_status(MotorStatus *s, uint32_t seq, bool result);
+#ifdef DUAL_CORE
+    SpscQueue<MotorCommand, MOT_CMD_QUEUE_SIZE> cmd_queue;        // core 0 -> core 1
+    SpscQueue<MotorStatus, MOT_STATUS_QUEUE_SIZE> status_queue;   // core 1 -> core 0
+    MotorStatus published = {};                 // core 1: last published status
+    uint32_t exec_seq = 0;                      // core 1: last executed command
+    bool exec_result = true;
+    volatile bool core1_start = false;          // set by init() on core 0
+    volatile uint8_t flash_park = 0;            // core 1 waits in RAM during a flash write
+    void receive_status(void);
+    void park_core1(void);
+#endif
+    uint32_t flash_irqs = 0;                    // core 0: interrupts masked during a flash write
     
   public:
-    bool a_enabled = false;
-    bool b_enabled = false;
+    volatile bool a_enabled = false;
+    volatile bool b_enabled = false;
     bool a_power = false;
     bool b_power = false;
-  	uint32_t a_step_time = MOT_STEP_TIME_MAX, b_step_time = MOT_STEP_TIME_MAX;
-    int mode = 0;      // 0 -> open mode, 1 -> limited mode
+    MotionProfile prof_a, prof_b;
+    volatile int mode = 0;      // 0 -> open mode, 1 -> limited mode
     uint32_t steps_target = 0;
     volatile uint32_t a_step_cnt = 0, b_step_cnt = 0;   // steps counter
+    volatile int64_t a_pos = 0, b_pos = 0;              // position in microsteps, forward -> positive
+    volatile uint32_t pos_seq = 0;                      // odd while the step interrupt updates a_pos, b_pos
 
     void init(void);
+#ifdef DUAL_CORE
+    void init_core1(void);
+    void run_commands(void);
+#endif
+    uint32_t submit(uint8_t op, int32_t a = 0, int32_t b = 0, int32_t c = 0);
+    bool wait_result(uint32_t seq);
+    void sync(void);
+    void begin_batch(void);
+    void end_batch(void);
+    bool is_batching(void);
+    bool poll_status(MotorStatus *s);
   	void set_a_enable(bool status);
   	void set_b_enable(bool status);
     bool get_a_enabled(void);
@@ -55,8 +216,6 @@ class Motors {
     bool get_b_power(void);
     void set_a_dir(bool status);
     void set_b_dir(bool status);
-  	void check_step_time_a(void);
-  	void check_step_time_b(void);
     void set_a_steptime(uint32_t steptime);
     void set_b_steptime(uint32_t steptime);
     void set_a_rpm(uint32_t rpm);
@@ -65,10 +224,30 @@ class Motors {
     uint32_t get_b_rpm(void);
     void set_ramp(uint32_t ramp);
     uint32_t get_ramp(void);
+    void set_accel(uint32_t accel);
+    uint32_t get_accel(void);
+    void set_jerk(uint32_t jerk);
+    uint32_t get_jerk(void);
     void run_defined_steps(uint32_t steps);
+    void run_sync(uint32_t steps_a, uint32_t steps_b, uint32_t rpm);
+    void run_segment(int32_t steps_a, int32_t steps_b);
+    void run_arc(int32_t length, int32_t radius);
+    void run_turn(int32_t angle);
+    bool queue_segment(int32_t steps_a, int32_t steps_b, uint32_t rpm);
+    uint8_t get_queue_count(void);
+    void get_position(int64_t *pos_a, int64_t *pos_b);
+#ifdef STEP_BACKEND_PWM
+    uint32_t run_pwm_events(void);
+#else
+    uint32_t run_step_events(void);
+#endif
+    void flash_begin(void);
+    void flash_end(void);
     int get_mode(void);
+    bool is_stopped(void);
     void set_defined_steps_speed(uint32_t speed);
     int get_defined_steps_speed(void);
+    void update_config(void);
 	
 };
 
@@ -0,0 +1,215 @@
+/*
+ * Step generation by a single hardware alarm (default backend)
+ * The alarm interrupt toggles the step pins of both motors, one timer event
+ * per half step.
+ */
+
+#include "motors.h"
+#include "trace.h"
+#include "perf.h"
+
+#ifndef STEP_BACKEND_PWM
+
+#include "hardware/timer.h"
+#include "hardware/irq.h"
+#include "hardware/structs/sio.h"
+
+#define MOTA_STEP_MASK (1u << MOTA_STEP)
+#define MOTB_STEP_MASK (1u << MOTB_STEP)
+
+int step_alarm = -1;      // hardware alarm scheduling the steps of both motors
+
+//----------------------------------------------------------------------
+// A single alarm serves both motors, it is only armed while a motor runs
+void Motors::init_stepping(void) {
+  step_alarm = hardware_alarm_claim_unused(true);
+  step_irq = TIMER_IRQ_0 + step_alarm;
+  irq_set_exclusive_handler(TIMER_IRQ_0 + step_alarm, step_alarm_irq);
+  hw_set_bits(&timer_hw->inte, 1u << step_alarm);
+  irq_set_enabled(TIMER_IRQ_0 + step_alarm, true);
+}
+
+//----------------------------------------------------------------------
+// Schedules the first event of an idle motor and wakes up the step
+// interrupt. Called with interrupts disabled.
+void Motors::wake_a(void) {
+  if (!a_enabled) {
+    a_next = timer_hw->timerawl;
+    a_enabled = true;
+  }
+  step_due = timer_hw->timerawl;
+  irq_set_pending(TIMER_IRQ_0 + step_alarm);
+}
+
+//----------------------------------------------------------------------
+void Motors::wake_b(void) {
+  if (!b_enabled) {
+    b_next = timer_hw->timerawl;
+    b_enabled = true;
+  }
+  step_due = timer_hw->timerawl;
+  irq_set_pending(TIMER_IRQ_0 + step_alarm);
+}
+
+//----------------------------------------------------------------------
+// Stops a motor immediately. Called with interrupts disabled.
+void Motors::halt_a(void) {
+  a_enabled = false;
+}
+
+//----------------------------------------------------------------------
+void Motors::halt_b(void) {
+  b_enabled = false;
+}
+
+//----------------------------------------------------------------------
+// Starts a limited run prepared by run_sync(). Called with interrupts disabled.
+void Motors::start_sync(void) {
+  uint32_t next;
+
+  set_sync_masks();
+  if (sync_a_leads) {
+    next = a_enabled ? a_next : timer_hw->timerawl;
+  } else {
+    next = b_enabled ? b_next : timer_hw->timerawl;
+  }
+  a_next = next;
+  b_next = next;
+  mode = 1;
+  a_enabled = true;
+  b_enabled = true;
+  step_due = timer_hw->timerawl;
+  irq_set_pending(TIMER_IRQ_0 + step_alarm);
+}
+
+//----------------------------------------------------------------------
+void STEP_ISR_FUNC(Motors::set_sync_masks)(void) {
+  if (sync_a_leads) {
+    sync_master_mask = MOTA_STEP_MASK;
+    sync_slave_mask = MOTB_STEP_MASK;
+  } else {
+    sync_master_mask = MOTB_STEP_MASK;
+    sync_slave_mask = MOTA_STEP_MASK;
+  }
+}
+
+//-------------------------------------------------------------------
+// run_step_events
+// Called from the step alarm interrupt. Processes the due events of both
+// motors, toggles their step pins with a single write and re-arms the alarm
+// for the earliest next event. In limited mode the motor with more steps
+// runs the profile and the other one follows by Bresenham. Queued segments
+// follow without a stop, the new leading motor takes over the velocity.
+// Returns the latency: time since the interrupt was due.
+uint32_t STEP_ISR_FUNC(Motors::run_step_events)(void) {
+  uint32_t now, next, mask, interval;
+  uint32_t latency = timer_hw->timerawl - step_due;
+  bool due_a, due_b;
+  MotionProfile *prev;
+
+  if ((int32_t) latency < 0) latency = 0;     // raised early (wake)
+  timer_hw->intr = 1u << step_alarm;
+  do {
+    now = timer_hw->timerawl;
+    mask = 0;
+
+    if (mode == 1) {
+      if ((int32_t) (now - a_next) >= 0) {
+        mask = sync_master_mask;
+        sync_err += sync_slave_events;
+        if (sync_err >= sync_master_events) {
+          sync_err -= sync_master_events;
+          mask |= sync_slave_mask;
+        }
+        sio_hw->gpio_togl = mask;
+        sync_events_left -= 1;
+        prev = sync_prof;
+        if (sync_events_left > 0) {
+          interval = sync_prof->next_interval();
+        } else if (next_segment()) {
+          if (sync_prof != prev) sync_prof->continue_from(*prev);
+          set_sync_masks();
+          interval = sync_prof->next_interval();
+        } else {
+          interval = 0;
+        }
+        if (interval == 0) {          // done or stopped by power off
+          a_enabled = false;
+          b_enabled = false;
+          prof_a.reset();
+          prof_b.reset();
+          mode = 0;
+        } else {
+          a_next += interval;
+          b_next = a_next;
+        }
+      }
+    } else {
+      due_a = a_enabled && ((int32_t) (now - a_next) >= 0);
+      due_b = b_enabled && ((int32_t) (now - b_next) >= 0);
+      if (due_a) mask |= MOTA_STEP_MASK;
+      if (due_b) mask |= MOTB_STEP_MASK;
+      sio_hw->gpio_togl = mask;
+      if (due_a) {
+        interval = prof_a.next_interval();
+        if (interval == 0) a_enabled = false;
+        else a_next += interval;
+      }
+      if (due_b) {
+        interval = prof_b.next_interval();
+        if (interval == 0) b_enabled = false;
+        else b_next += interval;
+      }
+    }
+
+    // count rising edges
+    pos_seq += 1;
+    __dmb();
+    if (mask & MOTA_STEP_MASK) {
+      a_level = !a_level;
+      if (a_level) {
+        a_step_cnt += 1;
+        a_pos += a_dir ? 1 : -1;
+      }
+    }
+    if (mask & MOTB_STEP_MASK) {
+      b_level = !b_level;
+      if (b_level) {
+        b_step_cnt += 1;
+        b_pos += b_dir ? 1 : -1;
+      }
+    }
+    __dmb();
+    pos_seq += 1;
+
+    if (mode == 1) {
+      next = a_next;
+    } else if (a_enabled && b_enabled) {
+      next = ((int32_t) (a_next - b_next) < 0) ? a_next : b_next;
+    } else if (a_enabled) {
+      next = a_next;
+    } else if (b_enabled) {
+      next = b_next;
+    } else {
+      timer_hw->armed = 1u << step_alarm;     // both motors idle
+      return latency;
+    }
+    step_due = next;
+    timer_hw->alarm[step_alarm] = next;
+  } while ((int32_t) (next - timer_hw->timerawl) <= 0);
+  return latency;
+}
+
+//-------------------------------------------------------------------
+void STEP_ISR_FUNC(step_alarm_irq)(void) {
+  extern Motors motors;
+  extern PerfCounters perf;
+  uint32_t t = time_us_32();
+  uint32_t latency;
+  TRACE_BEGIN(TRACE_STEP_ISR);
+  latency = motors.run_step_events();
+  TRACE_END(TRACE_STEP_ISR);
+  perf.add_step_isr(time_us_32() - t, latency);
+}
+
+#endif
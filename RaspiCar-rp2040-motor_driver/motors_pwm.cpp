@@ -0,0 +1,302 @@
+/*
+ * Step generation by the PWM slices (STEP_BACKEND_PWM)
+ * The PWM hardware generates the step signal with one PWM period per step
+ * and a counter clock of 1 MHz. The wrap interrupt counts the steps and
+ * loads the period after the next one (TOP and CC are double buffered).
+ */
+
+#include "motors.h"
+#include "trace.h"
+#include "perf.h"
+
+#ifdef STEP_BACKEND_PWM
+
+#include "hardware/pwm.h"
+#include "hardware/irq.h"
+#include "hardware/clocks.h"
+
+#define PWM_PERIOD_MAX 65536      // 16 bit counter
+
+uint32_t a_slice, b_slice;        // MOTA_STEP -> slice 2 A, MOTB_STEP -> slice 0 B
+uint32_t a_chan, b_chan;
+
+//----------------------------------------------------------------------
+void Motors::init_stepping(void) {
+  pwm_config cfg = pwm_get_default_config();
+
+  a_slice = pwm_gpio_to_slice_num(MOTA_STEP);
+  a_chan = pwm_gpio_to_channel(MOTA_STEP);
+  b_slice = pwm_gpio_to_slice_num(MOTB_STEP);
+  b_chan = pwm_gpio_to_channel(MOTB_STEP);
+  pwm_config_set_clkdiv(&cfg, (float) clock_get_hz(clk_sys) / 1000000);
+  pwm_init(a_slice, &cfg, false);
+  pwm_init(b_slice, &cfg, false);
+  gpio_set_function(MOTA_STEP, GPIO_FUNC_PWM);
+  gpio_set_function(MOTB_STEP, GPIO_FUNC_PWM);
+
+  pwm_clear_irq(a_slice);
+  pwm_clear_irq(b_slice);
+  pwm_set_irq_enabled(a_slice, true);
+  pwm_set_irq_enabled(b_slice, true);
+  step_irq = PWM_IRQ_WRAP;
+  irq_set_exclusive_handler(PWM_IRQ_WRAP, pwm_wrap_irq);
+  irq_set_enabled(PWM_IRQ_WRAP, true);
+}
+
+//----------------------------------------------------------------------
+// Error term of the limited mode (Bresenham): each step of the leading
+// motor adds the events of the other motor. Called for each period, a
+// step is only counted once.
+void STEP_ISR_FUNC(Motors::lead_step)(uint32_t steps) {
+  if (steps == sync_lead_steps) return;
+  sync_lead_steps = steps;
+  sync_lag += sync_slave_events;
+}
+
+//----------------------------------------------------------------------
+// Period of the following motor: the period of the leading motor scaled by
+// the step ratio, the remainder is carried to the next period. Each step
+// takes the events of the leading motor from the error term, a motor
+// behind (ahead of) the step ratio by 1/8 or 1/2 step runs 1/8 or 1/4
+// faster (slower). So both motors keep the step ratio and finish together.
+uint32_t STEP_ISR_FUNC(Motors::follow_period)(uint32_t lead_period, uint32_t steps) {
+  uint64_t p = umul32x32(lead_period, sync_ratio) + sync_frac;
+  int64_t half = sync_master_events >> 1, eighth = sync_master_events >> 3;
+  uint32_t period;
+
+  if (steps != sync_follow_steps) {
+    sync_follow_steps = steps;
+    sync_lag -= sync_master_events;
+  }
+  sync_frac = p & 0xFFFF;
+  p >>= 16;
+  period = (p > PWM_PERIOD_MAX) ? PWM_PERIOD_MAX : p;
+  if (sync_lag > half) period -= period >> 2;
+  else if (sync_lag > eighth) period -= period >> 3;
+  else if (sync_lag < -half) period += period >> 2;
+  else if (sync_lag < -eighth) period += period >> 3;
+  return period;
+}
+
+//----------------------------------------------------------------------
+// Period of the next step of motor A in us, 0 -> no further step.
+// In limited mode the leading motor runs the profile, the other one
+// follows by follow_period().
+uint32_t STEP_ISR_FUNC(Motors::pwm_period_a)(void) {
+  uint32_t period;
+
+  if ((mode == 1) && sync_a_leads) lead_step(a_step_cnt);
+  if ((mode == 1) && (a_step_cnt >= a_steps_goal)) {
+    period = 0;
+  } else if ((mode == 1) && !sync_a_leads) {
+    period = follow_period(b_period, a_step_cnt);
+  } else {
+    period = prof_a.next_interval();
+    if (period) period += prof_a.next_interval();
+  }
+  if (period > PWM_PERIOD_MAX) period = PWM_PERIOD_MAX;
+  a_period = period;
+  return period;
+}
+
+//----------------------------------------------------------------------
+uint32_t STEP_ISR_FUNC(Motors::pwm_period_b)(void) {
+  uint32_t period;
+
+  if ((mode == 1) && !sync_a_leads) lead_step(b_step_cnt);
+  if ((mode == 1) && (b_step_cnt >= b_steps_goal)) {
+    period = 0;
+  } else if ((mode == 1) && sync_a_leads) {
+    period = follow_period(a_period, b_step_cnt);
+  } else {
+    period = prof_b.next_interval();
+    if (period) period += prof_b.next_interval();
+  }
+  if (period > PWM_PERIOD_MAX) period = PWM_PERIOD_MAX;
+  b_period = period;
+  return period;
+}
+
+//----------------------------------------------------------------------
+// Starts the PWM of an idle motor with a step right away, or re-arms a
+// motor that is about to stop. Called with interrupts disabled.
+void STEP_ISR_FUNC(Motors::wake_a)(void) {
+  uint32_t period;
+
+  if (!a_enabled) {
+    period = pwm_period_a();
+    if (period == 0) return;
+    pwm_set_counter(a_slice, 0);
+    pwm_set_wrap(a_slice, period - 1);          // slice stopped: takes effect immediately
+    pwm_set_chan_level(a_slice, a_chan, period / 2);
+    pwm_set_enabled(a_slice, true);
+    pos_seq += 1;
+    __dmb();
+    a_step_cnt += 1;
+    a_pos += a_dir ? 1 : -1;
+    __dmb();
+    pos_seq += 1;
+    a_enabled = true;
+  } else if (a_pwm_edge) {
+    return;
+  }
+  period = pwm_period_a();
+  if (period) {
+    pwm_set_wrap(a_slice, period - 1);
+    pwm_set_chan_level(a_slice, a_chan, period / 2);
+  } else {
+    pwm_set_chan_level(a_slice, a_chan, 0);
+  }
+  a_pwm_edge = period != 0;
+}
+
+//----------------------------------------------------------------------
+void STEP_ISR_FUNC(Motors::wake_b)(void) {
+  uint32_t period;
+
+  if (!b_enabled) {
+    period = pwm_period_b();
+    if (period == 0) return;
+    pwm_set_counter(b_slice, 0);
+    pwm_set_wrap(b_slice, period - 1);
+    pwm_set_chan_level(b_slice, b_chan, period / 2);
+    pwm_set_enabled(b_slice, true);
+    pos_seq += 1;
+    __dmb();
+    b_step_cnt += 1;
+    b_pos += b_dir ? 1 : -1;
+    __dmb();
+    pos_seq += 1;
+    b_enabled = true;
+  } else if (b_pwm_edge) {
+    return;
+  }
+  period = pwm_period_b();
+  if (period) {
+    pwm_set_wrap(b_slice, period - 1);
+    pwm_set_chan_level(b_slice, b_chan, period / 2);
+  } else {
+    pwm_set_chan_level(b_slice, b_chan, 0);
+  }
+  b_pwm_edge = period != 0;
+}
+
+//----------------------------------------------------------------------
+// Stops a motor immediately. Called with interrupts disabled.
+void Motors::halt_a(void) {
+  pwm_set_enabled(a_slice, false);
+  pwm_set_chan_level(a_slice, a_chan, 0);
+  a_pwm_edge = false;
+  a_enabled = false;
+}
+
+//----------------------------------------------------------------------
+void Motors::halt_b(void) {
+  pwm_set_enabled(b_slice, false);
+  pwm_set_chan_level(b_slice, b_chan, 0);
+  b_pwm_edge = false;
+  b_enabled = false;
+}
+
+//----------------------------------------------------------------------
+// Starts a limited run prepared by setup_sync() (with the period ratio).
+// Called with interrupts disabled.
+void STEP_ISR_FUNC(Motors::start_sync)(void) {
+  uint32_t master_steps = sync_master_events / 2;
+  uint32_t slave_steps = sync_slave_events / 2;
+
+  a_steps_goal = sync_a_leads ? master_steps : slave_steps;
+  b_steps_goal = sync_a_leads ? slave_steps : master_steps;
+  // both first steps are counted at the start: in step with the ratio
+  // if the error term is centered
+  sync_frac = 0;
+  sync_lead_steps = 0;
+  sync_follow_steps = 0;
+  sync_lag = (int64_t) sync_master_events - (sync_slave_events >> 1);
+  mode = 1;
+  // the leading motor first, its period is the base of the other one
+  if (sync_a_leads) {
+    wake_a();
+    if (b_steps_goal > 0) wake_b();
+  } else {
+    wake_b();
+    if (a_steps_goal > 0) wake_a();
+  }
+}
+
+//-------------------------------------------------------------------
+// run_pwm_events
+// Called from the PWM wrap interrupt. A period that starts with a step
+// is counted, then the period after the next one is loaded. A period
+// without a step stops the slice. Returns the latency: the counter of the
+// slice (1 MHz) has run since the wrap.
+uint32_t STEP_ISR_FUNC(Motors::run_pwm_events)(void) {
+  uint32_t status = pwm_get_irq_status_mask();
+  uint32_t period, latency;
+
+  latency = pwm_get_counter((status & (1u << a_slice)) ? a_slice : b_slice);
+  pos_seq += 1;
+  __dmb();
+  if (status & (1u << a_slice)) {
+    pwm_clear_irq(a_slice);
+    if (a_pwm_edge) {
+      a_step_cnt += 1;
+      a_pos += a_dir ? 1 : -1;
+      period = pwm_period_a();
+      if (period) {
+        pwm_set_wrap(a_slice, period - 1);
+        pwm_set_chan_level(a_slice, a_chan, period / 2);
+      } else {
+        pwm_set_chan_level(a_slice, a_chan, 0);
+      }
+      a_pwm_edge = period != 0;
+    } else {
+      pwm_set_enabled(a_slice, false);
+      prof_a.reset();
+      a_enabled = false;
+    }
+  }
+
+  if (status & (1u << b_slice)) {
+    pwm_clear_irq(b_slice);
+    if (b_pwm_edge) {
+      b_step_cnt += 1;
+      b_pos += b_dir ? 1 : -1;
+      period = pwm_period_b();
+      if (period) {
+        pwm_set_wrap(b_slice, period - 1);
+        pwm_set_chan_level(b_slice, b_chan, period / 2);
+      } else {
+        pwm_set_chan_level(b_slice, b_chan, 0);
+      }
+      b_pwm_edge = period != 0;
+    } else {
+      pwm_set_enabled(b_slice, false);
+      prof_b.reset();
+      b_enabled = false;
+    }
+  }
+  __dmb();
+  pos_seq += 1;
+
+  // limited run done, queued segments start from standstill
+  if ((mode == 1) && !a_enabled && !b_enabled) {
+    mode = 0;
+    if (next_segment()) start_sync();
+  }
+  return latency;
+}
+
+//-------------------------------------------------------------------
+void STEP_ISR_FUNC(pwm_wrap_irq)(void) {
+  extern Motors motors;
+  extern PerfCounters perf;
+  uint32_t t = time_us_32();
+  uint32_t latency;
+  TRACE_BEGIN(TRACE_STEP_ISR);
+  latency = motors.run_pwm_events();
+  TRACE_END(TRACE_STEP_ISR);
+  perf.add_step_isr(time_us_32() - t, latency);
+}
+
+#endif
@@ -0,0 +1,162 @@
+#include "odometry.h"
+
+struct repeating_timer odometry_timer;
+
+// sin(0 ... 90 degrees), Q15
+const uint16_t sin_tab[257] = {
+  0, 201, 402, 603, 804, 1005, 1206, 1407, 1608, 1809, 2009, 2210,
+  2411, 2611, 2811, 3012, 3212, 3412, 3612, 3812, 4011, 4211, 4410, 4609,
+  4808, 5007, 5205, 5404, 5602, 5800, 5998, 6195, 6393, 6590, 6787, 6983,
+  7180, 7376, 7571, 7767, 7962, 8157, 8351, 8546, 8740, 8933, 9127, 9319,
+  9512, 9704, 9896, 10088, 10279, 10469, 10660, 10850, 11039, 11228, 11417, 11605,
+  11793, 11980, 12167, 12354, 12540, 12725, 12910, 13095, 13279, 13463, 13646, 13828,
+  14010, 14192, 14373, 14553, 14733, 14912, 15091, 15269, 15447, 15624, 15800, 15976,
+  16151, 16326, 16500, 16673, 16846, 17018, 17190, 17361, 17531, 17700, 17869, 18037,
+  18205, 18372, 18538, 18703, 18868, 19032, 19195, 19358, 19520, 19681, 19841, 20001,
+  20160, 20318, 20475, 20632, 20788, 20943, 21097, 21251, 21403, 21555, 21706, 21856,
+  22006, 22154, 22302, 22449, 22595, 22740, 22884, 23028, 23170, 23312, 23453, 23593,
+  23732, 23870, 24008, 24144, 24279, 24414, 24548, 24680, 24812, 24943, 25073, 25202,
+  25330, 25457, 25583, 25708, 25833, 25956, 26078, 26199, 26320, 26439, 26557, 26674,
+  26791, 26906, 27020, 27133, 27246, 27357, 27467, 27576, 27684, 27791, 27897, 28002,
+  28106, 28209, 28311, 28411, 28511, 28610, 28707, 28803, 28899, 28993, 29086, 29178,
+  29269, 29359, 29448, 29535, 29622, 29707, 29792, 29875, 29957, 30038, 30118, 30196,
+  30274, 30350, 30425, 30499, 30572, 30644, 30715, 30784, 30853, 30920, 30986, 31050,
+  31114, 31177, 31238, 31298, 31357, 31415, 31471, 31527, 31581, 31634, 31686, 31737,
+  31786, 31834, 31881, 31927, 31972, 32015, 32058, 32099, 32138, 32177, 32214, 32251,
+  32286, 32319, 32352, 32383, 32413, 32442, 32470, 32496, 32522, 32546, 32568, 32590,
+  32610, 32629, 32647, 32664, 32679, 32693, 32706, 32718, 32729, 32738, 32746, 32753,
+  32758, 32762, 32766, 32767, 32768
+
+};
+
+// 0.1 mm per microstep, Q16: pi * WHEEL_DIAMETER * 10 / STEPS_PER_ROTATION, pi ~ 355 / 113
+#define ODO_MM10_PER_STEP ((((uint64_t) WHEEL_DIAMETER * 10 * 355) << 16) / (113 * STEPS_PER_ROTATION))
+
+//-------------------------------------------------------------------------
+void Odometry::init(void) {
+  reset();
+  add_repeating_timer_ms(ODO_UPDATE_MS, odometry_timer_callback, NULL, &odometry_timer);
+}
+
+//-------------------------------------------------------------------------
+// Sets the pose to zero at the current position
+void Odometry::reset(void) {
+  extern Motors motors;
+
+  motors.get_position(&base_a, &base_b);
+  last_a = base_a;
+  last_b = base_b;
+  x = 0;
+  y = 0;
+  heading = 0;
+  time = time_us_32();
+}
+
+//-------------------------------------------------------------------------
+// calc_heading
+// The heading is taken from the total positions, so it doesn't drift by
+// rounding: (s_a - s_b) * WHEEL_DIAMETER * 2^31 / (STEPS_PER_ROTATION * WHEEL_TRACK),
+// with the difference reduced to one turn first
+uint32_t Odometry::calc_heading(int64_t pos_a, int64_t pos_b) {
+  const int64_t turn = 2 * (int64_t) STEPS_PER_ROTATION * WHEEL_TRACK;
+  int64_t m;
+
+  m = ((pos_a - base_a) - (pos_b - base_b)) * WHEEL_DIAMETER % turn;
+  if (m < 0) m += turn;
+  return (m << 31) / (STEPS_PER_ROTATION * WHEEL_TRACK);
+}
+
+//-------------------------------------------------------------------------
+// update
+// Integrates the path since the last update along the mean heading.
+// Called every ODO_UPDATE_MS from the main loop.
+void Odometry::update(void) {
+  extern Motors motors;
+  int64_t pos_a, pos_b, ds;
+  uint32_t h, h_mid;
+
+  motors.get_position(&pos_a, &pos_b);
+  time = time_us_32();
+  h = calc_heading(pos_a, pos_b);
+  ds = (pos_a - last_a) + (pos_b - last_b);       // twice the path of the center
+  if (ds != 0) {
+    h_mid = heading + (int32_t) (h - heading) / 2;
+    x += (ds * icos(h_mid)) >> 1;
+    y += (ds * isin(h_mid)) >> 1;
+  }
+  heading = h;
+  last_a = pos_a;
+  last_b = pos_b;
+}
+
+//-------------------------------------------------------------------------
+// Streams the pose with the given rate, 0 -> off
+void Odometry::set_stream(uint32_t hz) {
+  if (hz > ODO_STREAM_MAX) hz = ODO_STREAM_MAX;
+  stream_period = (hz == 0) ? 0 : 1000 / ODO_UPDATE_MS / hz;
+  stream_cnt = 0;
+}
+
+//-------------------------------------------------------------------------
+// Returns true if the pose is to be sent, called after each update
+bool Odometry::stream_due(void) {
+  if (stream_period == 0) return false;
+  stream_cnt += 1;
+  if (stream_cnt < stream_period) return false;
+  stream_cnt = 0;
+  return true;
+}
+
+//-------------------------------------------------------------------------
+// Position in 0.1 mm
+int32_t Odometry::get_x(void) {
+  return (x * (int64_t) ODO_MM10_PER_STEP) >> 31;
+}
+
+//-------------------------------------------------------------------------
+int32_t Odometry::get_y(void) {
+  return (y * (int64_t) ODO_MM10_PER_STEP) >> 31;
+}
+
+//-------------------------------------------------------------------------
+// Heading in 0.01 degree, -18000 ... 17999
+int32_t Odometry::get_heading(void) {
+  return ((int64_t) (int32_t) heading * 36000) >> 32;
+}
+
+//-------------------------------------------------------------------------
+// Time of the last update in us (wraps after 71 minutes)
+uint32_t Odometry::get_time(void) {
+  return time;
+}
+
+//-------------------------------------------------------------------------
+// Sine of a binary angle (2^32 -> 360 degrees), Q15. Quarter wave table
+// with linear interpolation.
+int32_t isin(uint32_t angle) {
+  uint32_t quadrant = angle >> 30;
+  uint32_t pos = (angle & 0x3FFFFFFF) >> 14;      // table index, Q8
+  uint32_t i;
+  int32_t s;
+
+  if (quadrant & 1) pos = 0x10000 - pos;
+  i = pos >> 8;
+  if (i >= 256) {
+    s = sin_tab[256];
+  } else {
+    s = sin_tab[i] + (((int32_t) (sin_tab[i + 1] - sin_tab[i]) * (int32_t) (pos & 0xFF)) >> 8);
+  }
+  return (quadrant & 2) ? -s : s;
+}
+
+//-------------------------------------------------------------------------
+int32_t icos(uint32_t angle) {
+  return isin(angle + 0x40000000);
+}
+
+//-------------------------------------------------------------------
+bool odometry_timer_callback(struct repeating_timer *t) {
+  extern volatile uint8_t job_flags;
+  job_flags |= (1 << JF_ODOMETRY);
+  return true;
+}
@@ -0,0 +1,45 @@
+#ifndef __ODOMETRY__
+#define __ODOMETRY__
+
+#include "RaspiCar-rp2040-motor_driver.h"
+#include "motors.h"
+
+// Job flags
+#define JF_ODOMETRY            1
+
+#define ODO_UPDATE_MS         10  // pose update period
+#define ODO_STREAM_MAX       100  // Hz
+
+// Differential drive pose from the position counters of the motors.
+// Motor A is the right wheel. x points forward and y to the left at the
+// last reset, the heading counts counter-clockwise.
+class Odometry {
+  private:
+    int64_t base_a = 0, base_b = 0;   // positions at the last reset
+    int64_t last_a = 0, last_b = 0;   // positions at the last update
+    int64_t x = 0, y = 0;             // Q15 microsteps
+    uint32_t heading = 0;             // binary angle, 2^32 -> 360 degrees
+    uint32_t time = 0;                // us, time of the last update
+    uint8_t stream_period = 0;        // update periods, 0 -> no stream
+    uint8_t stream_cnt = 0;
+    uint32_t calc_heading(int64_t pos_a, int64_t pos_b);
+
+  public:
+    void init(void);
+    void reset(void);
+    void update(void);
+    void set_stream(uint32_t hz);
+    bool stream_due(void);
+    int32_t get_x(void);
+    int32_t get_y(void);
+    int32_t get_heading(void);
+    uint32_t get_time(void);
+};
+
+int32_t isin(uint32_t angle);
+int32_t icos(uint32_t angle);
+
+// Function prototypes
+bool odometry_timer_callback(struct repeating_timer *t);
+
+#endif
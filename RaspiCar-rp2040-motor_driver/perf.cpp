@@ -0,0 +1,92 @@
+#include "perf.h"
+#include "serial_link.h"
+
+
+//-------------------------------------------------------------------------
+void PerfCounters::init(void) {
+  reset();
+}
+
+//-------------------------------------------------------------------------
+// Starts a new window. The maxima of the step interrupt are written by the
+// other core in dual core mode, a step interrupt at the same moment may
+// keep its value.
+void PerfCounters::reset(void) {
+  extern SerialLink uart_link;
+
+  start = time_us_64();
+  loops = 0;
+  loop_last = (uint32_t) start;
+  loop_max = 0;
+  isr_folded = isr_us;
+  isr_total = 0;
+  isr_count_ref = isr_count;
+  isr_max = 0;
+  isr_latency_max = 0;
+  cmds = 0;
+  decode_max = 0;
+  rx_overruns_ref = uart_link.get_rx_overruns();
+  rx_overflows_ref = uart_link.get_rx_overflows();
+}
+
+//-------------------------------------------------------------------------
+// Called at the start of each pass of the main loop
+void PerfCounters::loop_tick(void) {
+  uint32_t now = time_us_32();
+  uint32_t isr = isr_us;
+
+  if (now - loop_last > loop_max) loop_max = now - loop_last;
+  if (now - loop_last > tlm_loop_max) tlm_loop_max = now - loop_last;
+  loop_last = now;
+  loops += 1;
+  tlm_loops += 1;
+  isr_total += isr - isr_folded;
+  isr_folded = isr;
+}
+
+//-------------------------------------------------------------------------
+// Called by the step interrupt with its run time and latency
+void STEP_ISR_FUNC(PerfCounters::add_step_isr)(uint32_t us, uint32_t latency) {
+  isr_us += us;
+  isr_count += 1;
+  if (us > isr_max) isr_max = us;
+  if (latency > isr_latency_max) isr_latency_max = latency;
+}
+
+//-------------------------------------------------------------------------
+// Called by the main loop after each command or frame with its run time
+void PerfCounters::add_decode(uint32_t us) {
+  cmds += 1;
+  if (us > decode_max) decode_max = us;
+}
+
+//-------------------------------------------------------------------------
+// Rates and maxima since the last reset
+void PerfCounters::take_stats(PerfStats *st, bool reset) {
+  extern SerialLink uart_link;
+  uint64_t window = time_us_64() - start;
+
+  loop_tick();
+  if (window == 0) window = 1;
+  st->window_ms = window / 1000;
+  st->loops_per_s = loops * 1000000 / window;
+  st->loop_max_us = loop_max;
+  st->isr_load = isr_total * 1000 / window;
+  st->isr_per_s = (uint64_t) (isr_count - isr_count_ref) * 1000000 / window;
+  st->isr_max_us = isr_max;
+  st->rx_overruns = uart_link.get_rx_overruns() - rx_overruns_ref;
+  st->rx_overflows = uart_link.get_rx_overflows() - rx_overflows_ref;
+  st->cmds_per_s = (uint64_t) cmds * 1000000 / window;
+  st->decode_max_us = decode_max;
+  st->isr_latency_max_us = isr_latency_max;
+  if (reset) this->reset();
+}
+
+//-------------------------------------------------------------------------
+// Loop passes and longest pass since the last call (telemetry)
+void PerfCounters::take_loop_stats(uint32_t *n, uint32_t *max_us) {
+  *n = tlm_loops;
+  *max_us = tlm_loop_max;
+  tlm_loops = 0;
+  tlm_loop_max = 0;
+}
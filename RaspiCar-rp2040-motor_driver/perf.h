@@ -0,0 +1,59 @@
+#ifndef __PERF__
+#define __PERF__
+
+#include "RaspiCar-rp2040-motor_driver.h"
+
+// Rates and maxima of a window
+struct PerfStats {
+  uint32_t window_ms;
+  uint32_t loops_per_s;                       // main loop passes
+  uint32_t loop_max_us;                       // longest main loop pass
+  uint32_t isr_load;                          // time in the step interrupt, 0.1 %
+  uint32_t isr_per_s;
+  uint32_t isr_max_us;
+  uint32_t rx_overruns;                       // bytes lost in the UART FIFO
+  uint32_t rx_overflows;                      // bytes lost in the ring buffer
+  uint32_t cmds_per_s;                        // commands and frames decoded
+  uint32_t decode_max_us;
+  uint32_t isr_latency_max_us;                // step interrupt after its event
+};
+
+// Runtime performance counters ("GL"): main loop passes, time in the step
+// interrupt and the command decoder, serial receive losses. The counters
+// run since the last reset ("GLR" reads and resets), the rates are averaged
+// over this window. The step interrupt adds its time on the core it runs
+// on, the main loop folds it into a 64 bit total, so it does not wrap.
+// The latency is the delay of the step interrupt after the time of its
+// event, e.g. by XIP cache misses or a flash write. The telemetry ("$T")
+// takes the loop passes since its last line from the same counting.
+class PerfCounters {
+  private:
+    uint64_t start = 0;                       // us, start of the window
+    uint64_t loops = 0;
+    uint32_t loop_last = 0;                   // us, start of the last loop pass
+    uint32_t loop_max = 0;                    // us, longest loop pass
+    uint32_t tlm_loops = 0;                   // loop passes since the last telemetry line
+    uint32_t tlm_loop_max = 0;                // us, longest loop pass since the last telemetry line
+    volatile uint32_t isr_us = 0;             // us in the step interrupt, wraps
+    volatile uint32_t isr_count = 0;
+    volatile uint32_t isr_max = 0;            // us, longest step interrupt
+    volatile uint32_t isr_latency_max = 0;    // us, longest delay of the step interrupt
+    uint32_t isr_folded = 0;                  // isr_us already in isr_total
+    uint64_t isr_total = 0;                   // us in the step interrupt
+    uint32_t isr_count_ref = 0;
+    uint32_t cmds = 0;                        // commands and frames decoded
+    uint32_t decode_max = 0;                  // us, longest command
+    uint32_t rx_overruns_ref = 0;
+    uint32_t rx_overflows_ref = 0;
+
+  public:
+    void init(void);
+    void reset(void);
+    void loop_tick(void);
+    void add_step_isr(uint32_t us, uint32_t latency);
+    void add_decode(uint32_t us);
+    void take_stats(PerfStats *st, bool reset);
+    void take_loop_stats(uint32_t *n, uint32_t *max_us);
+};
+
+#endif
@@ -0,0 +1,116 @@
+#include "segment_queue.h"
+
+//-------------------------------------------------------------------------
+// Step counts and speeds of a segment, the other motor steps in proportion
+void init_segment(MotionSegment *s, int32_t steps_a, int32_t steps_b, uint32_t rpm) {
+  uint32_t lead, follow;
+
+  lead = max(abs(steps_a), abs(steps_b));
+  follow = min(abs(steps_a), abs(steps_b));
+  s->steps_a = steps_a;
+  s->steps_b = steps_b;
+  s->rpm = rpm;
+  s->rpm_follow = (lead > 0) ? (uint64_t) rpm * follow / lead : 0;
+  s->v_cruise = rpm_to_velocity(rpm);
+  s->v_follow = rpm_to_velocity(s->rpm_follow);
+  s->ratio = (follow > 0) ? ((uint64_t) lead << 16) / follow : 0;
+  s->v_junction = 0;
+  s->v_exit = 0;
+}
+
+//-------------------------------------------------------------------------
+// Appends a segment and sets the junction velocity of its predecessor.
+// Returns false if the queue is full.
+bool SegmentQueue::push(int32_t steps_a, int32_t steps_b, uint32_t rpm, uint32_t v_jump) {
+  MotionSegment *s;
+  uint8_t last;
+
+  if (count() >= SEG_QUEUE_SIZE - 1) return false;
+  s = &seg[tail];
+  init_segment(s, steps_a, steps_b, rpm);
+  if (head != tail) {
+    last = (tail - 1) & (SEG_QUEUE_SIZE - 1);
+    seg[last].v_junction = junction_velocity(&seg[last], s, v_jump);
+  }
+  tail = (tail + 1) & (SEG_QUEUE_SIZE - 1);
+  return true;
+}
+
+//-------------------------------------------------------------------------
+// Oldest segment, 0 -> queue empty
+MotionSegment *STEP_ISR_FUNC(SegmentQueue::peek)(void) {
+  if (head == tail) return 0;
+  return &seg[head];
+}
+
+//-------------------------------------------------------------------------
+void STEP_ISR_FUNC(SegmentQueue::pop)(void) {
+  if (head != tail) head = (head + 1) & (SEG_QUEUE_SIZE - 1);
+}
+
+//-------------------------------------------------------------------------
+void SegmentQueue::clear(void) {
+  head = tail;
+}
+
+//-------------------------------------------------------------------------
+uint8_t SegmentQueue::count(void) {
+  return (tail - head) & (SEG_QUEUE_SIZE - 1);
+}
+
+//-------------------------------------------------------------------------
+// junction_velocity
+// The leading motor has the same velocity at the end of s1 and at the start
+// of s2. The velocity of the other motor jumps if the step ratio changes,
+// the jump of each motor is limited to v_jump. v_jump 0 stops between the
+// segments, also if they are collinear (PWM backend).
+uint32_t SegmentQueue::junction_velocity(MotionSegment *s1, MotionSegment *s2, uint32_t v_jump) {
+  int32_t r1_a, r1_b, r2_a, r2_b;
+  uint32_t m1, m2, dr_a, dr_b, dr, v;
+
+  m1 = max(abs(s1->steps_a), abs(s1->steps_b));
+  m2 = max(abs(s2->steps_a), abs(s2->steps_b));
+  if ((m1 == 0) || (m2 == 0) || (v_jump == 0)) return 0;
+
+  // signed speed ratios of the motors, Q16
+  r1_a = ((int64_t) s1->steps_a << 16) / (int32_t) m1;
+  r1_b = ((int64_t) s1->steps_b << 16) / (int32_t) m1;
+  r2_a = ((int64_t) s2->steps_a << 16) / (int32_t) m2;
+  r2_b = ((int64_t) s2->steps_b << 16) / (int32_t) m2;
+  dr_a = abs(r1_a - r2_a);
+  dr_b = abs(r1_b - r2_b);
+  dr = max(dr_a, dr_b);
+
+  v = min(s1->v_cruise, s2->v_cruise);
+  if ((dr > 0) && (((uint64_t) v_jump << 16) / dr < v)) {
+    v = ((uint64_t) v_jump << 16) / dr;
+  }
+  return v;
+}
+
+//-------------------------------------------------------------------------
+// plan
+// Backward pass from the last segment (which ends with a stop) to the head:
+// the velocity at the end of a segment is limited by its junction and by
+// the velocity from which the next segment can still brake down to its own
+// end velocity. v_entry^2 = v_exit^2 + 2 * a * events (a * 2^17 per event).
+// No forward pass, the motion profile limits the acceleration anyway.
+void SegmentQueue::plan(uint32_t a_max) {
+  uint8_t i;
+  uint32_t v_entry = 0, v_exit, events;
+  uint64_t per_event = (uint64_t) a_max << 17;
+
+  i = tail;
+  while (i != head) {
+    i = (i - 1) & (SEG_QUEUE_SIZE - 1);
+    v_exit = min(seg[i].v_junction, v_entry);
+    seg[i].v_exit = v_exit;
+    events = 2 * max(abs(seg[i].steps_a), abs(seg[i].steps_b));
+    if ((uint64_t) seg[i].v_cruise * seg[i].v_cruise / per_event < events) {
+      v_entry = seg[i].v_cruise;          // long enough to brake from full speed
+    } else {
+      v_entry = isqrt64((uint64_t) v_exit * v_exit + per_event * events);
+      if (v_entry > seg[i].v_cruise) v_entry = seg[i].v_cruise;
+    }
+  }
+}
@@ -0,0 +1,44 @@
+#ifndef __SEGMENT_QUEUE__
+#define __SEGMENT_QUEUE__
+
+#include "RaspiCar-rp2040-motor_driver.h"
+#include "motion_profile.h"
+
+#define SEG_QUEUE_SIZE 16     // power of 2
+#define SEG_STEPS_MAX 1000000 // steps (8 microsteps) of each motor per segment
+
+// Motion segment, both motors run as a limited run. Velocities refer to the
+// leading motor (the one with more steps) in the format of the motion profile.
+// The speeds of the other motor are calculated in advance, so the step
+// interrupt loads the next segment without a division.
+struct MotionSegment {
+  int32_t steps_a, steps_b;   // signed microsteps
+  uint32_t rpm;               // max speed
+  uint32_t rpm_follow;        // max speed of the other motor
+  uint32_t v_cruise;          // max velocity
+  uint32_t v_follow;          // max velocity of the other motor
+  uint32_t ratio;             // steps leading / other motor, Q16 (PWM backend)
+  uint32_t v_junction;        // max velocity at the transition to the next segment
+  uint32_t v_exit;            // planned velocity at the end, 0 -> stop
+};
+
+void init_segment(MotionSegment *s, int32_t steps_a, int32_t steps_b, uint32_t rpm);
+
+// Ring buffer of motion segments with lookahead planner. The main loop
+// pushes and plans, the step interrupt takes the segments from the head.
+class SegmentQueue {
+  private:
+    MotionSegment seg[SEG_QUEUE_SIZE];
+    volatile uint8_t head = 0, tail = 0;
+    uint32_t junction_velocity(MotionSegment *s1, MotionSegment *s2, uint32_t v_jump);
+
+  public:
+    bool push(int32_t steps_a, int32_t steps_b, uint32_t rpm, uint32_t v_jump);
+    MotionSegment *peek(void);
+    void pop(void);
+    void clear(void);
+    uint8_t count(void);
+    void plan(uint32_t a_max);
+};
+
+#endif
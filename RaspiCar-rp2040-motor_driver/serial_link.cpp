@@ -0,0 +1,328 @@
+#include "serial_link.h"
+#include "trace.h"
+#include "config_store.h"
+#include "hardware/irq.h"
+
+//-------------------------------------------------------------------------
+// Starts with the baud rate saved in the configuration (default 115200). If
+// the Raspberry Pi still talks at 115200, the receive errors switch back.
+void SerialLink::init(void) {
+  extern ConfigStore config;
+  uint8_t index;
+
+  index = config.data.serial_baud;
+  baud = (index < SERIAL_BAUD_RATES) ? serial_baud_rates[index] : SERIAL_BAUD;
+  gpio_set_function(SERIAL_TX, GPIO_FUNC_UART);
+  gpio_set_function(SERIAL_RX, GPIO_FUNC_UART);
+  uart_init(uart1, baud);
+
+  irq_set_exclusive_handler(UART1_IRQ, uart_irq);
+  irq_set_enabled(UART1_IRQ, true);
+  uart_set_irq_enables(uart1, true, false);   // RX and RX timeout, TX is enabled while sending
+}
+
+//-------------------------------------------------------------------------
+// run_irq
+// Called from the UART interrupt (RX FIFO level, receive timeout or TX
+// FIFO level). Takes the data register including the error flags of each
+// byte, bytes with framing, parity or break errors are dropped. Then the
+// TX FIFO is refilled.
+void SerialLink::run_irq(void) {
+  uint32_t dr;
+
+  while (uart_is_readable(uart1)) {
+    dr = uart_get_hw(uart1)->dr;
+    if (dr & UART_UARTDR_OE_BITS) rx_overruns += 1;
+    if (dr & (UART_UARTDR_BE_BITS | UART_UARTDR_PE_BITS | UART_UARTDR_FE_BITS)) {
+      rx_errors += 1;
+    } else if (!rx.push(dr & 0xFF)) {
+      rx_overflows += 1;
+    }
+  }
+  run_tx();
+}
+
+//-------------------------------------------------------------------------
+// Fills the TX FIFO from the ring buffer, the TX interrupt stays enabled
+// as long as there is data left. Called from the interrupt or with the
+// interrupt disabled.
+void SerialLink::run_tx(void) {
+  uint8_t c;
+
+  while (uart_is_writable(uart1) && tx.pop(c)) {
+    uart_get_hw(uart1)->dr = c;
+  }
+  if (tx.count() == 0) {
+    hw_clear_bits(&uart_get_hw(uart1)->imsc, UART_UARTIMSC_TXIM_BITS);
+  } else {
+    hw_set_bits(&uart_get_hw(uart1)->imsc, UART_UARTIMSC_TXIM_BITS);
+  }
+}
+
+//-------------------------------------------------------------------------
+// The TX interrupt is only raised when the FIFO level drops, so the FIFO
+// is primed from the main loop
+void SerialLink::start_tx(void) {
+  irq_set_enabled(UART1_IRQ, false);
+  run_tx();
+  irq_set_enabled(UART1_IRQ, true);
+}
+
+//-------------------------------------------------------------------------
+void SerialLink::put(uint8_t c) {
+  uint32_t n;
+
+  if (muted) return;
+  if (!tx.push(c)) {
+    tx_waits += 1;
+    do {
+      start_tx();
+    } while (!tx.push(c));
+  }
+  n = tx.count();
+  if (n > tx_high_water) tx_high_water = n;
+}
+
+//-------------------------------------------------------------------------
+void SerialLink::write(const uint8_t *src, uint32_t n) {
+  while (n--) put(*src++);
+  start_tx();
+}
+
+//-------------------------------------------------------------------------
+void SerialLink::puts(const char *s) {
+  while (*s) put_text(*s++);
+  start_tx();
+}
+
+//-------------------------------------------------------------------------
+// Text char. While joining, the line ends of the replies are collected and
+// sent as a single ';' before the next reply. Each line of a tagged reply
+// starts with the tag.
+void SerialLink::put_text(char c) {
+  const char *t;
+
+  if (joining && ((c == '\r') || (c == '\n'))) {
+    join_pending = true;
+    return;
+  }
+  if (line_start) {
+    for (t = tag; *t; t++) put(*t);
+    line_start = false;
+  }
+  if (join_pending) {
+    put(';');
+    join_pending = false;
+  }
+  put(c);
+  if (c == '\n') line_start = true;
+}
+
+//-------------------------------------------------------------------------
+// The reply lines up to end_tag() start with "#<seq> "
+void SerialLink::begin_tag(uint32_t seq) {
+  char digits[10];
+  uint8_t n = 0, i = 0;
+
+  do {
+    digits[n++] = '0' + seq % 10;
+    seq /= 10;
+  } while (seq > 0);
+  tag[i++] = '#';
+  while (n > 0) tag[i++] = digits[--n];
+  tag[i++] = ' ';
+  tag[i] = '\0';
+}
+
+//-------------------------------------------------------------------------
+void SerialLink::end_tag(void) {
+  tag[0] = '\0';
+}
+
+//-------------------------------------------------------------------------
+// The replies up to end_join() form one line
+void SerialLink::begin_join(void) {
+  joining = true;
+  join_pending = false;
+}
+
+//-------------------------------------------------------------------------
+void SerialLink::end_join(void) {
+  joining = false;
+  join_pending = false;
+  puts("\r\n");
+}
+
+//-------------------------------------------------------------------------
+// Decimal number, formatted right into the transmit buffer
+void SerialLink::put_int(int32_t value) {
+  if (value < 0) {
+    put_text('-');
+    put_uint(-(uint32_t) value);
+  } else {
+    put_uint(value);
+  }
+}
+
+//-------------------------------------------------------------------------
+void SerialLink::put_uint(uint32_t value) {
+  char digits[10];
+  uint8_t n = 0;
+
+  do {
+    digits[n++] = '0' + value % 10;
+    value /= 10;
+  } while (value > 0);
+  while (n > 0) put_text(digits[--n]);
+  start_tx();
+}
+
+//-------------------------------------------------------------------------
+// Waits until all data has left the UART
+void SerialLink::flush(void) {
+  while (tx.count() > 0) start_tx();
+  while (uart_get_hw(uart1)->fr & UART_UARTFR_BUSY_BITS) tight_loop_contents();
+}
+
+//-------------------------------------------------------------------------
+// While muted the output is discarded (commands run by the benchmark). The
+// tag and join state of the reply being sent is restored afterwards.
+void SerialLink::set_mute(bool mute) {
+  if (mute == muted) return;
+  if (mute) {
+    strcpy(muted_tag, tag);
+    muted_joining = joining;
+    muted_join_pending = join_pending;
+    muted_line_start = line_start;
+    joining = false;
+    line_start = true;
+  } else {
+    strcpy(tag, muted_tag);
+    joining = muted_joining;
+    join_pending = muted_join_pending;
+    line_start = muted_line_start;
+  }
+  muted = mute;
+}
+
+//-------------------------------------------------------------------------
+// Copies up to max received bytes to dst, returns the number of bytes
+uint32_t SerialLink::read(uint8_t *dst, uint32_t max) {
+  uint32_t n = rx.count();
+
+  if (n > rx_high_water) rx_high_water = n;
+  return rx.read(dst, max);
+}
+
+//-------------------------------------------------------------------------
+// Switches the UART after all pending replies are sent
+void SerialLink::set_baud(uint32_t rate) {
+  flush();
+  uart_set_baudrate(uart1, rate);
+  baud = rate;
+  baud_errors_ref = rx_errors;
+}
+
+//-------------------------------------------------------------------------
+// start_baud_trial
+// Switches to a new baud rate, the Raspberry Pi has to confirm it with a
+// ping within SERIAL_BAUD_TRIAL_US, otherwise check_baud() falls back.
+// Returns false if the rate is not supported.
+bool SerialLink::start_baud_trial(uint32_t rate, bool save) {
+  uint8_t i;
+
+  for (i = 0; i < SERIAL_BAUD_RATES; i++) {
+    if (serial_baud_rates[i] == rate) break;
+  }
+  if (i >= SERIAL_BAUD_RATES) return false;
+  set_baud(rate);
+  baud_trial = rate != SERIAL_BAUD;
+  baud_trial_start = time_us_32();
+  baud_save = save;
+  if (save && !baud_trial) confirm_baud();
+  return true;
+}
+
+//-------------------------------------------------------------------------
+// A ping was received at the current rate: ends the trial and saves the
+// rate if requested
+void SerialLink::confirm_baud(void) {
+  extern ConfigStore config;
+  uint8_t i;
+
+  rx_valid();
+  if (!baud_trial && !baud_save) return;
+  baud_trial = false;
+  if (baud_save) {
+    baud_save = false;
+    for (i = 0; i < SERIAL_BAUD_RATES; i++) {
+      if (serial_baud_rates[i] == baud) break;
+    }
+    config.data.serial_baud = i;
+    config.changed();
+  }
+}
+
+//-------------------------------------------------------------------------
+// A valid command was received, errors before do not count
+void SerialLink::rx_valid(void) {
+  baud_errors_ref = rx_errors;
+}
+
+//-------------------------------------------------------------------------
+// check_baud
+// Called from the main loop. Falls back to 115200 if a trial is not
+// confirmed in time or if receive errors pile up at a fast rate (the
+// Raspberry Pi runs at a different rate).
+void SerialLink::check_baud(void) {
+  if (baud == SERIAL_BAUD) return;
+  if ((baud_trial && (time_us_32() - baud_trial_start > SERIAL_BAUD_TRIAL_US)) ||
+      (rx_errors - baud_errors_ref >= SERIAL_BAUD_ERRORS)) {
+    baud_trial = false;
+    baud_save = false;
+    set_baud(SERIAL_BAUD);
+  }
+}
+
+//-------------------------------------------------------------------------
+uint32_t SerialLink::get_baud(void) {
+  return baud;
+}
+
+//-------------------------------------------------------------------------
+uint32_t SerialLink::get_rx_overflows(void) {
+  return rx_overflows;
+}
+
+//-------------------------------------------------------------------------
+uint32_t SerialLink::get_rx_overruns(void) {
+  return rx_overruns;
+}
+
+//-------------------------------------------------------------------------
+uint32_t SerialLink::get_rx_errors(void) {
+  return rx_errors;
+}
+
+//-------------------------------------------------------------------------
+uint32_t SerialLink::get_rx_high_water(void) {
+  return rx_high_water;
+}
+
+//-------------------------------------------------------------------------
+uint32_t SerialLink::get_tx_high_water(void) {
+  return tx_high_water;
+}
+
+//-------------------------------------------------------------------------
+uint32_t SerialLink::get_tx_waits(void) {
+  return tx_waits;
+}
+
+//-------------------------------------------------------------------------
+void uart_irq(void) {
+  extern SerialLink uart_link;
+  TRACE_BEGIN(TRACE_UART_ISR);
+  uart_link.run_irq();
+  TRACE_END(TRACE_UART_ISR);
+}
@@ -0,0 +1,87 @@
+#ifndef __SERIAL_LINK__
+#define __SERIAL_LINK__
+
+#include "RaspiCar-rp2040-motor_driver.h"
+#include "spsc_queue.h"
+
+// supported baud rates, the configuration holds the index
+const uint32_t serial_baud_rates[] = {115200, 230400, 460800, 921600, 1000000};
+#define SERIAL_BAUD_RATES      5
+
+// Pins
+#define SERIAL_TX              8  // serial interface to Raspberry Pi
+#define SERIAL_RX              9
+
+#define SERIAL_BAUD       115200  // default and fallback
+#define SERIAL_BAUD_TRIAL_US 1000000  // time for the ping at the new baud rate
+#define SERIAL_BAUD_ERRORS     4  // receive errors at a fast rate -> fallback
+#define SERIAL_RX_BUF_SIZE   512  // power of 2
+#define SERIAL_TX_BUF_SIZE  1024  // power of 2
+
+// UART1 to the Raspberry Pi. The receive interrupt empties the 32 byte
+// hardware FIFO into a ring buffer, so blocking calls in the main loop
+// (display, EEPROM) no longer lose commands. The main loop takes the
+// received bytes in spans. Replies are formatted into the transmit ring
+// buffer and sent by the transmit interrupt, the main loop only waits if
+// the buffer is full.
+class SerialLink {
+  private:
+    SpscQueue<uint8_t, SERIAL_RX_BUF_SIZE> rx;
+    volatile uint32_t rx_overflows = 0;       // bytes lost, ring buffer full
+    volatile uint32_t rx_overruns = 0;        // bytes lost, hardware FIFO full
+    volatile uint32_t rx_errors = 0;          // framing, parity and break errors
+    uint32_t rx_high_water = 0;               // max fill level of the ring buffer
+    SpscQueue<uint8_t, SERIAL_TX_BUF_SIZE> tx;
+    uint32_t tx_high_water = 0;
+    uint32_t tx_waits = 0;                    // transmit buffer full, main loop had to wait
+    bool muted = false;                       // output discarded (benchmark)
+    char muted_tag[12];                       // reply state kept while muted
+    bool muted_joining = false;
+    bool muted_join_pending = false;
+    bool muted_line_start = true;
+    void put(uint8_t c);
+    void put_text(char c);
+    bool joining = false;                     // replies of a batch: line ends -> ';'
+    bool join_pending = false;
+    char tag[12] = "";                        // prefix of the reply lines, e.g. "#12 "
+    bool line_start = true;
+    void run_tx(void);
+    void start_tx(void);
+    uint32_t baud = SERIAL_BAUD;
+    bool baud_trial = false;                  // new rate not yet confirmed by a ping
+    bool baud_save = false;                   // save the rate once confirmed
+    uint32_t baud_trial_start = 0;
+    uint32_t baud_errors_ref = 0;             // rx_errors at the last valid command
+    void set_baud(uint32_t rate);
+
+  public:
+    void init(void);
+    uint32_t read(uint8_t *dst, uint32_t max);
+    void run_irq(void);
+    void write(const uint8_t *src, uint32_t n);
+    void puts(const char *s);
+    void put_int(int32_t value);
+    void put_uint(uint32_t value);
+    void flush(void);
+    void set_mute(bool mute);
+    void begin_join(void);
+    void end_join(void);
+    void begin_tag(uint32_t seq);
+    void end_tag(void);
+    bool start_baud_trial(uint32_t rate, bool save);
+    void confirm_baud(void);
+    void rx_valid(void);
+    void check_baud(void);
+    uint32_t get_baud(void);
+    uint32_t get_rx_overflows(void);
+    uint32_t get_rx_overruns(void);
+    uint32_t get_rx_errors(void);
+    uint32_t get_rx_high_water(void);
+    uint32_t get_tx_high_water(void);
+    uint32_t get_tx_waits(void);
+};
+
+// Function prototypes
+void uart_irq(void);
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef __SPSC_QUEUE__
+#define __SPSC_QUEUE__
+
+#include <stdint.h>
+
+// Lock-free ring buffer for exactly one producer and one consumer, e.g. the
+// two cores of the rp2040 or a thread pair on the host. The producer owns
+// tail, the consumer owns head. The release store of an index publishes the
+// element (or the free slot) to the other side, no interrupt lock required.
+// Plain C++ without Arduino dependencies, so it can be tested on the host.
+template <typename T, uint32_t N>
+class SpscQueue {
+  static_assert((N & (N - 1)) == 0, "SpscQueue size must be a power of 2");
+
+  private:
+    T item[N];
+    uint32_t head = 0;      // next element to pop, written by the consumer
+    uint32_t tail = 0;      // next free slot, written by the producer
+
+  public:
+    //-------------------------------------------------------------------
+    // Producer side, returns false if the queue is full
+    bool push(const T &t) {
+      uint32_t tl = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+
+      if (tl - __atomic_load_n(&head, __ATOMIC_ACQUIRE) >= N) return false;
+      item[tl & (N - 1)] = t;
+      __atomic_store_n(&tail, tl + 1, __ATOMIC_RELEASE);
+      return true;
+    }
+
+    //-------------------------------------------------------------------
+    // Consumer side, returns false if the queue is empty
+    bool pop(T &t) {
+      uint32_t hd = __atomic_load_n(&head, __ATOMIC_RELAXED);
+
+      if (hd == __atomic_load_n(&tail, __ATOMIC_ACQUIRE)) return false;
+      t = item[hd & (N - 1)];
+      __atomic_store_n(&head, hd + 1, __ATOMIC_RELEASE);
+      return true;
+    }
+
+    //-------------------------------------------------------------------
+    // Consumer side, pops up to max elements to dst in one go, returns
+    // the number of elements
+    uint32_t read(T *dst, uint32_t max) {
+      uint32_t hd = __atomic_load_n(&head, __ATOMIC_RELAXED);
+      uint32_t n = __atomic_load_n(&tail, __ATOMIC_ACQUIRE) - hd;
+      uint32_t i;
+
+      if (n > max) n = max;
+      for (i = 0; i < n; i++) dst[i] = item[(hd + i) & (N - 1)];
+      __atomic_store_n(&head, hd + n, __ATOMIC_RELEASE);
+      return n;
+    }
+
+    //-------------------------------------------------------------------
+    // Number of elements, exact only on the consumer or producer side
+    uint32_t count(void) {
+      return __atomic_load_n(&tail, __ATOMIC_ACQUIRE) - __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+    }
+};
+
+#endif
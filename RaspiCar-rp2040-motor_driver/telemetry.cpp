@@ -0,0 +1,39 @@
+#include "telemetry.h"
+
+struct repeating_timer telemetry_timer;
+
+//-------------------------------------------------------------------------
+void Telemetry::init(void) {
+  add_repeating_timer_ms(TELEMETRY_TICK_MS, telemetry_timer_callback, NULL, &telemetry_timer);
+}
+
+//-------------------------------------------------------------------------
+// Frame rate in Hz (1 ... 100), 0 -> off
+void Telemetry::set_rate(uint32_t rate) {
+  if (rate > TELEMETRY_HZ_MAX) rate = TELEMETRY_HZ_MAX;
+  hz = rate;
+  period = (rate == 0) ? 0 : 1000 / TELEMETRY_TICK_MS / rate;
+  cnt = 0;
+}
+
+//-------------------------------------------------------------------------
+uint32_t Telemetry::get_rate(void) {
+  return hz;
+}
+
+//-------------------------------------------------------------------------
+// Returns true if a frame is to be sent, called on each tick
+bool Telemetry::due(void) {
+  if (period == 0) return false;
+  cnt += 1;
+  if (cnt < period) return false;
+  cnt = 0;
+  return true;
+}
+
+//-------------------------------------------------------------------------
+bool telemetry_timer_callback(struct repeating_timer *t) {
+  extern volatile uint8_t job_flags;
+  job_flags |= (1 << JF_TELEMETRY);
+  return true;
+}
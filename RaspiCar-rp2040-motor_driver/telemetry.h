@@ -0,0 +1,32 @@
+#ifndef __TELEMETRY__
+#define __TELEMETRY__
+
+#include "RaspiCar-rp2040-motor_driver.h"
+
+// Job flags
+#define JF_TELEMETRY           2
+
+#define TELEMETRY_TICK_MS     10
+#define TELEMETRY_HZ_MIN       1
+#define TELEMETRY_HZ_MAX     100
+
+// Periodic status frame pushed to the Raspberry Pi (T<hz>): battery,
+// motors and main loop statistics (PerfCounters). The frames are sent from
+// the main loop between the command replies.
+class Telemetry {
+  private:
+    uint8_t hz = 0;                   // 0 -> off
+    uint8_t period = 0;               // ticks
+    uint8_t cnt = 0;
+
+  public:
+    void init(void);
+    void set_rate(uint32_t rate);
+    uint32_t get_rate(void);
+    bool due(void);
+};
+
+// Function prototypes
+bool telemetry_timer_callback(struct repeating_timer *t);
+
+#endif
@@ -0,0 +1,78 @@
+#include "trace.h"
+
+#ifdef TRACE
+
+#include "serial_link.h"
+#include "pico/platform.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
+#include "hardware/structs/timer.h"
+
+#define TRACE_SETTLE_US       10  // a write of the other core is finished
+
+//-------------------------------------------------------------------------
+// Called from both cores, main loops and interrupts
+void STEP_ISR_FUNC(Trace::add)(uint8_t id, uint8_t phase, uint16_t arg) {
+  uint32_t core = get_core_num();
+  uint32_t status;
+  TraceEvent *e;
+
+  if (!enabled) return;
+  status = save_and_disable_interrupts();
+  e = &events[core][head[core] & (TRACE_SIZE - 1)];
+  e->time = timer_hw->timerawl;
+  e->arg = arg;
+  e->id = id;
+  e->type = phase | (core ? TRACE_CORE_BIT : 0);
+  head[core] += 1;
+  restore_interrupts(status);
+}
+
+//-------------------------------------------------------------------------
+void Trace::set_enabled(bool on) {
+  enabled = on;
+}
+
+//-------------------------------------------------------------------------
+bool Trace::is_enabled(void) {
+  return enabled;
+}
+
+//-------------------------------------------------------------------------
+// dump
+// Sends the events of both rings, oldest first, and clears them. The
+// trace is stopped meanwhile, the main loop waits for the transmit buffer.
+void Trace::dump(void) {
+  extern SerialLink uart_link;
+  uint32_t n[2], first, count;
+  uint16_t crc = 0xFFFF;
+  uint8_t c[2];
+  bool was_enabled = enabled;
+  TraceEvent *e;
+
+  enabled = false;
+  busy_wait_us_32(TRACE_SETTLE_US);
+  for (int core = 0; core < 2; core++) {
+    n[core] = (head[core] < TRACE_SIZE) ? head[core] : TRACE_SIZE;
+  }
+  uart_link.puts("TRACE ");
+  uart_link.put_uint(n[0] + n[1]);
+  uart_link.puts(",");
+  uart_link.put_uint(timer_hw->timerawl);
+  uart_link.puts("\r\n");
+  for (int core = 0; core < 2; core++) {
+    first = head[core] - n[core];
+    for (count = 0; count < n[core]; count++) {
+      e = &events[core][(first + count) & (TRACE_SIZE - 1)];
+      uart_link.write((const uint8_t *) e, sizeof(TraceEvent));
+      crc = crc16_ccitt((const uint8_t *) e, sizeof(TraceEvent), crc);
+    }
+    head[core] = 0;
+  }
+  c[0] = crc & 0xFF;
+  c[1] = crc >> 8;
+  uart_link.write(c, 2);
+  enabled = was_enabled;
+}
+
+#endif
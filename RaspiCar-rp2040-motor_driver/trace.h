@@ -0,0 +1,67 @@
+#ifndef __TRACE__
+#define __TRACE__
+
+#include "RaspiCar-rp2040-motor_driver.h"
+
+//#define TRACE                     // event trace in RAM, dumped by "GT"
+
+#define TRACE_SIZE           512  // events per core, power of 2
+
+// Event ids
+#define TRACE_STEP_ISR         1  // step interrupt (alarm or PWM wrap)
+#define TRACE_UART_ISR         2
+#define TRACE_DECODE           3  // command line or binary frame
+#define TRACE_LCD              4  // display update
+#define TRACE_ADC              5  // battery voltage update, arg: mean of the ADC (12 bit)
+#define TRACE_CONFIG           6  // configuration save (flash erase and program)
+
+// Event type: bits 0, 1 phase, bit 7 core
+#define TRACE_PH_INSTANT       0
+#define TRACE_PH_BEGIN         1
+#define TRACE_PH_END           2
+#define TRACE_CORE_BIT      0x80
+
+// 8 bytes, little endian as dumped
+struct TraceEvent {
+  uint32_t time;                  // us, hardware timer
+  uint16_t arg;
+  uint8_t id;
+  uint8_t type;
+};
+
+#ifdef TRACE
+
+// Flight recorder of timestamped events. Each core writes its own ring, so
+// the cores never wait for each other; on a core the slot is taken with the
+// interrupts disabled for a few cycles, as the ISRs of the core trace too.
+// The oldest events are overwritten. "GT" stops the trace, sends the rings
+// in binary and starts again:
+//   "TRACE <events>,<now us>\r\n", events * 8 bytes, CRC-16 (low byte first)
+class Trace {
+  private:
+    TraceEvent events[2][TRACE_SIZE];
+    volatile uint32_t head[2] = {0, 0};   // events written by each core
+    volatile bool enabled = true;
+
+  public:
+    void add(uint8_t id, uint8_t phase, uint16_t arg);
+    void set_enabled(bool on);
+    bool is_enabled(void);
+    void dump(void);
+};
+
+extern Trace trace;
+
+#define TRACE_BEGIN(id)        trace.add(id, TRACE_PH_BEGIN, 0)
+#define TRACE_END(id)          trace.add(id, TRACE_PH_END, 0)
+#define TRACE_MARK(id, arg)    trace.add(id, TRACE_PH_INSTANT, arg)
+
+#else
+
+#define TRACE_BEGIN(id)        do {} while (0)
+#define TRACE_END(id)          do {} while (0)
+#define TRACE_MARK(id, arg)    do {} while (0)
+
+#endif
+
+#endif
@@ -1,4 +1,4 @@
-#include "util.h"
+#include "RaspiCar-rp2040-motor_driver.h"
 
 
 /* itoaf ---------------------------------------------------------------------------------------------------
@@ -46,3 +46,62 @@ void itoaf(int32_t value, char *s, uint8_t digits, const uint8_t dec_point, bool
   };
   *s = '\0';
 }
+
+/* isqrt64 -------------------------------------------------------------------------------------------------
+* Integer square root (floor) of a 64 bit value, bit by bit without division
+*/
+uint32_t STEP_ISR_FUNC(isqrt64)(uint64_t n) {
+  uint64_t result = 0;
+  uint64_t bit = 1ULL << 62;
+
+  while (bit > n) bit >>= 2;
+  while (bit != 0) {
+    if (n >= result + bit) {
+      n -= result + bit;
+      result = (result >> 1) + bit;
+    } else {
+      result >>= 1;
+    }
+    bit >>= 2;
+  }
+  return (uint32_t) result;
+}
+
+
+/* umul32x32 -----------------------------------------------------------------------------------------------
+* 32 x 32 -> 64 bit product from 16 bit partial products. The Cortex-M0+ only multiplies 32 x 32 -> 32,
+* a 64 bit product calls __aeabi_lmul of the libgcc in flash, which the step interrupt must not use
+* during a flash write.
+*/
+uint64_t STEP_ISR_FUNC(umul32x32)(uint32_t a, uint32_t b) {
+  uint32_t al = a & 0xFFFF, ah = a >> 16;
+  uint32_t bl = b & 0xFFFF, bh = b >> 16;
+  uint32_t ll = al * bl, lh = al * bh, hl = ah * bl;
+  uint32_t mid = (ll >> 16) + (lh & 0xFFFF) + hl;     // at most 2^32 - 1
+
+  return ((uint64_t) (ah * bh + (lh >> 16) + (mid >> 16)) << 32) | ((mid << 16) | (ll & 0xFFFF));
+}
+
+
+/* umul64x32 -----------------------------------------------------------------------------------------------
+* Low 64 bits of a 64 x 32 bit product, as (uint64_t) a * b but without __aeabi_lmul
+*/
+uint64_t STEP_ISR_FUNC(umul64x32)(uint64_t a, uint32_t b) {
+  return umul32x32((uint32_t) a, b) + ((uint64_t) ((uint32_t) (a >> 32) * b) << 32);
+}
+
+
+/* crc16_ccitt ---------------------------------------------------------------------------------------------
+* CRC-16/CCITT-FALSE (polynomial 0x1021, MSB first), start with crc = 0xFFFF
+*/
+uint16_t crc16_ccitt(const uint8_t *data, uint16_t len, uint16_t crc) {
+  uint8_t i;
+
+  while (len--) {
+    crc ^= (uint16_t) *data++ << 8;
+    for (i = 0; i < 8; i++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
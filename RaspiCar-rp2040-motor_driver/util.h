@@ -4,5 +4,9 @@
 #include <arduino.h>
 
 void itoaf(int32_t value, char *s, uint8_t digits, const uint8_t dec_point, bool lead_zero);
+uint32_t isqrt64(uint64_t n);
+uint64_t umul32x32(uint32_t a, uint32_t b);
+uint64_t umul64x32(uint64_t a, uint32_t b);
+uint16_t crc16_ccitt(const uint8_t *data, uint16_t len, uint16_t crc);
 
 #endif